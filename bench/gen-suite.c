@@ -0,0 +1,63 @@
+// Generator of the synthetic sources used by the startup benchmark.
+//
+//   gen-suite.t suite TESTS PADDING   a test suite with TESTS tests and
+//                                     PADDING unrelated global functions
+//   gen-suite.t pad   PADDING NAME    a shared object source with PADDING
+//                                     unrelated global functions
+//
+// Tests are grouped into modules of 10 , every 5th module is a fixture
+// module with a setup and a teardown function. The source is written into
+// the standard output.
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define TESTS_PER_MODULE 10
+#define FIXTURE_EVERY     5
+
+static void GenPadding( const char* prefix , long n ) {
+  long i;
+  for( i = 0 ; i < n ; ++i ) {
+    printf("int %sPad%ld( int x ) { return x + %ld; }\n",prefix,i,i);
+  }
+}
+
+static void GenSuite( long tests , long padding ) {
+  long i;
+
+  printf("#include <src/cunitpp.h>\n\n");
+
+  for( i = 0 ; i < tests ; ++i ) {
+    long module = i / TESTS_PER_MODULE;
+
+    if(module % FIXTURE_EVERY == FIXTURE_EVERY - 1) {
+      if(i % TESTS_PER_MODULE == 0) {
+        printf("static int kFixture%ld;\n",module);
+        printf("TEST_F_SETUP(Module%ld) { return &kFixture%ld; }\n",module,module);
+        printf("TEST_F_TEARDOWN(Module%ld,void* ctx) { (void)ctx; }\n",module);
+      }
+      printf("TEST_F(Module%ld,Test%ld,void* ctx) { ASSERT_TRUE(ctx); }\n",module,i);
+    } else {
+      printf("TEST(Module%ld,Test%ld) { ASSERT_TRUE(1); }\n",module,i);
+    }
+  }
+
+  printf("\n");
+  GenPadding("Suite",padding);
+
+  printf("\nint main( int argc , char* argv[] ) {\n"
+         "  return RunAllTests(argc,argv);\n"
+         "}\n");
+}
+
+int main( int argc , char** argv ) {
+  if(argc == 4 && strcmp(argv[1],"suite") == 0) {
+    GenSuite(atol(argv[2]),atol(argv[3]));
+  } else if(argc == 4 && strcmp(argv[1],"pad") == 0) {
+    GenPadding(argv[3],atol(argv[2]));
+  } else {
+    fprintf(stderr,"usage: %s suite TESTS PADDING | pad PADDING NAME\n",argv[0]);
+    return -1;
+  }
+  return 0;
+}
@@ -0,0 +1,80 @@
+#!/bin/sh
+# Startup and runner overhead benchmark , driven by `make bench`.
+#
+# For each size a synthetic suite is generated , padded with unrelated
+# global functions and linked against a set of padding shared objects. Each
+# suite is run in three modes:
+#
+#   registry  tests are discovered through the cunitpp_tests section
+#   symtab    built with CONFIG_CUNIT_NO_REGISTRY , the symbol table of the
+#             main program is scanned
+#   all       same binary with --option All , every loaded module is found
+#             and the shared objects are checked as well
+#
+# Every run writes the phase timing of the framework via --profile , they are
+# collected into $BENCH_DIR/result.json and printed.
+#
+# Environment: CC , BENCH_DIR (_bench) , BENCH_SIZES ("1000 10000 100000") ,
+# BENCH_PAD_DSO (16) , BENCH_PAD_SYM (5000)
+set -e
+
+CC=${CC:-gcc}
+DIR=${BENCH_DIR:-_bench}
+SIZES=${BENCH_SIZES:-"1000 10000 100000"}
+PAD_DSO=${BENCH_PAD_DSO:-16}
+PAD_SYM=${BENCH_PAD_SYM:-5000}
+GEN=./bench/gen-suite.t
+LIB=./libcunitpp.a
+
+mkdir -p "$DIR"
+ABS=$(cd "$DIR" && pwd)
+
+# 1. padding shared objects , they carry no test and are shared by all sizes
+LIBS=""
+i=0
+while [ $i -lt $PAD_DSO ]; do
+  if [ ! -f "$DIR/libpad$i.so" ]; then
+    $GEN pad $PAD_SYM Lib$i > "$DIR/pad$i.c"
+    $CC -shared -fPIC -O0 "$DIR/pad$i.c" -o "$DIR/libpad$i.so"
+  fi
+  LIBS="$LIBS -lpad$i"
+  i=$((i+1))
+done
+
+Now() {
+  date +%s%N
+}
+
+# Run a suite and append its result , $1 size $2 mode $3 binary $4.. options
+Run() {
+  size=$1 mode=$2 bin=$3
+  shift 3
+  start=$(Now)
+  "$bin" --profile "$DIR/profile.json" "$@" > /dev/null 2>&1 || true
+  end=$(Now)
+  [ -n "$SEP" ] && printf ",\n" >> "$DIR/result.json"
+  printf '  {"tests":%s,"mode":"%s","wall_ns":%s,"profile":%s}' \
+         "$size" "$mode" "$((end-start))" "$(cat "$DIR/profile.json")" >> "$DIR/result.json"
+  SEP=1
+}
+
+printf "[\n" > "$DIR/result.json"
+SEP=""
+
+# 2. suites of each size
+for n in $SIZES; do
+  $GEN suite $n $PAD_SYM > "$DIR/suite-$n.c"
+  for flag in "" "-DCONFIG_CUNIT_NO_REGISTRY"; do
+    out="$DIR/suite-$n${flag:+-noreg}.t"
+    $CC -O0 -I. $flag "$DIR/suite-$n.c" $LIB -o "$out" -L"$DIR" -Wl,--no-as-needed $LIBS \
+        -Wl,-rpath,"$ABS" -lpthread -ldl
+  done
+
+  Run $n registry "$DIR/suite-$n.t"
+  Run $n symtab   "$DIR/suite-$n-noreg.t"
+  Run $n all      "$DIR/suite-$n-noreg.t" --option All
+done
+
+printf "\n]\n" >> "$DIR/result.json"
+rm -f "$DIR/profile.json"
+cat "$DIR/result.json"
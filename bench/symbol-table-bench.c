@@ -0,0 +1,253 @@
+// Micro benchmark of the symbol table. It loads every symbol name of the ELF
+// files given on the command line ( by default the benchmark itself and the
+// libc it links to ) and measures insertion , hit lookup and miss lookup of
+// the flat hash table against the chained open addressing table it replaced.
+#define _GNU_SOURCE
+
+#include <src/elf-image.h>
+#include <src/symbol-table.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <link.h>
+
+#define ROUND 5
+
+/* ---------------------------------------------
+ * Legacy chained table                        |
+ * --------------------------------------------*/
+typedef struct _LegacyEntry {
+  struct _LegacyEntry* chain;
+  void*       info;
+  const char* name;
+  uint64_t    hash;
+} LegacyEntry;
+
+typedef struct _LegacyTable {
+  LegacyEntry* entry;
+  size_t       mask;
+  size_t       size;
+} LegacyTable;
+
+static uint64_t LegacyHash( const char* str , size_t len ) {
+  uint64_t ret = 17771;
+  size_t     i = 0;
+  for( ; i < len ; ++i ) {
+    ret = ret ^ ((ret<<5) + (ret>>2) + str[i]);
+  }
+  return ret;
+}
+
+static LegacyEntry* LegacyFindEntry( LegacyTable* t , const char* name ,
+                                                      uint64_t    hash ,
+                                                      int       insert ) {
+  LegacyEntry* prev  = NULL;
+  LegacyEntry* entry = t->entry + (t->mask & hash);
+  if(!entry->name) return insert ? entry : NULL;
+
+  do {
+    if(entry->hash == hash && strcmp(entry->name,name) == 0) {
+      return entry;
+    }
+    prev = entry;
+    entry= entry->chain;
+  } while(entry);
+
+  if(!insert) return NULL;
+
+  do
+    entry = t->entry + (++hash & t->mask);
+  while(entry->name);
+
+  prev->chain = entry;
+  return entry;
+}
+
+static void LegacyRehash( LegacyTable* t ) {
+  LegacyTable temp;
+  size_t i;
+
+  temp.mask = t->size * 2 - 1;
+  temp.entry= calloc(t->size * 2,sizeof(LegacyEntry));
+
+  for( i = 0 ; i < t->size ; ++i ) {
+    LegacyEntry* e = t->entry + i;
+    LegacyEntry* n = LegacyFindEntry(&temp,e->name,e->hash,1);
+    n->name = e->name;
+    n->hash = e->hash;
+    n->info = e->info;
+  }
+  free(t->entry);
+  t->mask = temp.mask;
+  t->entry= temp.entry;
+}
+
+static void LegacyInit( LegacyTable* t ) {
+  t->mask  = 63;
+  t->size  = 0;
+  t->entry = calloc(64,sizeof(LegacyEntry));
+}
+
+static void LegacyInsert( LegacyTable* t , const char* name ) {
+  uint64_t hash = LegacyHash(name,strlen(name));
+  LegacyEntry* e;
+  if(t->mask + 1 == t->size) LegacyRehash(t);
+  e = LegacyFindEntry(t,name,hash,1);
+  if(!e->name) {
+    ++t->size;
+    e->hash = hash;
+    e->name = name;
+  }
+}
+
+static LegacyEntry* LegacyFind( LegacyTable* t , const char* name ) {
+  return LegacyFindEntry(t,name,LegacyHash(name,strlen(name)),0);
+}
+
+/* ---------------------------------------------
+ * Symbol names                                |
+ * --------------------------------------------*/
+typedef struct _NameList {
+  const char** name;
+  size_t       size;
+  size_t       cap;
+} NameList;
+
+static int OnName( void* d , const char* name , const Elf64_Sym* sym ) {
+  NameList* list = d;
+  (void)sym;
+  if(!*name) return 0;
+  if(list->size == list->cap) {
+    list->cap  = list->cap ? list->cap * 2 : 1024;
+    list->name = realloc(list->name,sizeof(const char*) * list->cap);
+  }
+  list->name[list->size++] = name;
+  return 0;
+}
+
+static int LoadNames( ElfImage* img , const char* path , NameList* list ) {
+  const Elf64_Shdr* shdr;
+  if(ElfImageOpen(img,path)) {
+    fprintf(stderr,"cannot open elf file %s\n",path);
+    return -1;
+  }
+  if((shdr = ElfImageFindSectionByType(img,SHT_SYMTAB)))
+    ElfImageForeachSymbol(img,shdr,OnName,list);
+  if((shdr = ElfImageFindSectionByType(img,SHT_DYNSYM)))
+    ElfImageForeachSymbol(img,shdr,OnName,list);
+  return 0;
+}
+
+static int FindLibc( struct dl_phdr_info* info , size_t size , void* d ) {
+  (void)size;
+  if(strstr(info->dlpi_name,"libc.so")) {
+    *(const char**)(d) = info->dlpi_name;
+    return 1;
+  }
+  return 0;
+}
+
+/* ---------------------------------------------
+ * Benchmark                                   |
+ * --------------------------------------------*/
+static double Now() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC,&ts);
+  return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+static void Report( const char* table , const char* op , double ns , size_t n ) {
+  printf("%-8s %-8s %10.2f ns/op\n",table,op,ns / (double)(n));
+}
+
+int main( int argc , char** argv ) {
+  ElfImage   img[16];
+  size_t     nimg = 0;
+  NameList   list = { NULL , 0 , 0 };
+  char**     miss;
+  size_t     i , hit;
+  int        r;
+  double     t0 , best[6];
+
+  if(argc > 1) {
+    for( r = 1 ; r < argc && nimg < 16 ; ++r )
+      if(!LoadNames(img + nimg,argv[r],&list)) ++nimg;
+  } else {
+    const char* libc = NULL;
+    if(!LoadNames(img + nimg,"/proc/self/exe",&list)) ++nimg;
+    dl_iterate_phdr(FindLibc,&libc);
+    if(libc && !LoadNames(img + nimg,libc,&list)) ++nimg;
+  }
+
+  if(!list.size) {
+    fprintf(stderr,"no symbol found\n");
+    return -1;
+  }
+
+  // names that are not in the table but share a common prefix with them
+  miss = malloc(sizeof(char*) * list.size);
+  for( i = 0 ; i < list.size ; ++i ) {
+    size_t len = strlen(list.name[i]);
+    miss[i] = malloc(len + 2);
+    memcpy(miss[i],list.name[i],len);
+    miss[i][len] = '\x01';
+    miss[i][len+1] = 0;
+  }
+
+  printf("%zu symbol names from %zu files\n",list.size,nimg);
+
+  for( i = 0 ; i < 6 ; ++i ) best[i] = 1e300;
+
+  for( r = 0 ; r < ROUND ; ++r ) {
+    LegacyTable lt;
+    SymbolTable st;
+    double d;
+
+    LegacyInit(&lt);
+    t0 = Now();
+    for( i = 0 ; i < list.size ; ++i ) LegacyInsert(&lt,list.name[i]);
+    if((d = Now() - t0) < best[0]) best[0] = d;
+
+    t0 = Now();
+    for( hit = 0 , i = 0 ; i < list.size ; ++i ) hit += LegacyFind(&lt,list.name[i]) != NULL;
+    if((d = Now() - t0) < best[1]) best[1] = d;
+    if(hit != list.size) fprintf(stderr,"legacy table lost symbols\n");
+
+    t0 = Now();
+    for( hit = 0 , i = 0 ; i < list.size ; ++i ) hit += LegacyFind(&lt,miss[i]) != NULL;
+    if((d = Now() - t0) < best[2]) best[2] = d;
+
+    SymbolTableInit(&st,64);
+    t0 = Now();
+    for( i = 0 ; i < list.size ; ++i ) SymbolTableInsert(&st,list.name[i]);
+    if((d = Now() - t0) < best[3]) best[3] = d;
+
+    t0 = Now();
+    for( hit = 0 , i = 0 ; i < list.size ; ++i ) hit += SymbolTableFind(&st,list.name[i]) != NULL;
+    if((d = Now() - t0) < best[4]) best[4] = d;
+    if(hit != list.size) fprintf(stderr,"flat table lost symbols\n");
+
+    t0 = Now();
+    for( hit = 0 , i = 0 ; i < list.size ; ++i ) hit += SymbolTableFind(&st,miss[i]) != NULL;
+    if((d = Now() - t0) < best[5]) best[5] = d;
+    if(hit) fprintf(stderr,"flat table found missing symbols\n");
+
+    free(lt.entry);
+    SymbolTableDelete(&st);
+  }
+
+  Report("legacy","insert",best[0],list.size);
+  Report("legacy","hit"   ,best[1],list.size);
+  Report("legacy","miss"  ,best[2],list.size);
+  Report("flat"  ,"insert",best[3],list.size);
+  Report("flat"  ,"hit"   ,best[4],list.size);
+  Report("flat"  ,"miss"  ,best[5],list.size);
+
+  for( i = 0 ; i < list.size ; ++i ) free(miss[i]);
+  free(miss);
+  free(list.name);
+  while(nimg) ElfImageClose(img + --nimg);
+  return 0;
+}
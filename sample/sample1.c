@@ -2,7 +2,9 @@
 
 #include <assert.h>
 #include <stdio.h>
+#include <stdlib.h>
 #include <unistd.h>
+#include <sys/socket.h>
 
 /** --------------------------------------*
  * Simple Test                            |
@@ -53,6 +55,98 @@ TEST(NegativeSuite1,T5) {
   ASSERT_STRNE("a","a");
 }
 
+/** --------------------------------------*
+ * Param Test                             |
+ * ---------------------------------------*/
+
+static const struct {
+  const char* str;
+  size_t      len;
+} kLength[] = {
+  { ""      , 0 } ,
+  { "a"     , 1 } ,
+  { "ab"    , 2 } ,
+  { "a\0b" , 1 }
+};
+
+TEST_P(ParamSuite1,Length,kLength) {
+  ASSERT_EQ(strlen(row->str),row->len);
+}
+
+/** --------------------------------------*
+ * Async Test                             |
+ * ---------------------------------------*/
+
+typedef struct _Echo {
+  int fd[2];
+  int round;
+} Echo;
+
+static void OnPong( CUnitAsync* a , int fd , unsigned events , void* data );
+
+static void OnPing( CUnitAsync* a , int fd , unsigned events , void* data ) {
+  Echo* e = data;
+  char  c;
+  ASSERT_TRUE(events & CUNIT_ASYNC_READ);
+  ASSERT_EQ(read(fd,&c,1),1);
+  ASSERT_EQ(write(fd,&c,1),1);
+  CUnitAsyncWatch(a,e->fd[0],CUNIT_ASYNC_READ,OnPong,e);
+}
+
+static void OnPong( CUnitAsync* a , int fd , unsigned events , void* data ) {
+  Echo* e = data;
+  char  c;
+  ASSERT_TRUE(events & CUNIT_ASYNC_READ);
+  ASSERT_EQ(read(fd,&c,1),1);
+  ASSERT_EQ(c,'a' + e->round);
+
+  if(++e->round == 10) {
+    close(e->fd[0]);
+    close(e->fd[1]);
+    free(e);
+    CUnitAsyncDone(a);
+    return;
+  }
+
+  c = (char)('a' + e->round);
+  ASSERT_EQ(write(fd,&c,1),1);
+  CUnitAsyncWatch(a,e->fd[1],CUNIT_ASYNC_READ,OnPing,e);
+}
+
+TEST_ASYNC(AsyncSuite1,PingPong) {
+  Echo* e = calloc(1,sizeof(*e));
+  char  c = 'a';
+  ASSERT_EQ(socketpair(AF_UNIX,SOCK_STREAM,0,e->fd),0);
+  ASSERT_EQ(write(e->fd[0],&c,1),1);
+  CUnitAsyncWatch(async,e->fd[1],CUNIT_ASYNC_READ,OnPing,e);
+}
+
+static void OnTick( CUnitAsync* a , int fd , unsigned events , void* data ) {
+  int* tick = data;
+  ASSERT_EQ(fd,-1);
+  ASSERT_EQ(events,0);
+  if(++*tick < 3) CUnitAsyncTimer(a,10,OnTick,tick);
+}
+
+TEST_ASYNC(AsyncSuite1,Timer) {
+  static int tick;
+  tick = 0;
+  CUnitAsyncTimer(async,10,OnTick,&tick);
+}
+
+static void OnWrong( CUnitAsync* a , int fd , unsigned events , void* data ) {
+  (void)a;
+  (void)fd;
+  (void)events;
+  (void)data;
+  ASSERT_TRUE(0);
+}
+
+// fails in its callback while the test next to it goes on
+TEST_ASYNC(NegativeAsyncSuite1,T1) {
+  CUnitAsyncTimer(async,10,OnWrong,NULL);
+}
+
 int main( int argc , char* argv[] ) {
   return RunAllTests(argc,argv);
 }
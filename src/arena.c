@@ -0,0 +1,140 @@
+#include "arena.h"
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define ARENA_DEFAULT_BLOCK_SIZE (64*1024)
+#define ARENA_ALIGN              (sizeof(max_align_t))
+
+void ArenaInit( Arena* arena , size_t block_size ) {
+  arena->block      = NULL;
+  arena->block_size = block_size ? block_size : ARENA_DEFAULT_BLOCK_SIZE;
+}
+
+void* ArenaAlloc( Arena* arena , size_t size ) {
+  ArenaBlock* b = arena->block;
+  void*     ret;
+
+  size = (size + ARENA_ALIGN - 1) & ~(ARENA_ALIGN - 1);
+
+  if(!b || b->size - b->used < size) {
+    // a large allocation gets its own block , which is chained after the
+    // current block so the rest of the current block is not wasted
+    size_t bsize = size > arena->block_size / 4 ? size : arena->block_size;
+    ArenaBlock* nb = malloc(sizeof(ArenaBlock) + bsize);
+    nb->size = bsize;
+    nb->used = 0;
+
+    if(b && bsize != arena->block_size) {
+      nb->next = b->next;
+      b->next  = nb;
+    } else {
+      nb->next = b;
+      arena->block = nb;
+    }
+    b = nb;
+  }
+
+  ret = b->data + b->used;
+  b->used += size;
+  return ret;
+}
+
+void* ArenaCalloc( Arena* arena , size_t n , size_t size ) {
+  void* ret = ArenaAlloc(arena,n*size);
+  memset(ret,0,n*size);
+  return ret;
+}
+
+void* ArenaGrow( Arena* arena , void* old , size_t old_size , size_t new_size ) {
+  void* ret = ArenaAlloc(arena,new_size);
+  if(old_size) memcpy(ret,old,old_size);
+  return ret;
+}
+
+const char* ArenaSubStr( Arena* arena , const char* start , const char* end ) {
+  char* buf = ArenaAlloc(arena,(end-start) + 1);
+  memcpy(buf,start,(end-start));
+  buf[end-start] = 0;
+  return buf;
+}
+
+const char* ArenaStrDup( Arena* arena , const char* str ) {
+  return ArenaSubStr(arena,str,str+strlen(str));
+}
+
+void ArenaDelete( Arena* arena ) {
+  ArenaBlock* b = arena->block;
+  while(b) {
+    ArenaBlock* temp = b->next;
+    free(b);
+    b = temp;
+  }
+  arena->block = NULL;
+}
+
+/* ---------------------------------------------
+ * String Pool                                 |
+ * --------------------------------------------*/
+static uint64_t PoolHash( const char* str , size_t len ) {
+  uint64_t h = 14695981039346656037ULL;
+  size_t   i;
+  for( i = 0 ; i < len ; ++i ) {
+    h ^= (unsigned char)(str[i]);
+    h *= 1099511628211ULL;
+  }
+  return h;
+}
+
+void StringPoolInit( StringPool* pool , Arena* arena ) {
+  pool->arena = arena;
+  pool->mask  = 63;
+  pool->size  = 0;
+  pool->slot  = calloc(pool->mask+1,sizeof(const char*));
+}
+
+static const char** PoolFind( const char** slot , size_t mask , const char* str ,
+                                                                size_t      len ) {
+  size_t i = (size_t)(PoolHash(str,len)) & mask;
+  for( ; slot[i] ; i = (i + 1) & mask ) {
+    if(strncmp(slot[i],str,len) == 0 && slot[i][len] == 0)
+      break;
+  }
+  return slot + i;
+}
+
+const char* StringPoolIntern( StringPool* pool , const char* start , const char* end ) {
+  size_t len = (size_t)(end - start);
+  const char** s = PoolFind(pool->slot,pool->mask,start,len);
+
+  if(*s) return *s;
+
+  *s = ArenaSubStr(pool->arena,start,end);
+  ++pool->size;
+
+  // keep the load factor below 1/2 , linear probing degrades quickly above it
+  if(pool->size * 2 > pool->mask + 1) {
+    size_t       nmask = pool->mask * 2 + 1;
+    const char** nslot = calloc(nmask+1,sizeof(const char*));
+    const char*  ret   = *s;
+    size_t i;
+    for( i = 0 ; i < pool->mask + 1 ; ++i ) {
+      if(pool->slot[i]) {
+        *PoolFind(nslot,nmask,pool->slot[i],strlen(pool->slot[i])) = pool->slot[i];
+      }
+    }
+    free(pool->slot);
+    pool->slot = nslot;
+    pool->mask = nmask;
+    return ret;
+  }
+  return *s;
+}
+
+void StringPoolDelete( StringPool* pool ) {
+  free(pool->slot);
+  pool->slot = NULL;
+  pool->mask = 0;
+  pool->size = 0;
+}
@@ -0,0 +1,59 @@
+#ifndef ARENA_H_
+#define ARENA_H_
+
+#include <stddef.h>
+
+// A bump allocator. Memory is carved out of large blocks and is never freed
+// individually , deleting the arena releases every allocation at once.
+typedef struct _ArenaBlock {
+  struct _ArenaBlock* next;
+  size_t              size;   // size of the data
+  size_t              used;   // bytes already handed out
+  char                data[];
+} ArenaBlock;
+
+typedef struct _Arena {
+  ArenaBlock* block;          // current block , older blocks are chained
+  size_t      block_size;     // default size of a new block
+} Arena;
+
+// Initialize an arena , block size 0 uses the default block size
+void  ArenaInit  ( Arena* , size_t );
+
+// Allocate memory that is aligned to the max alignment of the platform
+void* ArenaAlloc ( Arena* , size_t );
+
+// Allocate zero initialized memory
+void* ArenaCalloc( Arena* , size_t , size_t );
+
+// Grow a previous allocation , the content is copied into the new memory and
+// the old memory is simply left in the arena
+void* ArenaGrow  ( Arena* , void* , size_t , size_t );
+
+// Copy the string marked by start and end into the arena
+const char* ArenaSubStr( Arena* , const char* , const char* );
+
+// Copy a null terminated string into the arena
+const char* ArenaStrDup( Arena* , const char* );
+
+// Release all the memory owned by the arena
+void  ArenaDelete( Arena* );
+
+// A string interning pool , the same string is always stored once inside of
+// the arena so interned strings can be compared by their address
+typedef struct _StringPool {
+  Arena*       arena;
+  const char** slot;
+  size_t       mask;
+  size_t       size;
+} StringPool;
+
+void StringPoolInit  ( StringPool* , Arena* );
+
+// Intern the string marked by start and end
+const char* StringPoolIntern( StringPool* , const char* , const char* );
+
+// Release the pool's table , the strings are owned by the arena
+void StringPoolDelete( StringPool* );
+
+#endif // ARENA_H_
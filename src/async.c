@@ -0,0 +1,137 @@
+#include "async.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/epoll.h>
+#include <sys/timerfd.h>
+
+int AsyncLoopInit( AsyncLoop* loop ) {
+  loop->head = NULL;
+  loop->epfd = epoll_create1(EPOLL_CLOEXEC);
+  return loop->epfd < 0 ? -1 : 0;
+}
+
+static void UnlinkWatch( AsyncLoop* loop , AsyncWatch* w ) {
+  if(w->prev) w->prev->next = w->next;
+  else        loop->head    = w->next;
+  if(w->next) w->next->prev = w->prev;
+
+  epoll_ctl(loop->epfd,EPOLL_CTL_DEL,w->fd,NULL);
+  if(w->timer) close(w->fd);
+}
+
+void AsyncLoopDelete( AsyncLoop* loop ) {
+  while(loop->head) {
+    AsyncWatch* w = loop->head;
+    UnlinkWatch(loop,w);
+    free(w);
+  }
+  if(loop->epfd >= 0) close(loop->epfd);
+  loop->epfd = -1;
+}
+
+static int AddWatch( AsyncLoop* loop , int fd , int timer , uint32_t events ,
+                                                            void* owner ,
+                                                            CUnitAsyncCallback cb ,
+                                                            void* data ) {
+  AsyncWatch*        w = malloc(sizeof(*w));
+  struct epoll_event ev;
+
+  w->fd    = fd;
+  w->timer = timer;
+  w->owner = owner;
+  w->cb    = cb;
+  w->data  = data;
+
+  ev.events   = events;
+  ev.data.ptr = w;
+  if(epoll_ctl(loop->epfd,EPOLL_CTL_ADD,fd,&ev)) {
+    free(w);
+    return -1;
+  }
+
+  w->prev = NULL;
+  w->next = loop->head;
+  if(loop->head) loop->head->prev = w;
+  loop->head = w;
+  return 0;
+}
+
+int AsyncLoopWatch( AsyncLoop* loop , int fd , unsigned events , void* owner ,
+                                                                 CUnitAsyncCallback cb ,
+                                                                 void* data ) {
+  uint32_t ev = 0;
+  if(events & CUNIT_ASYNC_READ ) ev |= EPOLLIN;
+  if(events & CUNIT_ASYNC_WRITE) ev |= EPOLLOUT;
+  return AddWatch(loop,fd,0,ev,owner,cb,data);
+}
+
+int AsyncLoopTimer( AsyncLoop* loop , unsigned ms , void* owner , CUnitAsyncCallback cb ,
+                                                                  void* data ) {
+  struct itimerspec its;
+  int fd = timerfd_create(CLOCK_MONOTONIC,TFD_NONBLOCK | TFD_CLOEXEC);
+
+  if(fd < 0) return -1;
+
+  // a zero it_value disarms the timer , so 0ms is rounded up to 1ns
+  memset(&its,0,sizeof(its));
+  its.it_value.tv_sec  = ms / 1000;
+  its.it_value.tv_nsec = (long)(ms % 1000) * 1000000L;
+  if(!ms) its.it_value.tv_nsec = 1;
+
+  if(timerfd_settime(fd,0,&its,NULL) || AddWatch(loop,fd,1,EPOLLIN,owner,cb,data)) {
+    close(fd);
+    return -1;
+  }
+  return 0;
+}
+
+size_t AsyncLoopCancel( AsyncLoop* loop , void* owner ) {
+  AsyncWatch* w = loop->head;
+  size_t      n = 0;
+
+  while(w) {
+    AsyncWatch* next = w->next;
+    if(w->owner == owner) {
+      UnlinkWatch(loop,w);
+      free(w);
+      ++n;
+    }
+    w = next;
+  }
+  return n;
+}
+
+int AsyncLoopWait( AsyncLoop* loop , int ms , AsyncEvent* out , int max ) {
+  struct epoll_event ev[64];
+  int n , i;
+
+  if(max > (int)(sizeof(ev) / sizeof(ev[0]))) max = (int)(sizeof(ev) / sizeof(ev[0]));
+
+  if((n = epoll_wait(loop->epfd,ev,max,ms)) < 0) {
+    return errno == EINTR ? 0 : -1;
+  }
+
+  for( i = 0 ; i < n ; ++i ) {
+    AsyncWatch* w = ev[i].data.ptr;
+    AsyncEvent* e = out + i;
+
+    e->owner  = w->owner;
+    e->cb     = w->cb;
+    e->data   = w->data;
+    e->fd     = w->timer ? -1 : w->fd;
+    e->events = 0;
+    if(!w->timer) {
+      if(ev[i].events & EPOLLIN ) e->events |= CUNIT_ASYNC_READ;
+      if(ev[i].events & EPOLLOUT) e->events |= CUNIT_ASYNC_WRITE;
+      if(ev[i].events & (EPOLLERR | EPOLLHUP)) e->events |= CUNIT_ASYNC_ERROR;
+    }
+
+    // one shot , the callback may watch the same fd again
+    UnlinkWatch(loop,w);
+    free(w);
+  }
+  return n;
+}
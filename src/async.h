@@ -0,0 +1,60 @@
+#ifndef ASYNC_H_
+#define ASYNC_H_
+
+#include "cunitpp.h"
+
+#include <stddef.h>
+
+/**
+ * Event loop of the TEST_ASYNC tests. It is a thin layer over epoll where
+ * every continuation is one shot : once its fd is ready or its timer
+ * expires it is removed from the loop and handed back to the caller , who
+ * runs it on behalf of its owner. Timers are timerfds owned by the loop.
+ */
+typedef struct _AsyncWatch {
+  int                  fd;
+  int                  timer;   // whether fd is a timerfd owned by the loop
+  void*                owner;   // the test it belongs to
+  CUnitAsyncCallback   cb;
+  void*                data;
+  struct _AsyncWatch*  prev;
+  struct _AsyncWatch*  next;
+} AsyncWatch;
+
+typedef struct _AsyncLoop {
+  int         epfd;
+  AsyncWatch* head;             // every continuation not fired yet
+} AsyncLoop;
+
+// A continuation that is ready to run
+typedef struct _AsyncEvent {
+  void*              owner;
+  CUnitAsyncCallback cb;
+  void*              data;
+  int                fd;        // -1 for a timer
+  unsigned           events;    // CUNIT_ASYNC_* , 0 for a timer
+} AsyncEvent;
+
+int  AsyncLoopInit  ( AsyncLoop* );
+
+// Drop every continuation left and close the loop
+void AsyncLoopDelete( AsyncLoop* );
+
+// Call cb once fd is ready for the events , a fd can only be watched once at
+// a time. Returns -1 if epoll refuses the fd
+int  AsyncLoopWatch ( AsyncLoop* , int fd , unsigned events , void* owner ,
+                                                               CUnitAsyncCallback ,
+                                                               void* data );
+
+// Call cb after ms milliseconds
+int  AsyncLoopTimer ( AsyncLoop* , unsigned ms , void* owner , CUnitAsyncCallback ,
+                                                               void* data );
+
+// Drop every continuation of the owner , returns how many are dropped
+size_t AsyncLoopCancel( AsyncLoop* , void* owner );
+
+// Wait up to ms milliseconds ( -1 forever ) for ready continuations , they are
+// removed from the loop before they are returned. Returns the number of them
+int  AsyncLoopWait  ( AsyncLoop* , int ms , AsyncEvent* , int max );
+
+#endif // ASYNC_H_
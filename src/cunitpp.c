@@ -1,12 +1,31 @@
+#define _GNU_SOURCE
+
 #include "cunitpp.h"
 #include "proc-info.h"
+#include "symbol-name.h"
+#include "arena.h"
+#include "profile.h"
+#include "timing-db.h"
+#include "jobserver.h"
+#include "async.h"
+#include "journal.h"
 #include "util.h"
 
 #include <stdint.h>
+#include <dlfcn.h>
 #include <time.h>
 #include <stdio.h>
 #include <stdarg.h>
 #include <setjmp.h>
+#include <signal.h>
+#include <execinfo.h>
+#include <ucontext.h>
+#include <poll.h>
+#include <errno.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <pthread.h>
+#include <sys/prctl.h>
 #include <unistd.h>
 #include <stdlib.h>
 #include <string.h>
@@ -14,25 +33,54 @@
 // Simple Test function prototype
 typedef void (*SimpleTest)();
 
+// Parameterized Test function prototype , the row table is returned by the
+// function of its V symbol
+typedef void        (*ParamTest )(const void*);
+typedef const void* (*ParamTable)(size_t* size , size_t* stride);
+
 // Fixture Test function prototype
 typedef void* (*FixtureSetup   )();
 typedef void  (*FixtureTest    )(void*);
 typedef void  (*FixtureTearDown)(void*);
 
-// Use to simulate exception in C
-static jmp_buf kTestEnv;
+// The test running on a thread. An assertion failing on the runner thread
+// of the test jumps back into the runner through env to simulate exception
+// in C , any other thread has no frame to jump to and only marks the test
+// as failed
+typedef struct _TestContext {
+  jmp_buf       env;
+  const char*   module;
+  const char*   name;
+  FILE*         output;   // where the assertions print , stderr if NULL
+  uint32_t      timeout;  // budget in milliseconds , 0 if there is none
+  volatile int  failed;   // set by the other threads of the test
+  volatile int  expired;  // set once the timeout runs out
+} TestContext;
+
+// Test of the calling thread and whether the thread is its runner
+static __thread TestContext* volatile kTest;
+static __thread int                   kTestRunner;
+
+// Test of a serial run , a failing thread without a test is charged to it.
+// There is no such test when the tests run on several threads
+static TestContext* volatile kTestOwner;
+static int                   kThreaded;
+
+// Whether an assertion failed on a thread that belongs to no test
+static volatile int kTestOrphan;
+
+// Linker generated bounds of the test registry section. They are declared
+// as weak symbols since a binary built with older headers has no registry
+// section at all and then both of them resolve to NULL
+extern const CUnitTestDesc __start_cunitpp_tests[] __attribute__((weak));
+extern const CUnitTestDesc __stop_cunitpp_tests [] __attribute__((weak));
 
 // Define test type that supported by the framework
 #define TT_UNKNOWN (0)
 #define TT_SIMPLE  (1)
 #define TT_FIXTURE (2)
-
-// Internal used symbol name type
-#define ST_UNKNOWN         (-1)
-#define ST_SIMPLE_TEST      (0)
-#define ST_FIXTURE_SETUP    (1)
-#define ST_FIXTURE_TEARDOWN (2)
-#define ST_FIXTURE_TEST     (3)
+#define TT_ASYNC   (3)
+#define TT_PARAM   (4)
 
 enum {
   ST_INIT,
@@ -40,14 +88,14 @@ enum {
   ST_FOUND
 };
 
-typedef struct _SymbolName {
-  const char* module;
-  const char* name  ;
-} SymbolName;
-
 typedef struct _TestEntry {
   const char*   name;
   void*      address;
+  uint32_t   timeout;   // budget in milliseconds , 0 uses the --timeout option
+  // only used for parameterized test
+  const char*   rows;
+  uint32_t  row_size;   // number of rows
+  uint32_t    stride;   // bytes of a row
 } TestEntry;
 
 typedef struct _TestEntryArray {
@@ -63,101 +111,113 @@ typedef struct _ModuleEntry {
   // only used for fixture test
   FixtureSetup    setup;
   FixtureTearDown tear_down;
+  int             per_test;   // whether the setup runs around each test
 } ModuleEntry;
 
+// The global environment , see TEST_ENV_SETUP
+typedef void (*EnvironmentHook)(void);
+
+typedef struct _EnvEntry {
+  const char*     module;     // interned , the host prefixes it with the library
+  EnvironmentHook setup;
+  EnvironmentHook tear_down;
+  int             ready;      // whether the setup has run
+  int             failed;     // whether the setup failed
+} EnvEntry;
+
 typedef struct _TestPlan  {
   ModuleEntry *module;
   size_t         size;
   size_t          cap;
+
+  // global environments , the host may load one per library
+  EnvEntry*      env;
+  size_t         env_size;
+  size_t         env_cap;
+
+  // owns all the memory of the plan , module names are interned so they
+  // can be compared by address
+  Arena        arena;
+  StringPool   pool;
 } TestPlan;
 
+// A TEST_TIMEOUT override or the row table of a TEST_P , it is resolved once
+// every test is known since it may be found before its test
+typedef struct _TestAttr {
+  int          type;        // ST_TEST_TIMEOUT or ST_PARAM_VALUES
+  const char*  module;      // interned
+  const char*  name;
+  void*        func;
+} TestAttr;
+
 typedef struct _TestPlanGenerator {
   TestPlan*    plan;
+
+  // TEST_TIMEOUT overrides and TEST_P row tables found so far
+  TestAttr*    attr;
+  size_t       attr_size;
+  size_t       attr_cap;
+
+  // module index , an open addressing table keyed by the interned module
+  // name storing position + 1 of the module inside of the plan , 0 is empty
+  size_t*      index;
+  size_t       index_mask;
+
   // context variables
   int          tt;
   union {
     TestEntry*      entry;
     ModuleEntry*    module;
+    TestAttr*       attr;
+    EnvEntry*       env;
   } cur;
 
   int          run_all;
+
+  // module names are prefixed with the scope when it is not NULL , used to
+  // namespace the modules of different libraries loaded by the host
+  const char*  scope;
 } TestPlanGenerator;
 
+typedef struct _CmdOption {
+  int opt ;
+  int list;
+  const char** module_list;
+  const char** test_list;
+  const char*  cache_dir;   // directory of the test index cache , may be NULL
+  const char** library;     // shared objects to load , only used by the host
+  int          crash;       // whether a crashing test is caught
+  int          jobs;        // number of worker processes , 1 runs serially
+  int          threads;     // number of runner threads , 1 runs serially
+  int          fork_fixture; // whether each fixture test runs in its own child
+  const char*  timing_db;   // file of the duration history , may be NULL
+  int          shard_index; // shard run by this process , from 0
+  int          total_shards; // number of shards , 1 runs every test
+  int          shard_mode;  // SHARD_HASH or SHARD_DURATION
+  uint32_t     timeout;     // default timeout of a test in milliseconds , 0 is none
+  int          jobserver;   // whether the jobserver of a parent make is used
+  uint32_t     repeat;      // rounds of the repeat mode , 0 unless asked for
+  int          until_fail;  // whether the rounds stop at the first failure
+  int          stress_jobs; // number of worker processes of the repeat mode
+  const char*  journal;     // file the progress is recorded in , may be NULL
+  int          resume;      // whether the journal is loaded and continued
+} CmdOption;
+
 static const char* GetTTName( int tt ) {
   switch(tt) {
     case TT_SIMPLE:  return "T";
     case TT_FIXTURE: return "F";
+    case TT_ASYNC:   return "A";
+    case TT_PARAM:   return "P";
     default:         return NULL;
   }
 }
 
+// Current time in microseconds
 static uint64_t TimeGetNow() {
   struct timespec res;
   clock_gettime(CLOCK_MONOTONIC,&res);
-  return res.tv_sec * 1000 + res.tv_nsec /1000000;
-}
-
-static void FreeSymbolName( SymbolName* name ) {
-  free((void*)(name->module));
-  free((void*)(name->name  ));
-}
-
-// resolve the symbol to check whether it is a unknown symbol to our framework
-static int ParseSymbolName( const char* name , SymbolName* output ) {
-  int tt;
-  const char* p;
-
-  // check whether the symbol has our designed the prefix, if not then
-  // just return it is not known to the framework
-  if(strstr(name,CUNIT_SYMBOL_PREFIX) == name) {
-    name += strlen(CUNIT_SYMBOL_PREFIX); // advance and look for the meta character
-    switch(*name) {
-      case CUNIT_SIMPLE_TEST     : tt = ST_SIMPLE_TEST;      break;
-      case CUNIT_FIXTURE_TEST    : tt = ST_FIXTURE_TEST;     break;
-      case CUNIT_FIXTURE_SETUP   : tt = ST_FIXTURE_SETUP;    break;
-      case CUNIT_FIXTURE_TEARDOWN: tt = ST_FIXTURE_TEARDOWN; break;
-      default: goto unknown;
-    }
-
-    name ++; // skip the meta character
-    p = strstr(name,CUNIT_MODULE_SEPARATOR);
-    if(p) {
-      output->module = SubStr(name,p);
-      output->name   = strdup(p+strlen(CUNIT_MODULE_SEPARATOR));
-      return tt;
-    }
-  }
-
-unknown:
-  return ST_UNKNOWN;
-}
-
-static int ExplodeSymbolName( const char* name , int           tt ,
-                                                 char*        mod ,
-                                                 char*        sym ,
-                                                 char*        buf ,
-                                                 size_t       len ) {
-
-  const char* pend = strchr(name,'.');
-  if(pend) {
-    size_t sz = strlen(pend+1);
-    char   mt;
-    memcpy(mod,name,pend-name);
-    mod[pend-name] = 0;
-    memcpy(sym,pend+1,sz);
-    sym[sz] = 0;
-
-    switch(tt) {
-      case ST_SIMPLE_TEST     :  mt = CUNIT_SIMPLE_TEST;      break;
-      case ST_FIXTURE_TEST    :  mt = CUNIT_FIXTURE_TEST;     break;
-      case ST_FIXTURE_SETUP   :  mt = CUNIT_FIXTURE_SETUP;    break;
-      case ST_FIXTURE_TEARDOWN:  mt = CUNIT_FIXTURE_TEARDOWN; break;
-      default: return -1;
-    }
-    snprintf(buf,len,"%s%c%s%s%s",CUNIT_SYMBOL_PREFIX,mt,mod,CUNIT_MODULE_SEPARATOR,sym);
-    return 0;
-  }
-  return -1;
+  return res.tv_sec * 1000000 + res.tv_nsec / 1000;
 }
 
 // Parse a comma separated string into a list of string
@@ -186,22 +246,28 @@ static const char** ParseCommStr( const char* str ) {
   return ret;
 }
 
-static TestEntry* AddTestEntry( TestEntryArray* arr ) {
+static TestEntry* AddTestEntry( TestPlan* tp , TestEntryArray* arr ) {
   TestEntry* te;
   if(arr->cap == arr->size) {
     size_t ncap = arr->cap == 0 ? 2 : arr->cap * 2;
-    arr->arr = realloc(arr->arr,sizeof(TestEntry)*ncap);
+    arr->arr = ArenaGrow(&(tp->arena),arr->arr,sizeof(TestEntry)*arr->size,
+                                               sizeof(TestEntry)*ncap);
     arr->cap = ncap;
   }
   te = arr->arr + arr->size++;
-  te->address = NULL;
+  te->address  = NULL;
+  te->timeout  = 0;
+  te->rows     = NULL;
+  te->row_size = 0;
+  te->stride   = 0;
   return te;
 }
 
 static ModuleEntry* AddModuleEntry( TestPlan* tp ) {
   if(tp->cap == tp->size) {
     size_t ncap = tp->cap == 0 ? 2 : tp->cap * 2;
-    tp->module = realloc(tp->module,sizeof(ModuleEntry) * ncap);
+    tp->module = ArenaGrow(&(tp->arena),tp->module,sizeof(ModuleEntry) * tp->size,
+                                                   sizeof(ModuleEntry) * ncap);
     // reset rest to be 0
     memset(tp->module + tp->size,0,sizeof(ModuleEntry)* (ncap - tp->size));
     tp->cap = ncap;
@@ -209,100 +275,155 @@ static ModuleEntry* AddModuleEntry( TestPlan* tp ) {
   return tp->module + tp->size++;
 }
 
-static void DeleteTestPlan( TestPlan* p ) {
+static EnvEntry* FindOrAddEnv( TestPlan* tp , const char* module ) {
   size_t i;
-  for( i = 0 ; i < p->size ; ++i ) {
-    ModuleEntry* me = p->module + i;
-    free((void*)me->module);
-    for( size_t j = 0 ; j < me->arr.size ; ++j ) {
-      TestEntry* te = me->arr.arr + j;
-      free((void*)(te->name));
-    }
-    free(me->arr.arr);
+  for( i = 0 ; i < tp->env_size ; ++i ) {
+    if(tp->env[i].module == module) return tp->env + i;
+  }
+  if(tp->env_cap == tp->env_size) {
+    size_t ncap = tp->env_cap ? tp->env_cap * 2 : 2;
+    tp->env = ArenaGrow(&(tp->arena),tp->env,sizeof(EnvEntry) * tp->env_size,
+                                             sizeof(EnvEntry) * ncap);
+    tp->env_cap = ncap;
   }
-  free(p->module);
+  memset(tp->env + tp->env_size,0,sizeof(EnvEntry));
+  tp->env[tp->env_size].module = module;
+  return tp->env + tp->env_size++;
+}
+
+// Everything inside of the plan is owned by its arena
+static void DeleteTestPlan( TestPlan* p ) {
+  StringPoolDelete(&(p->pool));
+  ArenaDelete(&(p->arena));
   p->module = 0;
   p->cap    = 0;
   p->size   = 0;
+  p->env      = NULL;
+  p->env_size = 0;
+  p->env_cap  = 0;
+}
+
+static size_t* ModuleIndexFind( size_t* index , size_t mask , const ModuleEntry* module ,
+                                                                const char*   name ) {
+  // module names are interned , so the address itself is hashed
+  size_t i = (size_t)(((uintptr_t)(name) >> 3) * 0x9e3779b97f4a7c15ULL) & mask;
+  for( ; index[i] && module[index[i]-1].module != name ; i = (i + 1) & mask )
+    ;
+  return index + i;
+}
+
+static void ModuleIndexInsert( TestPlanGenerator* gen , size_t pos ) {
+  TestPlan* tp = gen->plan;
+
+  // keep the load factor below 1/2
+  if((tp->size + 1) * 2 > gen->index_mask + 1) {
+    size_t  nmask  = gen->index_mask * 2 + 1;
+    size_t* nindex = calloc(nmask + 1,sizeof(size_t));
+    size_t  i;
+    for( i = 0 ; i < gen->index_mask + 1 ; ++i ) {
+      if(gen->index[i]) {
+        const char* name = tp->module[gen->index[i]-1].module;
+        *ModuleIndexFind(nindex,nmask,tp->module,name) = gen->index[i];
+      }
+    }
+    free(gen->index);
+    gen->index      = nindex;
+    gen->index_mask = nmask;
+  }
+
+  *ModuleIndexFind(gen->index,gen->index_mask,tp->module,tp->module[pos].module) = pos + 1;
 }
 
 static ModuleEntry* FindOrAddModule( TestPlanGenerator* gen , const char* module, int tt ) {
-  size_t i;
-  for( i = 0 ; i < gen->plan->size ; ++i ) {
-    ModuleEntry* me = gen->plan->module + i;
-    if(strcmp(me->module,module) == 0) {
-      if(me->tt != TT_UNKNOWN) {
-        if(me->tt != tt) {
-          return NULL;
-        }
-      } else {
-        me->tt = tt;
+  TestPlan* tp = gen->plan;
+  size_t*  pos = ModuleIndexFind(gen->index,gen->index_mask,tp->module,module);
+
+  if(*pos) {
+    ModuleEntry* me = tp->module + (*pos - 1);
+    if(me->tt != TT_UNKNOWN) {
+      if(me->tt != tt) {
+        return NULL;
       }
-      return me;
+    } else {
+      me->tt = tt;
     }
+    return me;
   }
 
   if(gen->run_all) {
-    ModuleEntry* me = AddModuleEntry(gen->plan);
-    me->tt = tt;
-    return me;
+    ModuleEntry* me = AddModuleEntry(tp);
+    me->module = module;
+    me->tt     = tt;
+    ModuleIndexInsert(gen,tp->size - 1);
+    return tp->module + tp->size - 1;
   }
 
   return NULL;
 }
 
-static int SymbolBegin( void* d , const char* name ) {
-  TestPlanGenerator* gen = d;
-  SymbolName sn;
+// add a parsed symbol into the test plan. Once it returns
+// PINFO_FOREACH_CONTINUE the address of the symbol should be fed via OnSymbol
+static int AddPlanSymbol( TestPlanGenerator* gen , int tt , const SymbolName* sn ) {
+  TestPlan*     tp = gen->plan;
+  ModuleEntry*  me;
+  const char*   module;
 
-  gen->tt = ParseSymbolName(name,&sn);
+  gen->tt = tt;
+  if(tt == ST_UNKNOWN) goto brk;
+
+  if(gen->scope) {
+    char buf[1024];
+    int  len = snprintf(buf,sizeof(buf),"%s/%.*s",gen->scope,(int)(sn->module_end - sn->module),
+                                                             sn->module);
+    if(len < 0 || (size_t)(len) >= sizeof(buf)) goto brk;
+    module = StringPoolIntern(&(tp->pool),buf,buf+len);
+  } else {
+    module = StringPoolIntern(&(tp->pool),sn->module,sn->module_end);
+  }
 
   switch(gen->tt) {
-    case ST_UNKNOWN    :
-      goto brk;
     case ST_SIMPLE_TEST:
     case ST_FIXTURE_TEST:
-      {
-        ModuleEntry* me = FindOrAddModule(gen,
-                                          sn.module,
-                                          gen->tt == ST_SIMPLE_TEST ? TT_SIMPLE : TT_FIXTURE);
-        if(me) {
-          if(!me->module)
-            me->module = sn.module;
-          else
-            free((void*)sn.module);
-
-          gen->cur.entry = AddTestEntry(&me->arr);
-          gen->cur.entry->name = sn.name;
-          goto cont;
-        } else {
-          FreeSymbolName(&sn);
-          goto brk;
-        }
-      }
-      break;
+    case ST_ASYNC_TEST:
+    case ST_PARAM_TEST:
+      me = FindOrAddModule(gen,module,gen->tt == ST_SIMPLE_TEST ? TT_SIMPLE  :
+                                      gen->tt == ST_ASYNC_TEST  ? TT_ASYNC   :
+                                      gen->tt == ST_PARAM_TEST  ? TT_PARAM   :
+                                                                  TT_FIXTURE);
+      if(!me) goto brk;
+
+      gen->cur.entry = AddTestEntry(tp,&me->arr);
+      gen->cur.entry->name = ArenaStrDup(&(tp->arena),sn->name);
+      goto cont;
 
     case ST_FIXTURE_SETUP:
     case ST_FIXTURE_TEARDOWN:
-      {
-        ModuleEntry* me = FindOrAddModule(gen,sn.module,TT_FIXTURE);
-        if(me) {
-          if(me) {
-            if(!me->module) {
-              me->module = sn.module;
-              free((void*)sn.name);
-            } else {
-              FreeSymbolName(&sn);
-            }
-            gen->cur.module = me;
-            goto cont;
-          }
-        } else {
-          FreeSymbolName(&sn);
-          goto brk;
-        }
+    case ST_FIXTURE_PER_TEST:
+      me = FindOrAddModule(gen,module,TT_FIXTURE);
+      if(!me) goto brk;
+
+      gen->cur.module = me;
+      goto cont;
+
+    case ST_ENV_SETUP:
+    case ST_ENV_TEARDOWN:
+      gen->cur.env = FindOrAddEnv(tp,module);
+      goto cont;
+
+    case ST_TEST_TIMEOUT:
+    case ST_PARAM_VALUES:
+      if(gen->attr_size == gen->attr_cap) {
+        size_t ncap = gen->attr_cap ? gen->attr_cap * 2 : 16;
+        gen->attr = realloc(gen->attr,sizeof(TestAttr) * ncap);
+        gen->attr_cap = ncap;
       }
-      break;
+      gen->cur.attr = gen->attr + gen->attr_size++;
+      gen->cur.attr->type   = gen->tt;
+      gen->cur.attr->module = module;
+      gen->cur.attr->name   = ArenaStrDup(&(tp->arena),sn->name);
+      gen->cur.attr->func   = NULL;
+      goto cont;
+
     default:
       break;
   }
@@ -320,6 +441,8 @@ static int OnSymbol  ( void* d , void* addr , int weak ) {
     switch(gen->tt) {
       case ST_SIMPLE_TEST:
       case ST_FIXTURE_TEST:
+      case ST_ASYNC_TEST:
+      case ST_PARAM_TEST:
         gen->cur.entry->address    = addr;
         break;
       case ST_FIXTURE_SETUP:
@@ -328,6 +451,19 @@ static int OnSymbol  ( void* d , void* addr , int weak ) {
       case ST_FIXTURE_TEARDOWN:
         gen->cur.module->tear_down = addr;
         break;
+      case ST_FIXTURE_PER_TEST:
+        gen->cur.module->per_test  = 1;
+        break;
+      case ST_ENV_SETUP:
+        gen->cur.env->setup        = addr;
+        break;
+      case ST_ENV_TEARDOWN:
+        gen->cur.env->tear_down    = addr;
+        break;
+      case ST_TEST_TIMEOUT:
+      case ST_PARAM_VALUES:
+        gen->cur.attr->func        = addr;
+        break;
       default:
         break;
     }
@@ -340,35 +476,180 @@ static void SymbolEnd( void* d ) {
   (void)d;
 }
 
+static int SymbolBegin( void* d , const char* name ) {
+  SymbolName sn;
+  int tt = ParseSymbolName(name,&sn);
+  return AddPlanSymbol(d,tt,&sn);
+}
+
 static void ShowSeparator() {
   ColorFPrintf(stderr,"Bold","Megenta",NULL,"[---------]\n");
 }
 
-static void PrepareTestPlan( struct ProcInfo* pinfo , TestPlan* tp ,
-                                                      const char** module_list ) {
-  TestPlanGenerator gen;
-  gen.plan        = tp;
+static void InitTestPlanGenerator( TestPlanGenerator* gen , TestPlan* tp ,
+                                                            const char** module_list ) {
+  gen->plan         = tp;
+  gen->scope        = NULL;
+  gen->attr         = NULL;
+  gen->attr_size    = 0;
+  gen->attr_cap     = 0;
+  gen->index_mask   = 63;
+  gen->index        = calloc(gen->index_mask + 1,sizeof(size_t));
 
-  // initialize the module entry
+  ArenaInit(&(tp->arena),0);
+  StringPoolInit(&(tp->pool),&(tp->arena));
+
+  tp->size   = 0;
+  tp->cap    = 0;
+  tp->module = NULL;
+  tp->env      = NULL;
+  tp->env_size = 0;
+  tp->env_cap  = 0;
+
+  // initialize the module entry , a module listed twice is only added once
   if(module_list) {
-    size_t sz = 0;
     const char** p = module_list;
-    for( ; *p ; ++p ) ++sz;
-    tp->cap    = sz;
-    tp->size   = sz;
-    tp->module = calloc(sz,sizeof(ModuleEntry));
-    for( size_t i = 0 ; i < sz ; ++i ) {
-      tp->module[i].module = module_list[i];
-    }
-    gen.run_all = 0;
+    for( ; *p ; ++p ) {
+      const char* m = StringPoolIntern(&(tp->pool),*p,*p+strlen(*p));
+      if(!*ModuleIndexFind(gen->index,gen->index_mask,tp->module,m)) {
+        AddModuleEntry(tp)->module = m;
+        ModuleIndexInsert(gen,tp->size - 1);
+      }
+    }
+    gen->run_all = 0;
   } else {
-    tp->size    = 0;
-    tp->cap     = 0;
-    tp->module  = NULL;
-    gen.run_all = 1;
+    gen->run_all = 1;
+  }
+}
+
+static int CompareTestEntry( const void* l , const void* r ) {
+  return strcmp(((const TestEntry*)(l))->name,((const TestEntry*)(r))->name);
+}
+
+static int CompareModuleEntry( const void* l , const void* r ) {
+  return strcmp(((const ModuleEntry*)(l))->module,((const ModuleEntry*)(r))->module);
+}
+
+// Turn the collected modules into the final plan in one pass : modules that
+// end up without any test are dropped , tests whose strong symbol is not
+// found are removed and both modules and tests are sorted by name so the
+// plan is the same regardless of the order symbols are discovered
+static void LoadParamTable( TestEntry* te , ParamTable table ) {
+  size_t size = 0 , stride = 0;
+  const void* rows = table(&size,&stride);
+
+  if(!rows || size > UINT32_MAX || stride > UINT32_MAX) return;
+  te->rows     = rows;
+  te->row_size = (uint32_t)(size);
+  te->stride   = (uint32_t)(stride);
+}
+
+static void FinishTestPlanGenerator( TestPlanGenerator* gen ) {
+  TestPlan* tp = gen->plan;
+  size_t i , j , n = 0;
+
+  for( i = 0 ; i < tp->size ; ++i ) {
+    ModuleEntry* me = tp->module + i;
+    size_t m = 0;
+
+    for( j = 0 ; j < me->arr.size ; ++j ) {
+      if(me->arr.arr[j].address) me->arr.arr[m++] = me->arr.arr[j];
+    }
+    me->arr.size = m;
+
+    if(me->tt == TT_UNKNOWN || (m == 0 && !me->setup && !me->tear_down))
+      continue;
+
+    if(m) qsort(me->arr.arr,m,sizeof(TestEntry),CompareTestEntry);
+    if(n != i) tp->module[n] = *me;
+    ++n;
+  }
+
+  tp->size = n;
+  qsort(tp->module,n,sizeof(ModuleEntry),CompareModuleEntry);
+
+  // attach the TEST_TIMEOUT overrides and the TEST_P row tables to their
+  // tests in the sorted plan
+  for( i = 0 ; i < gen->attr_size ; ++i ) {
+    const TestAttr* at = gen->attr + i;
+    ModuleEntry   key;
+    ModuleEntry*  me;
+    TestEntry     tkey;
+    TestEntry*    te;
+
+    if(!at->func) continue;
+
+    key.module = at->module;
+    if(!(me = bsearch(&key,tp->module,n,sizeof(ModuleEntry),CompareModuleEntry)))
+      continue;
+
+    tkey.name = at->name;
+    if(!(te = bsearch(&tkey,me->arr.arr,me->arr.size,sizeof(TestEntry),CompareTestEntry)))
+      continue;
+
+    if(at->type == ST_TEST_TIMEOUT) {
+      int ms      = ((int (*)(void))(at->func))();
+      te->timeout = ms > 0 ? (uint32_t)(ms) : 0;
+    } else if(me->tt == TT_PARAM) {
+      LoadParamTable(te,(ParamTable)(at->func));
+    }
   }
+  free(gen->attr);
+  gen->attr = NULL;
+
+  free(gen->index);
+  gen->index      = NULL;
+  gen->index_mask = 0;
+}
 
+static void PrepareTestPlan( struct ProcInfo* pinfo , TestPlan* tp ,
+                                                      const char** module_list ) {
+  TestPlanGenerator gen;
+  InitTestPlanGenerator(&gen,tp,module_list);
   ForeachSymbol(pinfo,SymbolBegin,OnSymbol,SymbolEnd,&gen);
+  FinishTestPlanGenerator(&gen);
+}
+
+/* --------------------------------------------
+ * Test Registry Section                      |
+ * -------------------------------------------*/
+static int HasTestRegistry() {
+  const CUnitTestDesc* begin = __start_cunitpp_tests;
+  return begin && begin != __stop_cunitpp_tests;
+}
+
+// Prepare the test plan from the registry section , each descriptor goes
+// through the same path as a symbol found in the symbol table
+static void PrepareTestPlanFromRegistry( TestPlan* tp , const char** module_list ) {
+  TestPlanGenerator gen;
+  const CUnitTestDesc* desc = __start_cunitpp_tests;
+  InitTestPlanGenerator(&gen,tp,module_list);
+
+  for( ; desc != __stop_cunitpp_tests ; ++desc ) {
+    SymbolName sn;
+    int tt = GetSymbolType(desc->type);
+    if(tt == ST_UNKNOWN) continue;
+
+    sn.module     = desc->module;
+    sn.module_end = desc->module + strlen(desc->module);
+    sn.name       = desc->name;
+    if(AddPlanSymbol(&gen,tt,&sn) == PINFO_FOREACH_CONTINUE) {
+      OnSymbol(&gen,desc->func,0);
+    }
+  }
+  FinishTestPlanGenerator(&gen);
+}
+
+// Find a test function inside of the registry section
+static void* FindRegistryTest( const char* module , const char* name , int type ) {
+  const CUnitTestDesc* desc = __start_cunitpp_tests;
+  for( ; desc != __stop_cunitpp_tests ; ++desc ) {
+    if(desc->type == type && strcmp(desc->module,module) == 0 &&
+                             strcmp(desc->name  ,name  ) == 0) {
+      return desc->func;
+    }
+  }
+  return NULL;
 }
 
 static void ShowError( const char* fmt , ... ) {
@@ -379,156 +660,2904 @@ static void ShowError( const char* fmt , ... ) {
   ColorFPrintf(stderr,"Bold","Red",NULL,"[ ERROR   ] %s\n",buf);
 }
 
-static int RunTest( void* address , FILE* file , const char* module ,
-                                                 const char* name   ,
-                                                 int            tt  ,
-                                                 void*          ctx  ) {
-  ColorFPrintf(stderr,NULL,"Blue",NULL,"[ RUN     ] ");
-  fprintf     (stderr,"%s.%s\n",module,name);
-
-  if(setjmp(kTestEnv) == 0) {
-    uint64_t start,end;
-
-    start = TimeGetNow();
-    switch(tt) {
-      case TT_SIMPLE:
-        {
-          SimpleTest tc = (SimpleTest)(address);
-          tc();
-        }
-        break;
-      case TT_FIXTURE:
-        {
-          FixtureTest ft = (FixtureTest)(address);
-          ft(ctx);
-        }
-        break;
-      default:
-        break;
-    }
-    end   = TimeGetNow();
+// Build the test plan. The registry section is preferred since it only
+// costs O(tests) , the symbol table scanning is used for binaries built with
+// older headers or when all the shared objects need to be searched
+static int BuildTestPlan( TestPlan* tp , const char** module_list ,
+                                         const CmdOption*    opt ) {
+  struct ProcInfo* pinfo;
+  int rcode;
 
-    ColorFPrintf(stderr,NULL,"Green",NULL,"[      OK ] ");
-    fprintf     (stderr,"%s.%s (%lldms)\n",module,name,(long long int)(end-start));
+  if(opt->opt == PINFO_SRCH_MAIN_ONLY && HasTestRegistry()) {
+    uint64_t start = ProfileBegin();
+    PrepareTestPlanFromRegistry(tp,module_list);
+    ProfileEnd(PROFILE_PLAN,start);
     return 0;
-  } else {
-    ColorFPrintf(stderr,NULL,"Red",NULL,"[    FAIL ] ");
-    fprintf     (stderr,"%s.%s\n",module,name);
+  }
+
+  if((rcode = CreateProcInfoWithCache(getpid(),&pinfo,opt->opt,opt->cache_dir))) {
+    ShowError("Cannot create ProcInfo object because of error code %d\n",rcode);
     return -1;
   }
+
+  {
+    uint64_t start = ProfileBegin();
+    PrepareTestPlan(pinfo,tp,module_list);
+    ProfileEnd(PROFILE_PLAN,start);
+  }
+  DeleteProcInfo(pinfo);
+  return 0;
 }
 
-static int RunTestPlan( const TestPlan* tp ) {
-  size_t i;
-  int rcode = 0;
+// Keep only the tests named by the list inside of the plan , a name that
+// matches no test is reported
+static int FilterTestPlan( TestPlan* tp , const char** test_list ) {
+  size_t size = 0 , i , j , k , n = 0;
+  int*   found;
+  int    rcode = 0;
+
+  for( ; test_list[size] ; ++size )
+    ;
+  found = calloc(size,sizeof(int));
+
   for( i = 0 ; i < tp->size ; ++i ) {
     ModuleEntry* me = tp->module + i;
-    ColorFPrintf(stderr,NULL,"Blue",NULL,"[ SUITE(%s)] ",GetTTName(me->tt));
-    fprintf     (stderr,"%s\n",me->module);
+    size_t    mlen  = strlen(me->module) , m = 0;
 
-    switch(me->tt) {
-      case TT_SIMPLE:
-        for( size_t j = 0 ; j < me->arr.size ; ++j ) {
-          TestEntry* t  = me->arr.arr + j;
-          if(t->address) {
-            rcode = RunTest(t->address,stderr,me->module,t->name,TT_SIMPLE,NULL);
-          }
+    for( j = 0 ; j < me->arr.size ; ++j ) {
+      int keep = 0;
+      for( k = 0 ; k < size ; ++k ) {
+        const char* t = test_list[k];
+        if(strncmp(t,me->module,mlen) == 0 && t[mlen] == '.' &&
+           strcmp(t + mlen + 1,me->arr.arr[j].name) == 0) {
+          found[k] = keep = 1;
         }
-        break;
-      case TT_FIXTURE:
-        {
-          void* ctx = NULL;
+      }
+      if(keep) me->arr.arr[m++] = me->arr.arr[j];
+    }
 
-          if(me->setup) {
-            ColorFPrintf(stderr,NULL,"Blue",NULL,"[ SETUP   ]\n");
-            ctx = me->setup();
-          }
+    me->arr.size = m;
+    if(m) tp->module[n++] = *me;
+  }
+  tp->size = n;
 
-          for( size_t j = 0 ; j < me->arr.size ; ++j ) {
-            TestEntry* t = me->arr.arr + j;
-            if(t->address) {
-              rcode = RunTest(t->address,stderr,me->module,t->name,TT_FIXTURE,ctx);
-            }
-          }
+  for( k = 0 ; k < size ; ++k ) {
+    if(!found[k]) {
+      ShowError("Test %s is not found",test_list[k]);
+      rcode = -1;
+    }
+  }
+
+  free(found);
+  return rcode;
+}
+
+/* --------------------------------------------
+ * Crash Handler                              |
+ * -------------------------------------------*/
+
+// Maximum number of frames shown in the backtrace of a crash
+#define CRASH_MAX_FRAME 64
+
+static const int kCrashSignal[] = { SIGSEGV , SIGBUS , SIGFPE , SIGILL , SIGABRT };
+
+// State of the crash handler. Only a crash on the runner thread of a test
+// is caught , a crash anywhere else keeps the default behavior
+typedef struct _CrashGuard {
+  struct AddressIndex*   index;     // built by the first backtrace shown
+  int                    loaded;    // whether the index is built
+  int                    opt;       // search option of the index
+  struct sigaction       old[ARRAY_SIZE(kCrashSignal)];
+  stack_t                old_stack;
+  void*                  stack;
+  int                    installed;
+} CrashGuard;
+
+static CrashGuard kCrash;
+static pthread_mutex_t kCrashLock = PTHREAD_MUTEX_INITIALIZER;
+
+// Frames of the last crash or timeout of the thread. The handler only
+// records the raw addresses , they are symbolized once it has jumped back
+// into the runner , so a run where nothing crashes never builds the index
+typedef struct _CrashTrace {
+  void* frame[CRASH_MAX_FRAME];
+  int   size;
+  int   first;      // the frame that was interrupted , the handler is above
+} CrashTrace;
+
+static __thread CrashTrace kTrace;
+
+// A fixed buffer written with write(2) , the handler cannot use stdio
+typedef struct _SafeBuffer {
+  char   buf[1024];
+  size_t size;
+} SafeBuffer;
+
+static void SafeAppend( SafeBuffer* b , const char* str , size_t len ) {
+  if(len > sizeof(b->buf) - b->size) len = sizeof(b->buf) - b->size;
+  memcpy(b->buf + b->size,str,len);
+  b->size += len;
+}
+
+static void SafeAppendStr( SafeBuffer* b , const char* str ) {
+  SafeAppend(b,str,strlen(str));
+}
+
+static void SafeAppendHex( SafeBuffer* b , uintptr_t v ) {
+  char   buf[2 + sizeof(v) * 2];
+  size_t i = sizeof(buf);
+  do {
+    buf[--i] = "0123456789abcdef"[v & 0xf];
+    v >>= 4;
+  } while(v);
+  buf[--i] = 'x';
+  buf[--i] = '0';
+  SafeAppend(b,buf + i,sizeof(buf) - i);
+}
+
+static void SafeFlush( SafeBuffer* b ) {
+  size_t off = 0;
+  while(off < b->size) {
+    ssize_t n = write(STDERR_FILENO,b->buf + off,b->size - off);
+    if(n <= 0) break;
+    off += (size_t)(n);
+  }
+  b->size = 0;
+}
+
+static const char* CrashSignalName( int sig ) {
+  switch(sig) {
+    case SIGSEGV: return "SIGSEGV";
+    case SIGBUS : return "SIGBUS";
+    case SIGFPE : return "SIGFPE";
+    case SIGILL : return "SIGILL";
+    case SIGABRT: return "SIGABRT";
+    default:      return "signal";
+  }
+}
+
+// Symbolize a single frame , a test function is shown as module.name
+static void AppendFrame( SafeBuffer* b , size_t i , uintptr_t addr ) {
+  const char* sym = NULL;
+  const char* mod = NULL;
+  uintptr_t  soff = 0 , moff = 0;
+  SymbolName sn;
+
+  if(kCrash.index) {
+    sym = LookupAddress      (kCrash.index,addr,&soff);
+    mod = LookupAddressModule(kCrash.index,addr,&moff);
+  }
+
+  SafeAppendStr(b,"  #");
+  SafeAppend   (b,"0123456789" + (i / 10) % 10,1);
+  SafeAppend   (b,"0123456789" + i % 10,1);
+  SafeAppendStr(b," ");
+  SafeAppendHex(b,addr);
+
+  if(sym) {
+    SafeAppendStr(b," ");
+    if(ParseSymbolName(sym,&sn) != ST_UNKNOWN) {
+      SafeAppend   (b,sn.module,(size_t)(sn.module_end - sn.module));
+      SafeAppendStr(b,".");
+      SafeAppendStr(b,sn.name);
+    } else {
+      SafeAppendStr(b,sym);
+    }
+    SafeAppendStr(b,"+");
+    SafeAppendHex(b,soff);
+  }
+
+  if(mod) {
+    SafeAppendStr(b," (");
+    SafeAppendStr(b,mod);
+    SafeAppendStr(b,"+");
+    SafeAppendHex(b,moff);
+    SafeAppendStr(b,")");
+  }
+  SafeAppendStr(b,"\n");
+  SafeFlush(b);
+}
+
+static uintptr_t CrashAddress( void* uctx ) {
+  const ucontext_t* uc = uctx;
+#if defined(__x86_64__)
+  return (uintptr_t)(uc->uc_mcontext.gregs[REG_RIP]);
+#elif defined(__aarch64__)
+  return (uintptr_t)(uc->uc_mcontext.pc);
+#else
+  (void)uc;
+  return 0;
+#endif
+}
+
+// Record the backtrace of a signal , the handler frames are skipped so the
+// first frame shown is the one that was interrupted at pc
+static void RecordSignalBacktrace( uintptr_t pc ) {
+  int i;
+
+  kTrace.first = 0;
+  kTrace.size  = backtrace(kTrace.frame,CRASH_MAX_FRAME);
+  for( i = 0 ; i < kTrace.size ; ++i ) {
+    if((uintptr_t)(kTrace.frame[i]) == pc) {
+      kTrace.first = i;
+      break;
+    }
+  }
+}
+
+// Print the backtrace recorded by the last signal of the thread , if any.
+// Called by the runner once the handler has jumped back into it , the index
+// of the symbols is built by the first backtrace of the run
+static void ShowCrashBacktrace() {
+  SafeBuffer b;
+  int        i;
+
+  if(!kTrace.size) return;
+
+  pthread_mutex_lock(&kCrashLock);
+  if(!kCrash.loaded) {
+    uint64_t start = ProfileBegin();
+    if(CreateAddressIndex(kCrash.opt,&kCrash.index)) kCrash.index = NULL;
+    kCrash.loaded = 1;
+    ProfileEnd(PROFILE_INDEX,start);
+  }
+
+  b.size = 0;
+  for( i = kTrace.first ; i < kTrace.size ; ++i ) {
+    // a return address points after the call , step back into the call
+    uintptr_t addr = (uintptr_t)(kTrace.frame[i]);
+    AppendFrame(&b,(size_t)(i - kTrace.first),i == kTrace.first ? addr : addr - 1);
+  }
+  pthread_mutex_unlock(&kCrashLock);
+  kTrace.size = 0;
+}
+
+static void OnCrashSignal( int sig , siginfo_t* info , void* uctx ) {
+  SafeBuffer b;
+  uintptr_t  pc = CrashAddress(uctx);
+  TestContext* t = kTest;
+
+  (void)info;
+
+  // not on the runner thread of a test , let the default action take place
+  if(!t || !kTestRunner) {
+    signal(sig,SIG_DFL);
+    raise(sig);
+    return;
+  }
+
+  b.size = 0;
+  SafeAppendStr(&b,"Test ");
+  SafeAppendStr(&b,t->module);
+  SafeAppendStr(&b,".");
+  SafeAppendStr(&b,t->name);
+  SafeAppendStr(&b," crashed with ");
+  SafeAppendStr(&b,CrashSignalName(sig));
+  SafeAppendStr(&b,", backtrace:\n");
+  SafeFlush(&b);
+
+  RecordSignalBacktrace(pc);
+  longjmp(t->env,1);
+}
+
+// The signal stack is per thread , every thread running tests needs its own
+static void* InstallCrashStack( stack_t* old ) {
+  stack_t st;
+  st.ss_sp    = malloc(SIGSTKSZ * 4);
+  st.ss_size  = SIGSTKSZ * 4;
+  st.ss_flags = 0;
+  sigaltstack(&st,old);
+  return st.ss_sp;
+}
+
+static void UninstallCrashStack( void* stack , const stack_t* old ) {
+  sigaltstack(old,NULL);
+  free(stack);
+}
+
+// Install the handlers of the crash signals , they run on an alternative
+// stack so a stack overflow is caught as well
+static void InstallCrashHandler( int opt ) {
+  struct sigaction sa;
+  void*            frame[1];
+  size_t i;
+
+  // the index is only built once a backtrace is shown
+  kCrash.opt = opt;
+
+  // backtrace loads the unwinder on the first call , which is not safe to
+  // happen inside of the handler
+  backtrace(frame,1);
+
+  kCrash.stack = InstallCrashStack(&kCrash.old_stack);
+
+  memset(&sa,0,sizeof(sa));
+  sa.sa_sigaction = OnCrashSignal;
+  // the handler leaves with longjmp , so the signal must not stay blocked
+  sa.sa_flags     = SA_SIGINFO | SA_ONSTACK | SA_NODEFER;
+  sigemptyset(&sa.sa_mask);
+
+  for( i = 0 ; i < ARRAY_SIZE(kCrashSignal) ; ++i ) {
+    sigaction(kCrashSignal[i],&sa,kCrash.old + i);
+  }
+  kCrash.installed = 1;
+}
+
+static void UninstallCrashHandler() {
+  size_t i;
+  if(!kCrash.installed) return;
+
+  for( i = 0 ; i < ARRAY_SIZE(kCrashSignal) ; ++i ) {
+    sigaction(kCrashSignal[i],kCrash.old + i,NULL);
+  }
+  UninstallCrashStack(kCrash.stack,&kCrash.old_stack);
+
+  if(kCrash.index) DeleteAddressIndex(kCrash.index);
+  memset(&kCrash,0,sizeof(kCrash));
+}
+
+/* --------------------------------------------
+ * Test Timeout                               |
+ * -------------------------------------------*/
+
+#ifndef sigev_notify_thread_id
+#define sigev_notify_thread_id _sigev_un._tid
+#endif
+
+// Default budget of a test in milliseconds , 0 means no limit
+static uint32_t kTimeout;
+
+// Signal of the per thread timers , nothing else of the framework uses the
+// real time signals
+#define TIMEOUT_SIGNAL (SIGRTMIN)
+
+// Timer of the calling thread , created on its first armed test
+static __thread timer_t kTimer;
+static __thread int     kTimerReady;
+
+static struct sigaction kTimeoutOld;
+static int              kTimeoutInstalled;
+
+static uint32_t TestTimeout( const TestEntry* t ) {
+  return t->timeout ? t->timeout : kTimeout;
+}
+
+static void SafeAppendDec( SafeBuffer* b , uint64_t v ) {
+  char   buf[20];
+  size_t i = sizeof(buf);
+  do {
+    buf[--i] = (char)('0' + v % 10);
+    v /= 10;
+  } while(v);
+  SafeAppend(b,buf + i,sizeof(buf) - i);
+}
+
+static void OnTimeoutSignal( int sig , siginfo_t* info , void* uctx ) {
+  SafeBuffer b;
+  TestContext* t = kTest;
+
+  (void)sig;
+  (void)info;
+
+  // the test finished right before the timer expired
+  if(!t || !kTestRunner) return;
+
+  b.size = 0;
+  SafeAppendStr(&b,"Test ");
+  SafeAppendStr(&b,t->module);
+  SafeAppendStr(&b,".");
+  SafeAppendStr(&b,t->name);
+  SafeAppendStr(&b," timed out after ");
+  SafeAppendDec(&b,t->timeout);
+  SafeAppendStr(&b,"ms, backtrace:\n");
+  SafeFlush(&b);
+
+  RecordSignalBacktrace(CrashAddress(uctx));
+  t->expired = 1;
+  longjmp(t->env,1);
+}
+
+// The timer fires on the thread running the test , which then leaves the
+// test the same way a crash does
+static void InstallTimeoutHandler() {
+  struct sigaction sa;
+  void*            frame[1];
+
+  // backtrace must not load the unwinder inside of the handler
+  backtrace(frame,1);
+
+  memset(&sa,0,sizeof(sa));
+  sa.sa_sigaction = OnTimeoutSignal;
+  sa.sa_flags     = SA_SIGINFO | SA_ONSTACK | SA_NODEFER;
+  sigemptyset(&sa.sa_mask);
+  sigaction(TIMEOUT_SIGNAL,&sa,&kTimeoutOld);
+  kTimeoutInstalled = 1;
+}
+
+static void UninstallTimeoutHandler() {
+  if(!kTimeoutInstalled) return;
+  sigaction(TIMEOUT_SIGNAL,&kTimeoutOld,NULL);
+  kTimeoutInstalled = 0;
+}
+
+static void ArmTestTimer( uint32_t ms ) {
+  struct itimerspec its;
+
+  if(!kTimerReady) {
+    struct sigevent sev;
+    memset(&sev,0,sizeof(sev));
+    sev.sigev_notify           = SIGEV_THREAD_ID;
+    sev.sigev_signo            = TIMEOUT_SIGNAL;
+    sev.sigev_notify_thread_id = gettid();
+    if(timer_create(CLOCK_MONOTONIC,&sev,&kTimer)) return;
+    kTimerReady = 1;
+  }
+
+  memset(&its,0,sizeof(its));
+  its.it_value.tv_sec  = ms / 1000;
+  its.it_value.tv_nsec = (long)(ms % 1000) * 1000000L;
+  timer_settime(kTimer,0,&its,NULL);
+}
+
+static void DisarmTestTimer() {
+  struct itimerspec its;
+  if(!kTimerReady) return;
+  memset(&its,0,sizeof(its));
+  timer_settime(kTimer,0,&its,NULL);
+}
+
+// Release the timer of the calling thread , called before a thread exits
+static void DeleteTestTimer() {
+  if(!kTimerReady) return;
+  timer_delete(kTimer);
+  kTimerReady = 0;
+}
+
+// Progress journal of the run , NULL if it is not kept. A test shown as
+// running gets a record and another one once its result is shown
+static Journal* kJournal;
+
+static void ShowTestBegin( const char* module , const char* name ) {
+  uint64_t out = ProfileBegin();
+  ColorFPrintf(stderr,NULL,"Blue",NULL,"[ RUN     ] ");
+  fprintf     (stderr,"%s.%s\n",module,name);
+  if(kJournal) JournalBegin(kJournal,module,name);
+  ProfileEnd(PROFILE_OUTPUT,out);
+}
+
+// Duration history of the tests , NULL if it is not kept
+static struct TimingDB* kTiming;
+
+// Show the result of a test , every mode ends up here so the duration of a
+// passing test is recorded here as well. The elapsed time is in microseconds
+static void ShowTestEnd( const char* module , const char* name , int rcode ,
+                                                                 uint64_t elapsed ) {
+  uint64_t out = ProfileBegin();
+  if(rcode == 0) {
+    if(kTiming) TimingDBUpdate(kTiming,module,name,elapsed);
+    ColorFPrintf(stderr,NULL,"Green",NULL,"[      OK ] ");
+    fprintf     (stderr,"%s.%s (%lldms)\n",module,name,(long long int)(elapsed / 1000));
+  } else {
+    ColorFPrintf(stderr,NULL,"Red",NULL,"[    FAIL ] ");
+    fprintf     (stderr,"%s.%s\n",module,name);
+  }
+  if(kJournal) JournalEnd(kJournal,module,name,rcode,elapsed);
+  ProfileEnd(PROFILE_OUTPUT,out);
+}
+
+// Run the body of a test , returns 0 if it passes and -1 if an assertion
+// fails , it crashes or it runs out of its timeout. A timeout of 0 is not
+// enforced. The assertions print into output , stderr if it is NULL. The
+// elapsed time is only set when it passes
+static int RunTestBody( void* address , const char* module ,
+                                        const char* name   ,
+                                        int            tt  ,
+                                        void*          ctx ,
+                                        uint32_t   timeout ,
+                                        FILE*       output ,
+                                        uint64_t*  elapsed ) {
+  TestContext t;
+  int rcode;
+
+  t.module  = module;
+  t.name    = name;
+  t.output  = output;
+  t.timeout = timeout;
+  t.failed  = 0;
+  t.expired = 0;
+
+  kTest       = &t;
+  kTestRunner = 1;
+  if(!kThreaded) kTestOwner = &t;
+
+  if(setjmp(t.env) == 0) {
+    uint64_t start,body;
+
+    body  = ProfileBegin();
+    start = TimeGetNow();
+    if(timeout) ArmTestTimer(timeout);
+    switch(tt) {
+      case TT_SIMPLE:
+        {
+          SimpleTest tc = (SimpleTest)(address);
+          tc();
+        }
+        break;
+      case TT_FIXTURE:
+        {
+          FixtureTest ft = (FixtureTest)(address);
+          ft(ctx);
+        }
+        break;
+      default:
+        break;
+    }
+    *elapsed = TimeGetNow() - start;
+    ProfileEnd(PROFILE_BODY,body);
+
+    // an assertion may have failed on a helper thread of the test
+    rcode = t.failed ? -1 : 0;
+  } else {
+    rcode = -1;
+  }
+
+  if(timeout) DisarmTestTimer();
+  kTest       = NULL;
+  kTestRunner = 0;
+  if(!kThreaded) kTestOwner = NULL;
+  ShowCrashBacktrace();
+  return rcode;
+}
+
+static int RunTest( void* address , const char* module , const char* name ,
+                                                         int            tt ,
+                                                         void*         ctx ,
+                                                         uint32_t  timeout ) {
+  uint64_t elapsed = 0;
+  int rcode;
+
+  ShowTestBegin(module,name);
+  ProfileCount(PROFILE_TEST,1);
+  rcode = RunTestBody(address,module,name,tt,ctx,timeout,NULL,&elapsed);
+  ShowTestEnd(module,name,rcode,elapsed);
+  return rcode;
+}
+
+/* --------------------------------------------
+ * Fixture Scope                              |
+ * -------------------------------------------*/
+
+// Everything is set up lazily right before the first test needing it runs ,
+// so a run whose filters select nothing of a module never pays for its setup
+
+enum {
+  HOOK_ENV_SETUP,
+  HOOK_ENV_TEARDOWN,
+  HOOK_SETUP,
+  HOOK_TEARDOWN
+};
+
+// Run a setup or a teardown under a context of its own , so a failed
+// assertion or a crash in it jumps back here as it does in a test instead of
+// ending the runner thread. The fixture made by HOOK_SETUP is stored into
+// ctx , HOOK_TEARDOWN gets it from there. Returns -1 if the hook fails
+static int RunFixtureHook( const char* module , int kind , void* hook , void** ctx ) {
+  TestContext t;
+  int rcode;
+
+  t.module  = module;
+  t.name    = kind == HOOK_ENV_SETUP || kind == HOOK_SETUP ? "SETUP" : "TEARDOWN";
+  t.output  = NULL;
+  t.timeout = 0;
+  t.failed  = 0;
+  t.expired = 0;
+
+  kTest       = &t;
+  kTestRunner = 1;
+  if(!kThreaded) kTestOwner = &t;
+
+  if(setjmp(t.env) == 0) {
+    switch(kind) {
+      case HOOK_ENV_SETUP:
+      case HOOK_ENV_TEARDOWN:
+        ((EnvironmentHook)(hook))();
+        break;
+      case HOOK_SETUP:
+        *ctx = ((FixtureSetup)(hook))();
+        break;
+      default:
+        ((FixtureTearDown)(hook))(*ctx);
+        break;
+    }
+    rcode = t.failed ? -1 : 0;
+  } else {
+    rcode = -1;
+  }
+
+  kTest       = NULL;
+  kTestRunner = 0;
+  if(!kThreaded) kTestOwner = NULL;
+  ShowCrashBacktrace();
+  return rcode;
+}
+
+// Fail a test without running it since a setup it needs failed , returns -1
+static int SkipBrokenTest( const char* module , const char* name ) {
+  ShowTestBegin(module,name);
+  ShowTestEnd(module,name,-1,0);
+  return -1;
+}
+
+// Set up the global environments that are not ready yet , cheap to call
+// before every test. Returns -1 if one of them failed , now or before , the
+// tests then fail without running
+static int SetupEnvironment( EnvEntry* env , size_t size ) {
+  size_t i;
+  int rcode = 0;
+  for( i = 0 ; i < size ; ++i ) {
+    EnvEntry* e = env + i;
+    if(!e->ready) {
+      e->ready = 1;
+      if(e->setup) {
+        ColorFPrintf(stderr,NULL,"Blue",NULL,"[ SETUP   ] ");
+        fprintf     (stderr,"%s\n",e->module);
+        if(RunFixtureHook(e->module,HOOK_ENV_SETUP,(void*)(e->setup),NULL)) {
+          ShowError("Setup of the environment %s failed , every test fails",e->module);
+          e->failed = 1;
+        }
+      }
+    }
+    if(e->failed) rcode = -1;
+  }
+  return rcode;
+}
+
+// Returns -1 if a teardown fails , the one of a failed setup is not run
+static int TearDownEnvironment( EnvEntry* env , size_t size ) {
+  size_t i;
+  int rcode = 0;
+  for( i = 0 ; i < size ; ++i ) {
+    EnvEntry* e = env + i;
+    int failed = e->failed;
+    if(!e->ready) continue;
+    e->ready  = 0;
+    e->failed = 0;
+    if(e->tear_down && !failed) {
+      ColorFPrintf(stderr,NULL,"Blue",NULL,"[ TEARDOWN] ");
+      fprintf     (stderr,"%s\n",e->module);
+      if(RunFixtureHook(e->module,HOOK_ENV_TEARDOWN,(void*)(e->tear_down),NULL)) {
+        ShowError("Teardown of the environment %s failed",e->module);
+        rcode = -1;
+      }
+    }
+  }
+  return rcode;
+}
+
+// Returns -1 if the setup fails , the tests of the fixture then fail
+static int SetupFixture( const ModuleEntry* me , void** ctx ) {
+  *ctx = NULL;
+  if(!me->setup) return 0;
+  ColorFPrintf(stderr,NULL,"Blue",NULL,"[ SETUP   ] ");
+  fprintf     (stderr,"%s\n",me->module);
+  if(RunFixtureHook(me->module,HOOK_SETUP,(void*)(me->setup),ctx)) {
+    ShowError("Setup of %s failed , its tests fail without running",me->module);
+    return -1;
+  }
+  return 0;
+}
+
+static int TearDownFixture( const ModuleEntry* me , void* ctx ) {
+  if(!me->setup || !me->tear_down) return 0;
+  ColorFPrintf(stderr,NULL,"Blue",NULL,"[ TEARDOWN] ");
+  fprintf     (stderr,"%s\n",me->module);
+  if(RunFixtureHook(me->module,HOOK_TEARDOWN,(void*)(me->tear_down),&ctx)) {
+    ShowError("Teardown of %s failed",me->module);
+    return -1;
+  }
+  return 0;
+}
+
+/* --------------------------------------------
+ * Forked Fixture                             |
+ * -------------------------------------------*/
+
+// Whether every fixture test runs in a child forked after the setup
+static int kForkFixture;
+
+static int ReadFull( int fd , void* buf , size_t len ) {
+  char* p = buf;
+  while(len) {
+    ssize_t n = read(fd,p,len);
+    if(n < 0 && errno == EINTR) continue;
+    if(n <= 0) return -1;
+    p   += n;
+    len -= (size_t)(n);
+  }
+  return 0;
+}
+
+static int WriteFull( int fd , const void* buf , size_t len ) {
+  const char* p = buf;
+  while(len) {
+    ssize_t n = write(fd,p,len);
+    if(n < 0 && errno == EINTR) continue;
+    if(n <= 0) return -1;
+    p   += n;
+    len -= (size_t)(n);
+  }
+  return 0;
+}
+
+static void DescribeExit( int status , char* buf , size_t len ) {
+  if(WIFSIGNALED(status)) {
+    snprintf(buf,len,"signal %s",strsignal(WTERMSIG(status)));
+  } else {
+    snprintf(buf,len,"exit code %d",WEXITSTATUS(status));
+  }
+}
+
+// Result a forked test sends back to the runner
+typedef struct _ForkResult {
+  int32_t  rcode;
+  uint64_t elapsed;
+} ForkResult;
+
+// Wait until the fd is readable or the budget in milliseconds runs out , 0
+// waits forever. Returns 0 if the budget runs out
+static int WaitReadable( int fd , uint32_t budget ) {
+  struct pollfd pfd;
+  uint64_t deadline = TimeGetNow() + (uint64_t)(budget) * 1000;
+
+  pfd.fd     = fd;
+  pfd.events = POLLIN;
+  for( ;; ) {
+    int wait = -1 , r;
+    if(budget) {
+      uint64_t now = TimeGetNow();
+      if(now >= deadline) return 0;
+      wait = (int)((deadline - now + 999) / 1000);
+    }
+    if((r = poll(&pfd,1,wait)) > 0) return 1;
+    if(r < 0 && errno != EINTR) return 1;
+  }
+}
+
+// Run a fixture test in a child forked from the runner after the setup , so
+// the test gets a copy on write copy of the fixture that no other test sees.
+// The teardown runs in the child on that copy. The child is killed once it
+// runs out of the timeout of the test
+static int RunForkedTestBody( const ModuleEntry* me , const TestEntry* t , void* ctx ,
+                                                                           uint64_t* elapsed ) {
+  ForkResult res;
+  uint32_t budget = TestTimeout(t);
+  int   fd[2];
+  int   status = 0 , rcode , expired = 0;
+  pid_t pid;
+  char  how[128];
+
+  if(pipe(fd)) {
+    ShowError("Cannot create a pipe , %s.%s runs without fork",me->module,t->name);
+    return RunTestBody(t->address,me->module,t->name,TT_FIXTURE,ctx,budget,NULL,elapsed);
+  }
+
+  fflush(stdout);
+  fflush(stderr);
+  if((pid = fork()) < 0) {
+    close(fd[0]);
+    close(fd[1]);
+    ShowError("Cannot fork , %s.%s runs without fork",me->module,t->name);
+    return RunTestBody(t->address,me->module,t->name,TT_FIXTURE,ctx,budget,NULL,elapsed);
+  }
+
+  if(pid == 0) {
+    // a child must not outlive its runner , ie when a worker gets killed
+    prctl(PR_SET_PDEATHSIG,SIGKILL);
+    close(fd[0]);
+    res.elapsed = 0;
+    res.rcode   = RunTestBody(t->address,me->module,t->name,TT_FIXTURE,ctx,0,NULL,
+                              &res.elapsed);
+    if(me->setup && me->tear_down &&
+       RunFixtureHook(me->module,HOOK_TEARDOWN,(void*)(me->tear_down),&ctx)) {
+      res.rcode = -1;
+    }
+    // _exit skips the stdio buffers of the child
+    fflush(stdout);
+    fflush(stderr);
+    WriteFull(fd[1],&res,sizeof(res));
+    _exit(0);
+  }
+
+  close(fd[1]);
+  if(!WaitReadable(fd[0],budget)) {
+    kill(pid,SIGKILL);
+    expired = 1;
+  }
+  rcode = ReadFull(fd[0],&res,sizeof(res));
+  close(fd[0]);
+  while(waitpid(pid,&status,0) < 0 && errno == EINTR)
+    ;
+
+  if(rcode && expired) {
+    ShowError("Test %s.%s timed out after %ums and is killed",me->module,t->name,budget);
+    return -1;
+  }
+
+  // the child died before it could report , the test or its teardown crashed
+  // without the crash handler
+  if(rcode) {
+    DescribeExit(status,how,sizeof(how));
+    ShowError("Test %s.%s exited with %s",me->module,t->name,how);
+    return -1;
+  }
+
+  *elapsed = res.elapsed;
+  return res.rcode;
+}
+
+static int RunForkedTest( const ModuleEntry* me , const TestEntry* t , void* ctx ) {
+  uint64_t elapsed = 0;
+  int rcode;
+
+  ShowTestBegin(me->module,t->name);
+  ProfileCount(PROFILE_TEST,1);
+  rcode = RunForkedTestBody(me,t,ctx,&elapsed);
+  ShowTestEnd(me->module,t->name,rcode,elapsed);
+  return rcode;
+}
+
+/* --------------------------------------------
+ * Async Runner                               |
+ * -------------------------------------------*/
+
+// Asynchronous tests of a module run at most this many at once
+#define ASYNC_MAX_RUNNING (256)
+
+// Continuations run per wait of the loop
+#define ASYNC_MAX_EVENT   (64)
+
+// Asynchronous Test function prototype
+typedef void (*AsyncTest)(CUnitAsync*);
+
+// A running asynchronous test , it owns its continuations in the loop. The
+// output of a test is kept apart until it ends since the tests interleave
+struct _CUnitAsync {
+  AsyncLoop*         loop;
+  const ModuleEntry* me;        // NULL if the slot is free
+  const TestEntry*   test;
+  uint32_t           index;     // of the test inside of the module
+  TestContext        ctx;
+  FILE*              output;
+  char*              buf;
+  size_t             len;
+  size_t             pending;   // continuations left in the loop
+  int                done;
+  int                failed;
+  uint64_t           start;
+  uint64_t           deadline;  // in microseconds , 0 if there is none
+};
+
+// A test that ended , it waits for the tests before it to be reported
+typedef struct _AsyncResult {
+  int      over;
+  int      rcode;
+  uint64_t elapsed;
+  char*    buf;
+  size_t   len;
+} AsyncResult;
+
+// Called once a test is reported , the output of the test is in buf
+typedef void (*AsyncReport)( const ModuleEntry* , uint32_t index , int rcode ,
+                                                                   uint64_t elapsed ,
+                                                                   const char* buf ,
+                                                                   size_t len ,
+                                                                   void* data );
+
+int CUnitAsyncWatch( CUnitAsync* a , int fd , unsigned events , CUnitAsyncCallback cb ,
+                                                                 void* data ) {
+  if(AsyncLoopWatch(a->loop,fd,events,a,cb,data)) {
+    fprintf(a->output ? a->output : stderr,"Cannot watch fd %d , %s\n",fd,strerror(errno));
+    a->ctx.failed = 1;
+    return -1;
+  }
+  ++a->pending;
+  return 0;
+}
+
+int CUnitAsyncTimer( CUnitAsync* a , unsigned ms , CUnitAsyncCallback cb , void* data ) {
+  if(AsyncLoopTimer(a->loop,ms,a,cb,data)) {
+    fprintf(a->output ? a->output : stderr,"Cannot create a timer , %s\n",strerror(errno));
+    a->ctx.failed = 1;
+    return -1;
+  }
+  ++a->pending;
+  return 0;
+}
+
+void CUnitAsyncDone( CUnitAsync* a ) {
+  a->done = 1;
+}
+
+// Run the body of the test , or one of its continuations when cb is not
+// NULL. A failed assertion jumps back here and only ends this test. The
+// timer catches a step that blocks instead of returning to the loop
+static void RunAsyncStep( CUnitAsync* a , CUnitAsyncCallback cb , int fd , unsigned events ,
+                                                                           void* data ) {
+  uint64_t body = ProfileBegin();
+
+  kTest       = &(a->ctx);
+  kTestRunner = 1;
+  if(!kThreaded) kTestOwner = &(a->ctx);
+
+  if(setjmp(a->ctx.env) == 0) {
+    if(a->deadline) {
+      uint64_t now = TimeGetNow();
+      ArmTestTimer(now < a->deadline ? (uint32_t)((a->deadline - now + 999) / 1000) : 1);
+    }
+    if(cb) {
+      cb(a,fd,events,data);
+    } else {
+      AsyncTest at = (AsyncTest)(a->test->address);
+      at(a);
+    }
+    if(a->ctx.failed) a->failed = 1;
+  } else {
+    a->failed = 1;
+  }
+
+  if(a->deadline) DisarmTestTimer();
+  kTest       = NULL;
+  kTestRunner = 0;
+  if(!kThreaded) kTestOwner = NULL;
+  ShowCrashBacktrace();
+  ProfileEnd(PROFILE_BODY,body);
+}
+
+static int IsAsyncTestOver( const CUnitAsync* a ) {
+  return a->failed || a->done || !a->pending;
+}
+
+static void FinishAsyncTest( CUnitAsync* a , AsyncResult* r ) {
+  AsyncLoopCancel(a->loop,a);
+  if(a->output) fclose(a->output);
+  r->over    = 1;
+  r->rcode   = a->failed ? -1 : 0;
+  r->elapsed = TimeGetNow() - a->start;
+  r->buf     = a->buf;
+  r->len     = a->buf ? a->len : 0;
+  memset(a,0,sizeof(*a));
+}
+
+static void StartAsyncTest( CUnitAsync* a , AsyncLoop* loop , const ModuleEntry* me ,
+                                                              uint32_t index ) {
+  uint32_t budget = TestTimeout(me->arr.arr + index);
+
+  memset(a,0,sizeof(*a));
+  a->loop   = loop;
+  a->me     = me;
+  a->test   = me->arr.arr + index;
+  a->index  = index;
+  a->output = open_memstream(&(a->buf),&(a->len));
+  a->start  = TimeGetNow();
+  if(budget) a->deadline = a->start + (uint64_t)(budget) * 1000;
+
+  a->ctx.module  = me->module;
+  a->ctx.name    = a->test->name;
+  a->ctx.output  = a->output;
+  a->ctx.timeout = budget;
+
+  RunAsyncStep(a,NULL,-1,0,NULL);
+}
+
+// Run the asynchronous tests [begin,end) of a module on one loop. The tests
+// are reported in the order of the module no matter in which order they end ,
+// so a worker streams its results the same way as for the other tests.
+// Returns -1 if any of them fails
+static int RunAsyncTests( const ModuleEntry* me , uint32_t begin , uint32_t end ,
+                                                  AsyncReport report ,
+                                                  void* data ) {
+  AsyncLoop    loop;
+  AsyncEvent   ev[ASYNC_MAX_EVENT];
+  CUnitAsync*  slot;
+  AsyncResult* result;
+  size_t       running = 0 , i;
+  uint32_t     next = begin , head = begin;
+  int rcode = 0;
+
+  if(AsyncLoopInit(&loop)) {
+    ShowError("Cannot create the loop of %s , %s",me->module,strerror(errno));
+    for( ; next < end ; ++next ) {
+      if(me->arr.arr[next].address) report(me,next,-1,0,NULL,0,data);
+    }
+    return -1;
+  }
+  slot   = calloc(ASYNC_MAX_RUNNING,sizeof(CUnitAsync));
+  result = calloc(end > begin ? end - begin : 1,sizeof(AsyncResult));
+
+  for( ;; ) {
+    uint64_t now;
+    int wait = -1 , n , k;
+
+    // 1. start tests until every slot is taken
+    for( i = 0 ; i < ASYNC_MAX_RUNNING && next < end ; ++i ) {
+      CUnitAsync* a = slot + i;
+      if(a->me) continue;
+      while(next < end && !me->arr.arr[next].address) result[next++ - begin].over = 1;
+      if(next == end) break;
+
+      StartAsyncTest(a,&loop,me,next++);
+      if(IsAsyncTestOver(a)) {
+        FinishAsyncTest(a,result + (a->index - begin));
+      } else {
+        ++running;
+      }
+    }
+
+    // 2. report the tests that ended , in order
+    for( ; head < next && result[head - begin].over ; ++head ) {
+      AsyncResult* r = result + (head - begin);
+      if(!me->arr.arr[head].address) continue;
+      if(r->rcode) rcode = -1;
+      report(me,head,r->rcode,r->elapsed,r->buf,r->len,data);
+      free(r->buf);
+    }
+    if(!running && next == end) break;
+
+    // 3. wait until the nearest deadline for the continuations
+    now = TimeGetNow();
+    for( i = 0 ; i < ASYNC_MAX_RUNNING ; ++i ) {
+      CUnitAsync* a = slot + i;
+      if(a->me && a->deadline) {
+        int left = a->deadline > now ? (int)((a->deadline - now + 999) / 1000) : 0;
+        if(wait < 0 || left < wait) wait = left;
+      }
+    }
+
+    if((n = AsyncLoopWait(&loop,wait,ev,ASYNC_MAX_EVENT)) < 0) {
+      ShowError("Cannot wait on the loop of %s , %s",me->module,strerror(errno));
+      for( i = 0 ; i < ASYNC_MAX_RUNNING ; ++i ) {
+        if(slot[i].me) slot[i].failed = 1;
+      }
+    }
+
+    // 4. run the continuations. A test may have ended earlier in the batch ,
+    // nothing of it runs once it is done or failed and what it has left in
+    // the loop is dropped right away
+    for( k = 0 ; k < n ; ++k ) {
+      CUnitAsync* a = ev[k].owner;
+      if(!a->me || IsAsyncTestOver(a)) continue;
+      --a->pending;
+      RunAsyncStep(a,ev[k].cb,ev[k].fd,ev[k].events,ev[k].data);
+      if(a->done || a->failed) AsyncLoopCancel(&loop,a);
+    }
+
+    // 5. end the tests that are over or run out of time
+    now = TimeGetNow();
+    for( i = 0 ; i < ASYNC_MAX_RUNNING ; ++i ) {
+      CUnitAsync* a = slot + i;
+      if(!a->me) continue;
+      if(!IsAsyncTestOver(a) && a->deadline && now >= a->deadline) {
+        fprintf(a->output ? a->output : stderr,"Test %s.%s timed out after %ums\n",
+                                               me->module,a->test->name,a->ctx.timeout);
+        a->failed = 1;
+      }
+      if(IsAsyncTestOver(a)) {
+        FinishAsyncTest(a,result + (a->index - begin));
+        --running;
+      }
+    }
+  }
+
+  free(result);
+  free(slot);
+  AsyncLoopDelete(&loop);
+  return rcode;
+}
+
+static void ShowAsyncTest( const ModuleEntry* me , uint32_t index , int rcode ,
+                                                                    uint64_t elapsed ,
+                                                                    const char* buf ,
+                                                                    size_t len ,
+                                                                    void* data ) {
+  uint64_t out = ProfileBegin();
+  (void)data;
+  ProfileCount(PROFILE_TEST,1);
+  ShowTestBegin(me->module,me->arr.arr[index].name);
+  if(len) fwrite(buf,1,len,stderr);
+  ShowTestEnd(me->module,me->arr.arr[index].name,rcode,elapsed);
+  ProfileEnd(PROFILE_OUTPUT,out);
+}
+
+/* --------------------------------------------
+ * Param Runner                               |
+ * -------------------------------------------*/
+
+// Rows of a TEST_P handed out in one work item are at least this many , so
+// cheap rows are not drowned by the cost of the item itself
+#define PARAM_MIN_ROWS (64)
+
+// Name a TEST_P is shown with for the rows [begin,end) , a slice of its rows
+// gets the range appended so each slice is timed on its own
+static const char* ParamLabel( const TestEntry* t , uint32_t begin , uint32_t end ,
+                                                                     char*  buf ,
+                                                                     size_t len ) {
+  if(begin == 0 && end >= t->row_size) return t->name;
+  snprintf(buf,len,"%s[%u-%u]",t->name,begin,end - 1);
+  return buf;
+}
+
+// Run the rows [begin,end) of a TEST_P in one batch. A failing row is
+// reported with its index and the next row goes on , the timeout covers the
+// whole batch and the rows left are skipped once it runs out. Returns 0 if
+// every row passes , the elapsed time is always set
+static int RunParamRows( const ModuleEntry* me , const TestEntry* t , uint32_t begin ,
+                                                                      uint32_t end   ,
+                                                                      uint32_t timeout ,
+                                                                      FILE*    output ,
+                                                                      uint64_t* elapsed ) {
+  ParamTest         pt  = (ParamTest)(t->address);
+  FILE*             out = output ? output : stderr;
+  TestContext       ctx;
+  volatile uint32_t i , failed = 0;
+  uint64_t          start , body;
+
+  if(!t->rows) {
+    fprintf(out,"Test %s.%s has no row table\n",me->module,t->name);
+    *elapsed = 0;
+    return -1;
+  }
+
+  ctx.module  = me->module;
+  ctx.name    = t->name;
+  ctx.output  = output;
+  ctx.timeout = timeout;
+  ctx.failed  = 0;
+  ctx.expired = 0;
+
+  kTest       = &ctx;
+  kTestRunner = 1;
+  if(!kThreaded) kTestOwner = &ctx;
+
+  body  = ProfileBegin();
+  start = TimeGetNow();
+  if(timeout) ArmTestTimer(timeout);
+  for( i = begin ; i < end ; ++i ) {
+    if(setjmp(ctx.env) == 0) {
+      pt(t->rows + (size_t)(i) * t->stride);
+      // an assertion may have failed on a helper thread of the row
+      if(!ctx.failed) continue;
+      ctx.failed = 0;
+    }
+    ++failed;
+    ShowCrashBacktrace();
+    fprintf(out,"Row %u of %s.%s failed\n",(unsigned)(i),me->module,t->name);
+    if(ctx.expired) {
+      if(i + 1 < end) fprintf(out,"Rows %u-%u are skipped\n",(unsigned)(i + 1),end - 1);
+      break;
+    }
+  }
+  if(timeout) DisarmTestTimer();
+  *elapsed = TimeGetNow() - start;
+  ProfileEnd(PROFILE_BODY,body);
+
+  kTest       = NULL;
+  kTestRunner = 0;
+  if(!kThreaded) kTestOwner = NULL;
+
+  if(failed) fprintf(out,"%u of %u rows failed\n",(unsigned)(failed),end - begin);
+  return failed ? -1 : 0;
+}
+
+static int RunParamTest( const ModuleEntry* me , const TestEntry* t ) {
+  uint64_t elapsed = 0;
+  int rcode;
+
+  ShowTestBegin(me->module,t->name);
+  ProfileCount(PROFILE_TEST,1);
+  rcode = RunParamRows(me,t,0,t->row_size,TestTimeout(t),NULL,&elapsed);
+  ShowTestEnd(me->module,t->name,rcode,elapsed);
+  return rcode;
+}
+
+static int RunTestPlan( const TestPlan* tp ) {
+  size_t i;
+  int rcode = 0;
+  uint64_t start = ProfileBegin();
+  for( i = 0 ; i < tp->size ; ++i ) {
+    ModuleEntry* me = tp->module + i;
+    uint64_t    out = ProfileBegin();
+    ColorFPrintf(stderr,NULL,"Blue",NULL,"[ SUITE(%s)] ",GetTTName(me->tt));
+    fprintf     (stderr,"%s\n",me->module);
+    ProfileEnd(PROFILE_OUTPUT,out);
+
+    switch(me->tt) {
+      case TT_SIMPLE:
+        for( size_t j = 0 ; j < me->arr.size ; ++j ) {
+          TestEntry* t  = me->arr.arr + j;
+          if(!t->address) continue;
+          if(SetupEnvironment(tp->env,tp->env_size)) {
+            rcode = SkipBrokenTest(me->module,t->name);
+          } else if(RunTest(t->address,me->module,t->name,TT_SIMPLE,NULL,TestTimeout(t))) {
+            rcode = -1;
+          }
+        }
+        break;
+      case TT_FIXTURE:
+        {
+          void* ctx    = NULL;
+          int   ready  = 0;
+          int   broken = 0;   // whether the setup failed
+
+          for( size_t j = 0 ; j < me->arr.size ; ++j ) {
+            TestEntry* t = me->arr.arr + j;
+            if(!t->address) continue;
+
+            if(!ready) {
+              broken = SetupEnvironment(tp->env,tp->env_size) || SetupFixture(me,&ctx);
+              ready  = 1;
+            }
+
+            if(broken) {
+              rcode = SkipBrokenTest(me->module,t->name);
+            } else if(kForkFixture ? RunForkedTest(me,t,ctx) :
+                                     RunTest(t->address,me->module,t->name,TT_FIXTURE,ctx,
+                                             TestTimeout(t))) {
+              rcode = -1;
+            }
+
+            if(me->per_test) {
+              if(!broken && TearDownFixture(me,ctx)) rcode = -1;
+              ready = 0;
+            }
+          }
+
+          if(ready && !broken && TearDownFixture(me,ctx)) rcode = -1;
+        }
+        break;
+      case TT_ASYNC:
+        {
+          size_t j;
+          for( j = 0 ; j < me->arr.size && !me->arr.arr[j].address ; ++j )
+            ;
+          if(j == me->arr.size) break;
+
+          if(SetupEnvironment(tp->env,tp->env_size)) {
+            for( ; j < me->arr.size ; ++j ) {
+              if(me->arr.arr[j].address) rcode = SkipBrokenTest(me->module,me->arr.arr[j].name);
+            }
+          } else if(RunAsyncTests(me,0,(uint32_t)(me->arr.size),ShowAsyncTest,NULL)) {
+            rcode = -1;
+          }
+        }
+        break;
+      case TT_PARAM:
+        for( size_t j = 0 ; j < me->arr.size ; ++j ) {
+          TestEntry* t = me->arr.arr + j;
+          if(!t->address) continue;
+          if(SetupEnvironment(tp->env,tp->env_size)) {
+            rcode = SkipBrokenTest(me->module,t->name);
+          } else if(RunParamTest(me,t)) {
+            rcode = -1;
+          }
+        }
+        break;
+      default:
+        break;
+    }
+    out = ProfileBegin();
+    ShowSeparator();
+    ProfileEnd(PROFILE_OUTPUT,out);
+  }
+  if(TearDownEnvironment(tp->env,tp->env_size)) rcode = -1;
+  ProfileEnd(PROFILE_RUN,start);
+  return rcode;
+}
+
+/* --------------------------------------------
+ * Parallel Runner                            |
+ * -------------------------------------------*/
+
+// A range of tests of one module handed out to a worker. A fixture module
+// is handed out as a whole so its setup , tests and teardown all run in the
+// same worker , an asynchronous module so its tests share one loop , and a
+// simple test is handed out alone. The rows of a TEST_P are split into
+// slices handed out alone
+typedef struct _WorkItem {
+  uint32_t module;
+  uint32_t begin;
+  uint32_t end;
+  uint32_t iteration;   // round of the repeat mode , from 0
+  uint32_t row_begin;   // rows of a TEST_P , a slice of them is an item
+  uint32_t row_end;
+} WorkItem;
+
+typedef struct _WorkQueue {
+  WorkItem* item;
+  size_t    head;
+  size_t    size;
+  size_t    cap;
+  size_t    round;      // items of one round , the first ones of the queue
+} WorkQueue;
+
+// Kind of the frames a worker sends back to the parent
+enum {
+  FRAME_SETUP,
+  FRAME_TEST,
+  FRAME_TEARDOWN,
+  FRAME_DONE
+};
+
+// A frame is followed by len bytes of output the worker printed into its
+// stderr while running it
+typedef struct _WorkFrame {
+  int32_t  kind;
+  int32_t  rcode;
+  uint32_t test;
+  uint32_t len;
+  uint64_t elapsed;
+} WorkFrame;
+
+typedef struct _Worker {
+  pid_t    pid;     // 0 if the slot has no worker
+  int      cmd;     // write end of the command pipe , -1 once closed
+  int      res;     // read end of the result pipe
+  int      log;     // file the stderr of the worker is redirected into
+  int      busy;
+  int      setup;   // whether the setup of the current item has finished
+  int      expired; // whether it is killed for running out of the timeout
+  uint64_t since;   // when the running test started , in microseconds
+  int      token;   // job slot of the current item , JOB_TOKEN_NONE if idle
+  WorkItem item;    // tests left of the current item , begin is the running one
+} Worker;
+
+// Result of one test over every round of the repeat mode
+typedef struct _StressStat {
+  uint64_t runs;
+  uint64_t fails;
+  uint32_t first;       // iteration of the first failure , from 1
+} StressStat;
+
+// State of the repeat mode , the queue is refilled round by round
+typedef struct _StressRun {
+  uint32_t    repeat;     // number of rounds , 0 repeats until a test fails
+  int         until_fail; // whether the rounds stop at the first failure
+  uint32_t    rounds;     // rounds queued so far
+  int         failed;
+  StressStat* stat;       // one per test of the plan
+  size_t*     base;       // index into stat of the first test of each module
+} StressRun;
+
+// NULL unless the tests are repeated
+static StressRun* kStress;
+
+// Jobserver of the parent make , NULL if the jobs are not limited by it
+static JobServer* kJobServer;
+
+// Whether the implicit job slot of this process is taken
+static int kJobImplicit;
+
+#define JOB_TOKEN_NONE      (-1)
+#define JOB_TOKEN_IMPLICIT  (256)   // the slot make gives to this process
+#define JOB_TOKEN_UNLIMITED (257)   // there is no jobserver
+
+// Take a job slot for an item , waiting up to ms milliseconds for a token of
+// make. Returns JOB_TOKEN_NONE if every slot is taken
+static int TakeJobToken( int ms ) {
+  int expect = 0;
+  if(!kJobServer) return JOB_TOKEN_UNLIMITED;
+  if(__atomic_compare_exchange_n(&kJobImplicit,&expect,1,0,__ATOMIC_ACQUIRE,
+                                                            __ATOMIC_RELAXED)) {
+    return JOB_TOKEN_IMPLICIT;
+  }
+  return JobServerAcquire(kJobServer,ms);
+}
+
+static void GiveJobToken( int token ) {
+  if(token == JOB_TOKEN_IMPLICIT) {
+    __atomic_store_n(&kJobImplicit,0,__ATOMIC_RELEASE);
+  } else if(token >= 0 && token < JOB_TOKEN_IMPLICIT) {
+    JobServerRelease(kJobServer,token);
+  }
+}
+
+static void PushWorkItem( WorkQueue* q , size_t module , size_t begin , size_t end ) {
+  if(q->size == q->cap) {
+    q->cap  = q->cap ? q->cap * 2 : 64;
+    q->item = realloc(q->item,sizeof(WorkItem) * q->cap);
+  }
+  q->item[q->size].module = (uint32_t)(module);
+  q->item[q->size].begin  = (uint32_t)(begin);
+  q->item[q->size].end    = (uint32_t)(end);
+  q->item[q->size].iteration = 0;
+  q->item[q->size].row_begin = 0;
+  q->item[q->size].row_end   = 0;
+  ++q->size;
+}
+
+// Queue the tests of an item after the one a dead worker was running
+static void RequeueWorkItem( WorkQueue* q , const WorkItem* item ) {
+  if(item->begin + 1 < item->end) {
+    PushWorkItem(q,item->module,item->begin + 1,item->end);
+    q->item[q->size - 1].iteration = item->iteration;
+  }
+}
+
+// Whether there is an item left to hand out. The repeat mode queues the
+// next round once the queue is drained , the first round stays at the front
+// of the queue as the template of the others
+static int MoreWork( WorkQueue* q ) {
+  size_t i;
+
+  if(!kStress) return q->head < q->size;
+  if(kStress->until_fail && kStress->failed) return 0;
+  if(q->head < q->size) return 1;
+  if(kStress->repeat && kStress->rounds >= kStress->repeat) return 0;
+
+  q->head = q->size = q->round;
+  for( i = 0 ; i < q->round ; ++i ) {
+    WorkItem item = q->item[i];
+    PushWorkItem(q,item.module,item.begin,item.end);
+    q->item[q->size - 1] = item;
+    q->item[q->size - 1].iteration = kStress->rounds;
+  }
+  ++kStress->rounds;
+  return q->head < q->size;
+}
+
+// Record a run of the test j of the module of an item
+static void StressRecord( const TestPlan* tp , const WorkItem* item , uint32_t j ,
+                                                                      int rcode ) {
+  StressStat* s = kStress->stat + kStress->base[item->module] + j;
+  ++s->runs;
+  if(rcode) {
+    const ModuleEntry* me = tp->module + item->module;
+    ShowError("%s.%s failed in iteration %u",me->module,me->arr.arr[j].name,
+                                               item->iteration + 1);
+    // workers report out of order , the first failure is the lowest iteration
+    if(!s->fails || item->iteration + 1 < s->first) s->first = item->iteration + 1;
+    ++s->fails;
+    kStress->failed = 1;
+  }
+}
+
+// Estimated cost of an item in microseconds , a test without history costs
+// the average of the known tests
+static double EstimateWorkItem( const TestPlan* tp , const WorkItem* item ,
+                                                     double      average ) {
+  const ModuleEntry* me = tp->module + item->module;
+  double cost = 0.0;
+  uint32_t  j;
+
+  if(me->tt == TT_PARAM) {
+    const TestEntry* t = me->arr.arr + item->begin;
+    char label[1024];
+    const TimingEntry* e;
+
+    if(!kTiming) return average;
+    if((e = TimingDBFind(kTiming,me->module,ParamLabel(t,item->row_begin,item->row_end,
+                                                          label,sizeof(label))))) {
+      return e->mean;
+    }
+    // a slice never timed yet , scale the time of all the rows
+    if(t->row_size && (e = TimingDBFind(kTiming,me->module,t->name))) {
+      return e->mean * (item->row_end - item->row_begin) / t->row_size;
+    }
+    return average;
+  }
+
+  for( j = item->begin ; j < item->end ; ++j ) {
+    const TimingEntry* e = kTiming ? TimingDBFind(kTiming,me->module,me->arr.arr[j].name) :
+                                     NULL;
+    cost += e ? e->mean : average;
+  }
+  return cost;
+}
+
+typedef struct _WorkCost {
+  WorkItem item;
+  double   cost;
+  size_t   pos;
+} WorkCost;
+
+static int CompareWorkCost( const void* l , const void* r ) {
+  const WorkCost* lhs = l;
+  const WorkCost* rhs = r;
+  if(lhs->cost != rhs->cost) return lhs->cost > rhs->cost ? -1 : 1;
+  return lhs->pos < rhs->pos ? -1 : (lhs->pos > rhs->pos);
+}
+
+// Order the items longest first ( LPT ) by their recorded durations , so the
+// few slow tests start early instead of being the long tail of the run
+static void SortWorkQueue( const TestPlan* tp , WorkQueue* q ) {
+  WorkCost* cost = malloc(sizeof(WorkCost) * (q->size ? q->size : 1));
+  double average = TimingDBAverage(kTiming);
+  size_t       i;
+
+  for( i = 0 ; i < q->size ; ++i ) {
+    cost[i].item = q->item[i];
+    cost[i].cost = EstimateWorkItem(tp,q->item + i,average);
+    cost[i].pos  = i;
+  }
+  qsort(cost,q->size,sizeof(WorkCost),CompareWorkCost);
+  for( i = 0 ; i < q->size ; ++i ) {
+    q->item[i] = cost[i].item;
+  }
+  free(cost);
+}
+
+// Split the plan into items for parts runners. Without a duration history
+// fixture and asynchronous modules go first since they are likely the longest
+// ones , otherwise the items are ordered by their recorded durations
+static void BuildWorkQueue( const TestPlan* tp , WorkQueue* q , size_t parts ) {
+  size_t i , j;
+
+  memset(q,0,sizeof(*q));
+  for( i = 0 ; i < tp->size ; ++i ) {
+    ModuleEntry* me = tp->module + i;
+    if(((me->tt == TT_FIXTURE && !me->per_test) || me->tt == TT_ASYNC) && me->arr.size) {
+      PushWorkItem(q,i,0,me->arr.size);
+    }
+  }
+  // a test of a per test fixture module carries its own setup , so it is
+  // handed out alone like a simple test
+  for( i = 0 ; i < tp->size ; ++i ) {
+    ModuleEntry* me = tp->module + i;
+    if(me->tt != TT_SIMPLE && !me->per_test) continue;
+    for( j = 0 ; j < me->arr.size ; ++j ) {
+      if(me->arr.arr[j].address) PushWorkItem(q,i,j,j+1);
+    }
+  }
+  // the rows of a TEST_P are cut into a few slices per runner
+  for( i = 0 ; i < tp->size ; ++i ) {
+    ModuleEntry* me = tp->module + i;
+    if(me->tt != TT_PARAM) continue;
+    for( j = 0 ; j < me->arr.size ; ++j ) {
+      const TestEntry* t = me->arr.arr + j;
+      size_t slice = (t->row_size + parts * 4 - 1) / (parts * 4) , r = 0;
+
+      if(!t->address) continue;
+      if(slice < PARAM_MIN_ROWS) slice = PARAM_MIN_ROWS;
+      do {
+        PushWorkItem(q,i,j,j+1);
+        q->item[q->size - 1].row_begin = (uint32_t)(r);
+        r = r + slice < t->row_size ? r + slice : t->row_size;
+        q->item[q->size - 1].row_end   = (uint32_t)(r);
+      } while(r < t->row_size);
+    }
+  }
+
+  if(kTiming) SortWorkQueue(tp,q);
+  q->round = q->size;
+}
+
+// Send a frame together with the output captured since the previous one
+static void SendFrame( int res , int log , int kind , uint32_t test , int rcode ,
+                                                                      uint64_t elapsed ) {
+  WorkFrame f;
+  off_t     len;
+  char*     buf = NULL;
+
+  // stdout is shared with the parent , whatever the test printed into it
+  // goes out before its result
+  fflush(stdout);
+  fflush(stderr);
+  len       = lseek(log,0,SEEK_CUR);
+  f.kind    = kind;
+  f.rcode   = rcode;
+  f.test    = test;
+  f.elapsed = elapsed;
+  f.len     = len > 0 ? (uint32_t)(len) : 0;
+
+  if(f.len) {
+    buf = malloc(f.len);
+    if(pread(log,buf,f.len,0) != (ssize_t)(f.len)) f.len = 0;
+  }
+
+  // the parent is gone , nobody is waiting for the rest
+  if(WriteFull(res,&f,sizeof(f)) || WriteFull(res,buf,f.len)) _exit(1);
+
+  free(buf);
+  if(ftruncate(log,0) == 0) lseek(log,0,SEEK_SET);
+}
+
+// Where a worker sends the result of an asynchronous test
+typedef struct _WorkerPipe {
+  int res;
+  int log;
+} WorkerPipe;
+
+static void SendAsyncTest( const ModuleEntry* me , uint32_t index , int rcode ,
+                                                                    uint64_t elapsed ,
+                                                                    const char* buf ,
+                                                                    size_t len ,
+                                                                    void* data ) {
+  WorkerPipe* p = data;
+  (void)me;
+  if(len) fwrite(buf,1,len,stderr);
+  SendFrame(p->res,p->log,FRAME_TEST,index,rcode,elapsed);
+}
+
+// Main loop of a worker , it runs the items sent by the parent until the
+// command pipe is closed
+static void RunWorker( const TestPlan* tp , int cmd , int res , int log ) {
+  WorkItem item;
+  int     rcode;
+
+  dup2(log,STDERR_FILENO);
+
+  while(ReadFull(cmd,&item,sizeof(item)) == 0) {
+    ModuleEntry* me = tp->module + item.module;
+    int     fixture = me->tt == TT_FIXTURE;
+    void*       ctx = NULL;
+    uint32_t      j;
+    int      broken;
+
+    // each worker has its own environment , set up by its first item
+    broken = SetupEnvironment(tp->env,tp->env_size);
+
+    if(fixture) {
+      if(!broken && me->setup &&
+         RunFixtureHook(me->module,HOOK_SETUP,(void*)(me->setup),&ctx)) {
+        ShowError("Setup of %s failed , its tests fail without running",me->module);
+        broken = -1;
+      }
+      SendFrame(res,log,FRAME_SETUP,0,0,0);
+    }
+
+    // a failed setup fails every test of the item without running them
+    if(broken) {
+      for( j = item.begin ; j < item.end ; ++j ) {
+        if(me->arr.arr[j].address) SendFrame(res,log,FRAME_TEST,j,-1,0);
+      }
+      if(fixture) SendFrame(res,log,FRAME_TEARDOWN,0,0,0);
+      SendFrame(res,log,FRAME_DONE,0,0,0);
+      continue;
+    }
+
+    // asynchronous tests keep their own deadlines , the parent only kills a
+    // worker stuck in one
+    if(me->tt == TT_ASYNC) {
+      WorkerPipe p;
+      p.res = res;
+      p.log = log;
+      RunAsyncTests(me,item.begin,item.end,SendAsyncTest,&p);
+      SendFrame(res,log,FRAME_DONE,0,0,0);
+      continue;
+    }
+
+    for( j = item.begin ; j < item.end ; ++j ) {
+      TestEntry* t = me->arr.arr + j;
+      uint64_t elapsed = 0;
+      int rcode;
+
+      if(!t->address) continue;
+      if(me->tt == TT_PARAM) {
+        // stops by itself so the rows left are reported as skipped
+        rcode = RunParamRows(me,t,item.row_begin,item.row_end,TestTimeout(t),NULL,
+                                                                             &elapsed);
+      } else if(fixture && kForkFixture) {
+        rcode = RunForkedTestBody(me,t,ctx,&elapsed);
+      } else {
+        // the parent enforces the timeout by killing the worker
+        rcode = RunTestBody(t->address,me->module,t->name,me->tt,ctx,0,NULL,&elapsed);
+      }
+      SendFrame(res,log,FRAME_TEST,j,rcode,elapsed);
+    }
+
+    if(fixture) {
+      int rcode = 0;
+      if(me->setup && me->tear_down &&
+         RunFixtureHook(me->module,HOOK_TEARDOWN,(void*)(me->tear_down),&ctx)) {
+        ShowError("Teardown of %s failed",me->module);
+        rcode = -1;
+      }
+      SendFrame(res,log,FRAME_TEARDOWN,0,rcode,0);
+    }
+    SendFrame(res,log,FRAME_DONE,0,0,0);
+  }
+
+  // nothing reads the log any more , the parent learns of a failed teardown
+  // of the environment from the exit code. _exit skips the stdio buffers
+  rcode = TearDownEnvironment(tp->env,tp->env_size);
+  fflush(stdout);
+  fflush(stderr);
+  _exit(rcode ? 1 : 0);
+}
+
+static int SpawnWorker( const TestPlan* tp , Worker* pool , size_t size , size_t slot ) {
+  Worker* w = pool + slot;
+  int cmd[2] = {-1,-1} , res[2] = {-1,-1};
+  FILE* log;
+  pid_t pid;
+  size_t i;
+
+  if(!(log = tmpfile())) return -1;
+  if(pipe(cmd) || pipe(res)) goto fail;
+
+  fflush(stdout);
+  fflush(stderr);
+  if((pid = fork()) < 0) goto fail;
+
+  if(pid == 0) {
+    // the worker must not hold the pipes of the others , otherwise they
+    // never see the end of their command pipe
+    for( i = 0 ; i < size ; ++i ) {
+      if(pool[i].pid) {
+        if(pool[i].cmd >= 0) close(pool[i].cmd);
+        close(pool[i].res);
+        close(pool[i].log);
+      }
+    }
+    close(cmd[1]);
+    close(res[0]);
+    RunWorker(tp,cmd[0],res[1],fileno(log));
+  }
+
+  close(cmd[0]);
+  close(res[1]);
+  w->pid   = pid;
+  w->cmd   = cmd[1];
+  w->res   = res[0];
+  w->log   = dup(fileno(log));
+  w->busy  = 0;
+  w->setup = 0;
+  w->expired = 0;
+  w->token = JOB_TOKEN_NONE;
+  fclose(log);
+  return 0;
+
+fail:
+  for( i = 0 ; i < 2 ; ++i ) {
+    if(cmd[i] >= 0) close(cmd[i]);
+    if(res[i] >= 0) close(res[i]);
+  }
+  fclose(log);
+  return -1;
+}
+
+// Hand out the next item to an idle worker , the command pipe is closed
+// once the queue is drained so the worker exits
+static void DispatchWork( Worker* w , WorkQueue* q ) {
+  // the slot goes back between items so the other jobs of make get a turn
+  GiveJobToken(w->token);
+  w->token = JOB_TOKEN_NONE;
+
+  if(!MoreWork(q)) {
+    close(w->cmd);
+    w->cmd  = -1;
+    w->busy = 0;
+    return;
+  }
+
+  // every slot is taken , the worker stays idle until a token shows up
+  if((w->token = TakeJobToken(0)) == JOB_TOKEN_NONE) {
+    w->busy = 0;
+    return;
+  }
+
+  w->item  = q->item[q->head++];
+  w->busy  = 1;
+  w->setup = 0;
+  w->since = TimeGetNow();
+
+  // the worker is already dead , the item goes back and the death is
+  // noticed through the result pipe
+  if(WriteFull(w->cmd,&w->item,sizeof(w->item))) {
+    --q->head;
+    w->busy = 0;
+    GiveJobToken(w->token);
+    w->token = JOB_TOKEN_NONE;
+  }
+}
+
+static void ShowWorkerOutput( const char* buf , size_t len ) {
+  if(len) fwrite(buf,1,len,stderr);
+}
+
+// Handle a frame of a worker , returns -1 if a test failed
+static int OnWorkFrame( const TestPlan* tp , Worker* w , WorkQueue* q ,
+                                                         const WorkFrame* f ,
+                                                         const char*    buf ) {
+  ModuleEntry* me = tp->module + w->item.module;
+  uint64_t    out = ProfileBegin();
+  int       rcode = 0;
+
+  // the next test of the item starts right after the frame
+  w->since = TimeGetNow();
+
+  switch(f->kind) {
+    case FRAME_SETUP:
+      w->setup = 1;
+      if(me->setup && !kStress) {
+        ColorFPrintf(stderr,NULL,"Blue",NULL,"[ SETUP   ] ");
+        fprintf     (stderr,"%s\n",me->module);
+      }
+      ShowWorkerOutput(buf,f->len);
+      break;
+    case FRAME_TEST:
+      {
+        TestEntry* t = me->arr.arr + f->test;
+        const char* name;
+        char label[1024];
+        ProfileCount(PROFILE_TEST,1);
+        w->item.begin = f->test + 1;
+
+        // the repeat mode only shows the failing runs , there are plenty
+        if(kStress && !f->rcode) {
+          StressRecord(tp,&(w->item),f->test,0);
+          break;
+        }
+
+        name = me->tt == TT_PARAM ? ParamLabel(t,w->item.row_begin,w->item.row_end,
+                                                 label,sizeof(label)) : t->name;
+        ShowTestBegin(me->module,name);
+        ShowWorkerOutput(buf,f->len);
+        ShowTestEnd(me->module,name,f->rcode,f->elapsed);
+        if(f->rcode) rcode = -1;
+        if(kStress) StressRecord(tp,&(w->item),f->test,f->rcode);
+      }
+      break;
+    case FRAME_TEARDOWN:
+      if(me->setup && me->tear_down && !kStress) {
+        ColorFPrintf(stderr,NULL,"Blue",NULL,"[ TEARDOWN] ");
+        fprintf     (stderr,"%s\n",me->module);
+      }
+      ShowWorkerOutput(buf,f->len);
+      if(f->rcode) rcode = -1;
+      break;
+    case FRAME_DONE:
+      ShowWorkerOutput(buf,f->len);
+      DispatchWork(w,q);
+      break;
+    default:
+      break;
+  }
+
+  ProfileEnd(PROFILE_OUTPUT,out);
+  return rcode;
+}
+
+// Timeout of what a worker runs now in milliseconds , 0 if there is none.
+// Only tests are timed , not the setup or the teardown of a fixture module. A
+// forked fixture test , an asynchronous test or a TEST_P is ended by the
+// worker itself , the parent only steps in when the worker does not
+static uint32_t WorkerBudget( const TestPlan* tp , const Worker* w ) {
+  const ModuleEntry* me = tp->module + w->item.module;
+  uint32_t budget;
+
+  if(!w->busy || w->item.begin >= w->item.end) return 0;
+  if(me->tt == TT_FIXTURE && !w->setup) return 0;
+
+  budget = TestTimeout(me->arr.arr + w->item.begin);
+  if(budget && kForkFixture && me->tt == TT_FIXTURE) budget += 1000;
+  if(budget && (me->tt == TT_ASYNC || me->tt == TT_PARAM)) budget += 1000;
+  return budget;
+}
+
+// Kill the workers that run out of the timeout of their test , returns the
+// time in milliseconds until the next one runs out , -1 if none is timed
+static int ExpireWorkers( const TestPlan* tp , Worker* pool , size_t size ) {
+  uint64_t now  = TimeGetNow();
+  int      wait = -1;
+  size_t   i;
+
+  for( i = 0 ; i < size ; ++i ) {
+    Worker*     w = pool + i;
+    uint32_t budget;
+    uint64_t deadline;
+
+    if(!w->pid || w->expired || !(budget = WorkerBudget(tp,w))) continue;
+
+    deadline = w->since + (uint64_t)(budget) * 1000;
+    if(now >= deadline) {
+      kill(w->pid,SIGKILL);
+      w->expired = 1;
+    } else {
+      int left = (int)((deadline - now + 999) / 1000);
+      if(wait < 0 || left < wait) wait = left;
+    }
+  }
+  return wait;
+}
+
+// Show whatever a worker printed after its last frame , ie before it died
+static void ShowWorkerLog( const Worker* w ) {
+  struct stat st;
+  if(fstat(w->log,&st) == 0 && st.st_size > 0) {
+    char* buf = malloc(st.st_size);
+    if(pread(w->log,buf,st.st_size,0) == st.st_size) {
+      ShowWorkerOutput(buf,st.st_size);
+    }
+    free(buf);
+  }
+}
+
+// Reap a worker whose result pipe is closed. If it died in the middle of an
+// item the running test fails and the rest of the item goes back to the
+// queue , returns -1 in that case
+static int ReapWorker( const TestPlan* tp , Worker* w , WorkQueue* q ) {
+  int    status = 0 , rcode = 0;
+  char   how[128];
+
+  while(waitpid(w->pid,&status,0) < 0 && errno == EINTR)
+    ;
+
+  if(w->busy) {
+    ModuleEntry* me = tp->module + w->item.module;
+    TestEntry*    t = w->item.begin < w->item.end ? me->arr.arr + w->item.begin : NULL;
+    int       setup = me->tt == TT_FIXTURE && !w->setup;
+    const char* name = NULL;
+    char label[1024];
+
+    // a slice of a TEST_P is shown the way its worker frame would show it
+    if(t) name = me->tt == TT_PARAM ? ParamLabel(t,w->item.row_begin,w->item.row_end,
+                                                   label,sizeof(label)) : t->name;
+
+    DescribeExit(status,how,sizeof(how));
+    if(t && !setup) ShowTestBegin(me->module,name);
+
+    ShowWorkerLog(w);
+
+    if(setup) {
+      // the setup would only crash again , fail the whole item
+      uint32_t j;
+      ShowError("Worker %d exited with %s during the setup of %s",(int)(w->pid),how,me->module);
+      for( j = w->item.begin ; j < w->item.end ; ++j ) {
+        ShowTestEnd(me->module,me->arr.arr[j].name,-1,0);
+        if(kStress) StressRecord(tp,&(w->item),j,-1);
+      }
+    } else if(t && w->expired) {
+      ShowError("Test %s.%s timed out after %ums , worker %d is killed",me->module,name,
+                TestTimeout(t),(int)(w->pid));
+      ShowTestEnd(me->module,name,-1,0);
+      if(kStress) StressRecord(tp,&(w->item),w->item.begin,-1);
+      RequeueWorkItem(q,&(w->item));
+    } else if(t) {
+      ShowError("Worker %d exited with %s while running %s.%s",(int)(w->pid),how,
+                                                               me->module,name);
+      ShowTestEnd(me->module,name,-1,0);
+      if(kStress) StressRecord(tp,&(w->item),w->item.begin,-1);
+      RequeueWorkItem(q,&(w->item));
+    } else {
+      ShowError("Worker %d exited with %s during the teardown of %s",(int)(w->pid),how,
+                                                                     me->module);
+    }
+    rcode = -1;
+  } else if(!WIFEXITED(status) || WEXITSTATUS(status)) {
+    // the teardown of the environment failed once the work was done
+    DescribeExit(status,how,sizeof(how));
+    ShowWorkerLog(w);
+    ShowError("Worker %d exited with %s after its last item",(int)(w->pid),how);
+    rcode = -1;
+  }
+
+  GiveJobToken(w->token);
+  if(w->cmd >= 0) close(w->cmd);
+  close(w->res);
+  close(w->log);
+  memset(w,0,sizeof(*w));
+  return rcode;
+}
+
+// Run the plan with jobs forked workers. Tests are handed out one item at a
+// time over pipes , the results stream back and are printed by the parent.
+// A worker that dies is replaced and the run goes on
+static int RunTestPlanParallel( const TestPlan* tp , int jobs ) {
+  WorkQueue       q;
+  Worker*         pool;
+  struct pollfd*  pfd;
+  size_t*         slot;
+  size_t          size , i , j , live;
+  struct sigaction sa , old_pipe;
+  int rcode = 0;
+  uint64_t start;
+
+  // 1. split the plan into items
+  BuildWorkQueue(tp,&q,jobs > 0 ? (size_t)(jobs) : 1);
+
+  size  = (size_t)(jobs) < q.size ? (size_t)(jobs) : q.size;
+  pool  = calloc(size ? size : 1,sizeof(Worker));
+  pfd   = calloc(size + 1,sizeof(struct pollfd));
+  slot  = calloc(size ? size : 1,sizeof(size_t));
+  start = ProfileBegin();
+
+  // writing into the pipe of a dead worker must not kill the parent
+  memset(&sa,0,sizeof(sa));
+  sa.sa_handler = SIG_IGN;
+  sigemptyset(&sa.sa_mask);
+  sigaction(SIGPIPE,&sa,&old_pipe);
+
+  // 2. start the workers
+  for( i = 0 , live = 0 ; i < size ; ++i ) {
+    if(SpawnWorker(tp,pool,size,i) == 0) {
+      DispatchWork(pool + i,&q);
+      ++live;
+    }
+  }
+
+  if(size && !live) {
+    ShowError("Cannot start any worker , the tests run serially");
+    sigaction(SIGPIPE,&old_pipe,NULL);
+    ProfileEnd(PROFILE_RUN,start);
+    rcode = RunTestPlan(tp);
+    goto done;
+  }
+
+  // 3. collect the results until every worker is gone
+  while(live) {
+    nfds_t n = 0;
+    int idle = 0;
+
+    for( i = 0 ; i < size ; ++i ) {
+      Worker* w = pool + i;
+      if(w->pid) {
+        // an idle worker waits for a job slot
+        if(!w->busy && w->cmd >= 0) {
+          DispatchWork(w,&q);
+          if(!w->busy && w->cmd >= 0) idle = 1;
+        }
+        pfd[n].fd     = w->res;
+        pfd[n].events = POLLIN;
+        slot[n++]     = i;
+      }
+    }
+
+    if(idle) {
+      pfd[n].fd     = kJobServer->rfd;
+      pfd[n].events = POLLIN;
+      pfd[n].revents = 0;
+    }
+
+    if(poll(pfd,n + idle,ExpireWorkers(tp,pool,size)) < 0) {
+      if(errno == EINTR) continue;
+      ShowError("poll failed with %s",strerror(errno));
+      rcode = -1;
+      break;
+    }
+
+    for( j = 0 ; j < n ; ++j ) {
+      Worker*   w = pool + slot[j];
+      WorkFrame f;
+      char*   buf = NULL;
+
+      if(!pfd[j].revents) continue;
+
+      if(ReadFull(w->res,&f,sizeof(f)) ||
+         (f.len && (buf = malloc(f.len)) && ReadFull(w->res,buf,f.len))) {
+        free(buf);
+        if(ReapWorker(tp,w,&q)) rcode = -1;
+        --live;
+
+        // replace the worker while there is work left
+        if(MoreWork(&q)) {
+          if(SpawnWorker(tp,pool,size,slot[j]) == 0) {
+            DispatchWork(w,&q);
+            ++live;
+          } else if(!live) {
+            ShowError("Cannot start a worker , %zu items are not run",q.size - q.head);
+            rcode = -1;
+          }
+        }
+        continue;
+      }
+
+      if(OnWorkFrame(tp,w,&q,&f,buf)) rcode = -1;
+      free(buf);
+    }
+  }
+
+  // workers are only left when the loop stops on an error
+  for( i = 0 ; i < size ; ++i ) {
+    if(pool[i].pid) {
+      kill(pool[i].pid,SIGKILL);
+      pool[i].busy = 0;
+      ReapWorker(tp,pool + i,&q);
+    }
+  }
+
+  sigaction(SIGPIPE,&old_pipe,NULL);
+  ProfileEnd(PROFILE_RUN,start);
+
+done:
+  free(q.item);
+  free(pool);
+  free(pfd);
+  free(slot);
+  return rcode;
+}
+
+/* --------------------------------------------
+ * Repeat Mode                                |
+ * -------------------------------------------*/
+
+static int IsRepeatRun( const CmdOption* opt ) {
+  return opt->repeat > 1 || opt->until_fail;
+}
+
+// Run the plan round after round in worker processes , so a flaky test is
+// hunted without rediscovering the tests for every round and a crash only
+// costs a worker. Only the failing runs are shown , followed by the failure
+// rate of every test that failed at least once
+static int RunTestPlanRepeated( const TestPlan* tp , const CmdOption* opt ) {
+  StressRun run;
+  size_t   i , j , n = 0 , tests = 0 , failing = 0;
+  uint64_t runs = 0;
+  int     rcode;
+
+  memset(&run,0,sizeof(run));
+  run.repeat     = opt->repeat;
+  run.until_fail = opt->until_fail;
+  run.rounds     = 1;
+  run.base       = calloc(tp->size ? tp->size : 1,sizeof(size_t));
+  for( i = 0 ; i < tp->size ; ++i ) {
+    run.base[i] = n;
+    n += tp->module[i].arr.size;
+  }
+  run.stat = calloc(n ? n : 1,sizeof(StressStat));
+
+  kStress = &run;
+  rcode   = RunTestPlanParallel(tp,opt->stress_jobs);
+  kStress = NULL;
+
+  for( i = 0 ; i < tp->size ; ++i ) {
+    const ModuleEntry* me = tp->module + i;
+    for( j = 0 ; j < me->arr.size ; ++j ) {
+      const StressStat* st = run.stat + run.base[i] + j;
+      if(!st->runs) continue;
+      ++tests;
+      runs += st->runs;
+      if(!st->fails) continue;
+      ++failing;
+      ColorFPrintf(stderr,NULL,"Red",NULL,"[ REPEAT  ] ");
+      fprintf     (stderr,"%s.%s failed %llu of %llu runs ( %.2f%% ) , first in iteration %u\n",
+                   me->module,me->arr.arr[j].name,(unsigned long long)(st->fails),
+                   (unsigned long long)(st->runs),
+                   100.0 * (double)(st->fails) / (double)(st->runs),st->first);
+    }
+  }
+
+  ColorFPrintf(stderr,NULL,"Blue",NULL,"[ REPEAT  ] ");
+  fprintf     (stderr,"%llu runs of %zu tests , %zu of them failed\n",
+               (unsigned long long)(runs),tests,failing);
+
+  free(run.stat);
+  free(run.base);
+  return rcode || failing ? -1 : 0;
+}
+
+/* --------------------------------------------
+ * Threaded Runner                            |
+ * -------------------------------------------*/
+
+// Shared state of the runner threads , the items are the same as the ones
+// of the parallel runner and are taken in order with an atomic counter
+typedef struct _ThreadPool {
+  const TestPlan*  tp;
+  WorkQueue        q;
+  size_t           next;
+  pthread_mutex_t  lock;    // serializes the output
+  int              rcode;
+  int              broken;  // whether the setup of the environment failed
+} ThreadPool;
+
+static void ShowThreadTest( ThreadPool* pool , const char* module , const char* name ,
+                                                                    int        rcode ,
+                                                                    uint64_t elapsed ,
+                                                                    const char*  buf ,
+                                                                    size_t       len ) {
+  pthread_mutex_lock(&pool->lock);
+  ProfileCount(PROFILE_TEST,1);
+  ShowTestBegin(module,name);
+  if(len) fwrite(buf,1,len,stderr);
+  ShowTestEnd(module,name,rcode,elapsed);
+  if(rcode) pool->rcode = -1;
+  pthread_mutex_unlock(&pool->lock);
+}
+
+static void ShowThreadFixture( ThreadPool* pool , const char* tag , const char* module ) {
+  pthread_mutex_lock(&pool->lock);
+  ColorFPrintf(stderr,NULL,"Blue",NULL,"[ %s] ",tag);
+  fprintf     (stderr,"%s\n",module);
+  pthread_mutex_unlock(&pool->lock);
+}
+
+static void ShowThreadAsyncTest( const ModuleEntry* me , uint32_t index , int rcode ,
+                                                                          uint64_t elapsed ,
+                                                                          const char* buf ,
+                                                                          size_t len ,
+                                                                          void* data ) {
+  ShowThreadTest(data,me->module,me->arr.arr[index].name,rcode,elapsed,buf,len);
+}
+
+static void* RunThreadWorker( void* d ) {
+  ThreadPool* pool = d;
+  void*      stack = NULL;
+  stack_t    old;
+
+  if(kCrash.installed) stack = InstallCrashStack(&old);
+
+  for( ;; ) {
+    size_t         i = __atomic_fetch_add(&pool->next,1,__ATOMIC_RELAXED);
+    WorkItem*   item;
+    ModuleEntry*  me;
+    void*        ctx = NULL;
+    uint32_t       j;
+    int        token;
+    int       broken;
+
+    if(i >= pool->q.size) break;
+    item = pool->q.item + i;
+    me   = pool->tp->module + item->module;
+
+    // wake up now and then in case the implicit slot is given back
+    while((token = TakeJobToken(50)) == JOB_TOKEN_NONE)
+      ;
+
+    broken = pool->broken;
+    if(!broken && me->tt == TT_FIXTURE && me->setup) {
+      ShowThreadFixture(pool,"SETUP   ",me->module);
+      if(RunFixtureHook(me->module,HOOK_SETUP,(void*)(me->setup),&ctx)) {
+        pthread_mutex_lock(&pool->lock);
+        ShowError("Setup of %s failed , its tests fail without running",me->module);
+        pthread_mutex_unlock(&pool->lock);
+        broken = 1;
+      }
+    }
+
+    // a failed setup fails every test of the item without running them
+    if(broken) {
+      for( j = item->begin ; j < item->end ; ++j ) {
+        TestEntry* t = me->arr.arr + j;
+        char    label[1024];
+        if(!t->address) continue;
+        ShowThreadTest(pool,me->module,me->tt == TT_PARAM ?
+                       ParamLabel(t,item->row_begin,item->row_end,label,sizeof(label)) :
+                       t->name,-1,0,NULL,0);
+      }
+      GiveJobToken(token);
+      continue;
+    }
+
+    // every thread has its own loop
+    if(me->tt == TT_ASYNC) {
+      RunAsyncTests(me,item->begin,item->end,ShowThreadAsyncTest,pool);
+      GiveJobToken(token);
+      continue;
+    }
+
+    for( j = item->begin ; j < item->end ; ++j ) {
+      TestEntry* t = me->arr.arr + j;
+      uint64_t elapsed = 0;
+      char*    buf = NULL;
+      size_t   len = 0;
+      FILE*    out;
+      int      rcode;
+      const char* name;
+      char     label[1024];
+
+      if(!t->address) continue;
+
+      // the output of the test is printed in one piece with its result
+      out   = open_memstream(&buf,&len);
+      if(me->tt == TT_PARAM) {
+        rcode = RunParamRows(me,t,item->row_begin,item->row_end,TestTimeout(t),out,&elapsed);
+        name  = ParamLabel(t,item->row_begin,item->row_end,label,sizeof(label));
+      } else {
+        rcode = RunTestBody(t->address,me->module,t->name,me->tt,ctx,TestTimeout(t),out,
+                                                                              &elapsed);
+        name  = t->name;
+      }
+      if(out) fclose(out);
+      ShowThreadTest(pool,me->module,name,rcode,elapsed,buf,len);
+      free(buf);
+    }
+
+    if(me->tt == TT_FIXTURE && me->setup && me->tear_down) {
+      ShowThreadFixture(pool,"TEARDOWN",me->module);
+      if(RunFixtureHook(me->module,HOOK_TEARDOWN,(void*)(me->tear_down),&ctx)) {
+        pthread_mutex_lock(&pool->lock);
+        ShowError("Teardown of %s failed",me->module);
+        pool->rcode = -1;
+        pthread_mutex_unlock(&pool->lock);
+      }
+    }
+    GiveJobToken(token);
+  }
+
+  if(stack) UninstallCrashStack(stack,&old);
+  DeleteTestTimer();
+  return NULL;
+}
+
+// Run the plan on threads threads inside of this process. It is meant for
+// cheap tests that are safe to run concurrently , a test that crashes is
+// still caught but one that calls exit or corrupts the memory takes the run
+// down with it
+static int RunTestPlanThreaded( const TestPlan* tp , int threads ) {
+  ThreadPool pool;
+  pthread_t* tid;
+  size_t     size , i , n = 0;
+  uint64_t   start = ProfileBegin();
+
+  pool.tp     = tp;
+  pool.next   = 0;
+  pool.rcode  = 0;
+  pool.broken = 0;
+  pthread_mutex_init(&pool.lock,NULL);
+  BuildWorkQueue(tp,&pool.q,threads > 0 ? (size_t)(threads) : 1);
+
+  size = (size_t)(threads) < pool.q.size ? (size_t)(threads) : pool.q.size;
+  tid  = calloc(size ? size : 1,sizeof(pthread_t));
+
+  if(pool.q.size && SetupEnvironment(tp->env,tp->env_size)) pool.broken = 1;
+
+  kThreaded   = 1;
+  kTestOrphan = 0;
+  for( i = 0 ; i < size ; ++i ) {
+    if(pthread_create(tid + n,NULL,RunThreadWorker,&pool) == 0) ++n;
+  }
+
+  // nothing could be started , the calling thread does the work
+  if(size && !n) {
+    ShowError("Cannot start any thread , the tests run on the calling thread");
+    RunThreadWorker(&pool);
+  }
+
+  for( i = 0 ; i < n ; ++i ) {
+    pthread_join(tid[i],NULL);
+  }
+  kThreaded = 0;
+  if(TearDownEnvironment(tp->env,tp->env_size)) pool.rcode = -1;
+
+  if(kTestOrphan) pool.rcode = -1;
+  ProfileEnd(PROFILE_RUN,start);
+
+  pthread_mutex_destroy(&pool.lock);
+  free(pool.q.item);
+  free(tid);
+  return pool.rcode;
+}
+
+// Run the plan serially , in worker processes or on threads according to the
+// options
+static int DispatchTestPlan( const TestPlan* tp , const CmdOption* opt ) {
+  JobServer js;
+  int    rcode;
+
+  kForkFixture = opt->fork_fixture;
+  if(!IsRepeatRun(opt) && opt->jobs <= 1 && opt->threads <= 1) return RunTestPlan(tp);
+
+  // share the job slots of the make running this binary , if any
+  if(opt->jobserver && JobServerOpen(&js) == 0) kJobServer = &js;
+
+  if(IsRepeatRun(opt)) {
+    rcode = RunTestPlanRepeated(tp,opt);
+  } else if(opt->jobs > 1) {
+    rcode = RunTestPlanParallel(tp,opt->jobs);
+  } else {
+    rcode = RunTestPlanThreaded(tp,opt->threads);
+  }
+
+  if(kJobServer) {
+    JobServerClose(kJobServer);
+    kJobServer = NULL;
+  }
+  return rcode;
+}
+
+/* --------------------------------------------
+ * Sharding                                   |
+ * -------------------------------------------*/
+
+// How the tests are split between the shards
+enum {
+  SHARD_HASH,       // by a stable hash of the name , needs no history
+  SHARD_DURATION    // balanced by the recorded durations
+};
+
+// A unit of sharding , a simple test or a whole fixture module so a fixture
+// module is always run by exactly one shard
+typedef struct _ShardUnit {
+  WorkItem    item;
+  const char* name;     // MODULE.NAME of a test or MODULE of a fixture module
+  double      cost;
+  size_t      shard;
+} ShardUnit;
+
+// FNV-1a , stable across builds and machines unlike the hash of the symbol
+// table which is free to change
+static uint64_t ShardHash( const char* str ) {
+  uint64_t h = 14695981039346656037ULL;
+  for( ; *str ; ++str ) {
+    h ^= (uint8_t)(*str);
+    h *= 1099511628211ULL;
+  }
+  return h;
+}
+
+static int CompareShardUnit( const void* l , const void* r ) {
+  const ShardUnit* lhs = l;
+  const ShardUnit* rhs = r;
+  if(lhs->cost != rhs->cost) return lhs->cost > rhs->cost ? -1 : 1;
+  return strcmp(lhs->name,rhs->name);
+}
+
+// Keep only the tests of this shard inside of the plan. Every shard computes
+// the same split from the same plan , the duration mode additionally needs
+// the same duration history on every machine
+static void ShardTestPlan( TestPlan* tp , const CmdOption* opt ) {
+  ShardUnit* unit = NULL;
+  double*    load;
+  size_t     size = 0 , cap = 0 , i , j , k , n = 0 , kept = 0;
+  double     average = kTiming ? TimingDBAverage(kTiming) : 0.0;
+
+  // without any history every test counts the same
+  if(average <= 0.0) average = 1.0;
+
+  // 1. collect the units , fixture modules as a whole
+  for( i = 0 ; i < tp->size ; ++i ) {
+    ModuleEntry* me = tp->module + i;
+    for( j = 0 ; j < me->arr.size ; ++j ) {
+      ShardUnit* u;
+      if(me->tt == TT_FIXTURE && j) break;
+      if(size == cap) {
+        cap  = cap ? cap * 2 : 64;
+        unit = realloc(unit,sizeof(ShardUnit) * cap);
+      }
+      u = unit + size++;
+      u->item.module = (uint32_t)(i);
+      u->item.begin  = (uint32_t)(j);
+      u->item.end    = (uint32_t)(me->tt == TT_FIXTURE ? me->arr.size : j + 1);
+      if(me->tt == TT_FIXTURE) {
+        u->name = me->module;
+      } else {
+        size_t len = strlen(me->module) + strlen(me->arr.arr[j].name) + 2;
+        char*  buf = ArenaAlloc(&(tp->arena),len);
+        snprintf(buf,len,"%s.%s",me->module,me->arr.arr[j].name);
+        u->name = buf;
+      }
+      u->cost = EstimateWorkItem(tp,&(u->item),average);
+    }
+  }
+
+  // 2. assign every unit a shard
+  if(opt->shard_mode == SHARD_DURATION) {
+    // greedy longest first , each unit goes to the least loaded shard
+    load = calloc(opt->total_shards,sizeof(double));
+    qsort(unit,size,sizeof(ShardUnit),CompareShardUnit);
+    for( i = 0 ; i < size ; ++i ) {
+      size_t best = 0;
+      for( k = 1 ; k < (size_t)(opt->total_shards) ; ++k ) {
+        if(load[k] < load[best]) best = k;
+      }
+      unit[i].shard = best;
+      load[best]   += unit[i].cost;
+    }
+    free(load);
+  } else {
+    for( i = 0 ; i < size ; ++i ) {
+      unit[i].shard = (size_t)(ShardHash(unit[i].name) % (uint64_t)(opt->total_shards));
+    }
+  }
+
+  // 3. drop every test of the other shards , a module left without tests is
+  //    dropped as well so its setup never runs
+  for( i = 0 ; i < size ; ++i ) {
+    if(unit[i].shard != (size_t)(opt->shard_index)) {
+      ModuleEntry* me = tp->module + unit[i].item.module;
+      for( j = unit[i].item.begin ; j < unit[i].item.end ; ++j ) {
+        me->arr.arr[j].address = NULL;
+      }
+    }
+  }
+
+  for( i = 0 ; i < tp->size ; ++i ) {
+    ModuleEntry* me = tp->module + i;
+    size_t        m = 0;
+    for( j = 0 ; j < me->arr.size ; ++j ) {
+      if(me->arr.arr[j].address) me->arr.arr[m++] = me->arr.arr[j];
+    }
+    me->arr.size = m;
+    kept        += m;
+    if(m) tp->module[n++] = *me;
+  }
+  tp->size = n;
+  free(unit);
+
+  ColorFPrintf(stderr,NULL,"Blue",NULL,"[ SHARD   ] ");
+  fprintf     (stderr,"%d of %d , %zu tests\n",opt->shard_index,opt->total_shards,kept);
+}
+
+static int CompareRecord( const void* l , const void* r ) {
+  const JournalRecord* a = *(const JournalRecord* const*)(l);
+  const JournalRecord* b = *(const JournalRecord* const*)(r);
+  int c = strcmp(a->name,b->name);
+  return c ? c : (a < b ? -1 : a > b);
+}
+
+// Latest record of a test in the sorted index , NULL if it has none
+static const JournalRecord* FindRecord( const JournalRecord** index , size_t size ,
+                                                                      const char* name ) {
+  size_t l = 0 , r = size;
+  while(l < r) {
+    size_t m = l + (r - l) / 2;
+    if(strcmp(index[m]->name,name) <= 0) l = m + 1;
+    else                                 r = m;
+  }
+  return l && strcmp(index[l-1]->name,name) == 0 ? index[l-1] : NULL;
+}
+
+// Whether the slices of a TEST_P in the journal , named NAME[first-last] ,
+// cover all of its rows. A slice counts by its latest record once it ended ,
+// failed is set if one of the counted slices failed
+static int CoverParamRows( const JournalRecord** index , size_t size , const char* name ,
+                                                                       uint32_t   rows ,
+                                                                       int*     failed ) {
+  char     prefix[JOURNAL_NAME_SIZE];
+  uint8_t* seen;
+  size_t   len , l = 0 , r = size , k;
+  uint32_t i , left = rows;
+
+  len = (size_t)(snprintf(prefix,sizeof(prefix),"%s[",name));
+  if(len >= sizeof(prefix) || !rows) return 0;
+
+  // the slices sort next to each other , starting at the first name that is
+  // not below the prefix
+  while(l < r) {
+    size_t m = l + (r - l) / 2;
+    if(strcmp(index[m]->name,prefix) < 0) l = m + 1;
+    else                                  r = m;
+  }
+
+  seen    = calloc(rows,1);
+  *failed = 0;
+  for( k = l ; k < size && strncmp(index[k]->name,prefix,len) == 0 ; ++k ) {
+    const JournalRecord* rec = index[k];
+    unsigned first , last;
+    char     end;
+
+    if(k + 1 < size && strcmp(index[k+1]->name,rec->name) == 0) continue;
+    if(rec->state == JOURNAL_RUNNING) continue;
+    if(sscanf(rec->name + len,"%u-%u%c",&first,&last,&end) != 3 || end != ']' ||
+       first > last || last >= rows)
+      continue;
+
+    if(rec->state == JOURNAL_FAILED) *failed = 1;
+    for( i = first ; i <= last ; ++i ) {
+      if(!seen[i]) {
+        seen[i] = 1;
+        --left;
+      }
+    }
+  }
+  free(seen);
+  return left == 0;
+}
+
+// Drop the tests the journal has a result of. A test that was running when
+// the previous run died is dropped as well and counted as failed , it would
+// most likely take this run down again. Returns -1 if a dropped test failed
+static int ResumeTestPlan( TestPlan* tp ) {
+  size_t                size = kJournal->size - 1 , i , j , n = 0;
+  size_t                done = 0 , failed = 0;
+  const JournalRecord** index = malloc(sizeof(*index) * (size ? size : 1));
+  char                  name[JOURNAL_NAME_SIZE];
+
+  // a torn record was zeroed by the load
+  for( i = 0 , j = 0 ; i < size ; ++i ) {
+    if(kJournal->rec[i+1].check) index[j++] = kJournal->rec + i + 1;
+  }
+  size = j;
+  qsort(index,size,sizeof(*index),CompareRecord);
+
+  for( i = 0 ; i < tp->size ; ++i ) {
+    ModuleEntry* me = tp->module + i;
+    size_t        m = 0;
+
+    for( j = 0 ; j < me->arr.size ; ++j ) {
+      const TestEntry*     t = me->arr.arr + j;
+      const JournalRecord* r;
+      int                  fail;
+
+      JournalName(name,me->module,t->name);
+      if(!(r = FindRecord(index,size,name))) {
+        // a TEST_P run in slices is done once they cover all of its rows ,
+        // otherwise it runs again as a whole
+        if(me->tt == TT_PARAM && CoverParamRows(index,size,name,t->row_size,&fail)) {
+          ++done;
+          if(fail) {
+            ColorFPrintf(stderr,NULL,"Red",NULL,"[    FAIL ] ");
+            fprintf     (stderr,"%s ( previous run )\n",name);
+            ++failed;
+          }
+          continue;
+        }
+        me->arr.arr[m++] = me->arr.arr[j];
+        continue;
+      }
+      ++done;
+      if(r->state == JOURNAL_RUNNING) {
+        ShowError("Test %s was running when the previous run died",name);
+        ++failed;
+      } else if(r->state == JOURNAL_FAILED) {
+        ColorFPrintf(stderr,NULL,"Red",NULL,"[    FAIL ] ");
+        fprintf     (stderr,"%s ( previous run )\n",name);
+        ++failed;
+      }
+    }
+
+    me->arr.size = m;
+    if(m) tp->module[n++] = *me;
+  }
+  tp->size = n;
+  free(index);
+
+  ColorFPrintf(stderr,NULL,"Blue",NULL,"[ RESUME  ] ");
+  fprintf     (stderr,"%zu tests are done , %zu of them failed\n",done,failed);
+  return failed ? -1 : 0;
+}
+
+static int RunModuleTest( const CmdOption* opt ) {
+  TestPlan tp;
+  int rcode = 0;
+
+  // a test list only gets here when it runs in parallel , sharded or
+  // resumed , the full plan is built and filtered since the module of every
+  // test is needed
+  if(BuildTestPlan(&tp,opt->test_list ? NULL : opt->module_list,opt)) {
+    return -1;
+  }
+
+  if(opt->test_list && FilterTestPlan(&tp,opt->test_list)) rcode = -1;
+  if(opt->total_shards > 1) ShardTestPlan(&tp,opt);
+  if(opt->resume && ResumeTestPlan(&tp)) rcode = -1;
+  if(DispatchTestPlan(&tp,opt)) rcode = -1;
+  DeleteTestPlan(&tp);
+  return rcode;
+}
+
+// Symbols looked up for a test requested by the --test-filter option , the
+// module level ones are named S , D and E
+enum {
+  QUERY_TEST,
+  QUERY_TIMEOUT,
+  QUERY_FIXTURE,
+  QUERY_SETUP,
+  QUERY_TEARDOWN,
+  QUERY_PER_TEST,
+  QUERY_ASYNC,
+  QUERY_PARAM,
+  QUERY_VALUES,
+  QUERY_SIZE
+};
+
+static const struct {
+  int         type;
+  const char* name;     // NULL for the name of the test itself
+} kQueryKind[QUERY_SIZE] = {
+  { ST_SIMPLE_TEST      , NULL } ,
+  { ST_TEST_TIMEOUT     , NULL } ,
+  { ST_FIXTURE_TEST     , NULL } ,
+  { ST_FIXTURE_SETUP    , "S"  } ,
+  { ST_FIXTURE_TEARDOWN , "D"  } ,
+  { ST_FIXTURE_PER_TEST , "E"  } ,
+  { ST_ASYNC_TEST       , NULL } ,
+  { ST_PARAM_TEST       , NULL } ,
+  { ST_PARAM_VALUES     , NULL }
+};
+
+// A test requested by the --test-filter option
+typedef struct _TestQuery {
+  char   mod[1024];
+  char   sym[1024];
+  char   buf[QUERY_SIZE][1024];
+  int    valid;
+
+  // the first query of a module holds the state of its fixture
+  size_t owner;
+  size_t last;          // last query of the module , its teardown follows it
+  void*  ctx;
+  int    ready;
+  int    broken;        // whether the setup of the fixture failed
+} TestQuery;
+
+static int ExplodeQuery( TestQuery* q , const char* name ) {
+  char tmp[2048];
+  char mod[1024];
+  char sym[1024];
+  int  k;
+
+  if(ExplodeSymbolName(name,ST_SIMPLE_TEST,q->mod,q->sym,q->buf[QUERY_TEST],1024)) return -1;
+
+  for( k = 1 ; k < QUERY_SIZE ; ++k ) {
+    snprintf(tmp,sizeof(tmp),"%s.%s",q->mod,kQueryKind[k].name ? kQueryKind[k].name : q->sym);
+    if(ExplodeSymbolName(tmp,kQueryKind[k].type,mod,sym,q->buf[k],1024)) return -1;
+  }
+  return 0;
+}
+
+static int RunTestList( const CmdOption* opt ) {
+  const char** test_list = opt->test_list;
+  size_t       size = 0 , n , i , k;
+  TestQuery*   query;
+  const char** name;
+  void**       address;
+  char         env_name[2][1024];
+  char         mod[1024] , sym[1024];
+  EnvEntry     env;
+  uint64_t     start;
+  int rcode = 0;
+
+  for( ; test_list[size] ; ++size )
+    ;
+
+  // every kind of symbol of every query , followed by the environment
+  n       = size * QUERY_SIZE + 2;
+  query   = calloc(size ? size : 1,sizeof(TestQuery));
+  name    = calloc(n,sizeof(const char*));
+  address = calloc(n,sizeof(void*));
 
-          if(me->setup && me->tear_down) {
-            ColorFPrintf(stderr,NULL,"Blue",NULL,"[ TEARDOWN]\n");
-            me->tear_down(ctx);
-          }
-        }
-        break;
-      default:
+#define QUERY_ADDRESS(K,I) (address[(size_t)(K) * size + (I)])
+
+  // 1. resolve all the requested names at once , the full symbol table is not
+  //    needed for a handful of names so they are looked up lazily
+  for( i = 0 ; i < size ; ++i ) {
+    TestQuery* q = query + i;
+    q->valid = !ExplodeQuery(q,test_list[i]);
+    // a name that is not valid is not looked up at all
+    for( k = 0 ; k < QUERY_SIZE ; ++k ) name[k * size + i] = q->valid ? q->buf[k] : NULL;
+
+    // tests of the same module share the fixture of its first query
+    q->owner = i;
+    for( k = 0 ; k < i && q->valid ; ++k ) {
+      if(query[k].valid && strcmp(query[k].mod,q->mod) == 0) {
+        q->owner = query[k].owner;
         break;
+      }
     }
-    ShowSeparator();
   }
-  return rcode;
-}
 
-static int RunModuleTest( const char** module_list , int opt ) {
-  TestPlan tp;
-  struct ProcInfo* pinfo;
-  int rcode;
+  ExplodeSymbolName(CUNIT_ENV_MODULE ".G",ST_ENV_SETUP   ,mod,sym,env_name[0],1024);
+  ExplodeSymbolName(CUNIT_ENV_MODULE ".H",ST_ENV_TEARDOWN,mod,sym,env_name[1],1024);
+  name[n - 2] = env_name[0];
+  name[n - 1] = env_name[1];
 
-  if((rcode = CreateProcInfo(getpid(),&pinfo,opt))) {
-    ShowError("Cannot create ProcInfo object because of error code %d\n",rcode);
-    return -1;
+  if(opt->opt != PINFO_SRCH_MAIN_ONLY || !HasTestRegistry()) {
+    int ret;
+    if((ret = LookupSymbols(opt->opt,name,address,n))) {
+      ShowError("Cannot lookup symbols because of error code %d\n",ret);
+      rcode = -1;
+      goto done;
+    }
+  } else {
+    for( i = 0 ; i < size ; ++i ) {
+      TestQuery* q = query + i;
+      if(!q->valid) continue;
+      for( k = 0 ; k < QUERY_SIZE ; ++k ) {
+        QUERY_ADDRESS(k,i) = FindRegistryTest(q->mod,kQueryKind[k].name ? kQueryKind[k].name :
+                                                                          q->sym,
+                                              GetSymbolMeta(kQueryKind[k].type));
+      }
+    }
+    address[n - 2] = FindRegistryTest(CUNIT_ENV_MODULE,"G",CUNIT_ENV_SETUP);
+    address[n - 1] = FindRegistryTest(CUNIT_ENV_MODULE,"H",CUNIT_ENV_TEARDOWN);
   }
 
-  PrepareTestPlan(pinfo,&tp,module_list);
-  RunTestPlan(&tp);
+  for( i = 0 ; i < size ; ++i ) {
+    if(query[i].valid && QUERY_ADDRESS(QUERY_FIXTURE,i)) query[query[i].owner].last = i;
+  }
 
-  DeleteTestPlan(&tp);
-  DeleteProcInfo(pinfo);
-  return rcode;
-}
+  memset(&env,0,sizeof(env));
+  env.module    = CUNIT_ENV_MODULE;
+  env.setup     = (EnvironmentHook)(address[n - 2]);
+  env.tear_down = (EnvironmentHook)(address[n - 1]);
 
-static int RunTestList( const char** test_list , int opt ) {
-  char buf[1024];
-  char mod[1024];
-  char sym[1024];
+  // 2. run them in the requested order , a fixture is set up by the first
+  //    test of its module and torn down right after the last one
+  start = ProfileBegin();
+  for( i = 0 ; i < size ; ++i ) {
+    TestQuery* q = query + i;
+    TestEntry  t;
+    int        fixture , async , param;
 
-  struct ProcInfo* pinfo;
-  int rcode = CreateProcInfo(getpid(),&pinfo,opt);
-  if(rcode) {
-    ShowError("Cannot create ProcInfo object because of error code %d\n",rcode);
-    return -1;
-  }
+    if(!q->valid) {
+      ShowError("Test %s is not a valid name\n",test_list[i]);
+      rcode = -1;
+      continue;
+    }
 
-  for( ; *test_list ; ++test_list ) {
-    void* address;
-    if(ExplodeSymbolName(*test_list,ST_SIMPLE_TEST,mod,sym,buf,1024)) {
-      ShowError("Test %s is not a valid name\n",*test_list);
+    fixture = !QUERY_ADDRESS(QUERY_TEST,i) && QUERY_ADDRESS(QUERY_FIXTURE,i);
+    async   = !QUERY_ADDRESS(QUERY_TEST,i) && !fixture && QUERY_ADDRESS(QUERY_ASYNC,i);
+    param   = !QUERY_ADDRESS(QUERY_TEST,i) && !fixture && !async &&
+               QUERY_ADDRESS(QUERY_PARAM,i);
+    if(!fixture && !async && !param && !QUERY_ADDRESS(QUERY_TEST,i)) {
+      ShowError("Test %s is not found\n",test_list[i]);
       rcode = -1;
+      continue;
+    }
+
+    t.name    = q->sym;
+    t.address = QUERY_ADDRESS(fixture ? QUERY_FIXTURE :
+                              async   ? QUERY_ASYNC   :
+                              param   ? QUERY_PARAM   : QUERY_TEST,i);
+    t.rows     = NULL;
+    t.row_size = 0;
+    t.stride   = 0;
+    if(param && QUERY_ADDRESS(QUERY_VALUES,i)) {
+      LoadParamTable(&t,(ParamTable)(QUERY_ADDRESS(QUERY_VALUES,i)));
+    }
+    t.timeout = 0;
+    if(QUERY_ADDRESS(QUERY_TIMEOUT,i)) {
+      int ms = ((int (*)())(QUERY_ADDRESS(QUERY_TIMEOUT,i)))();
+      if(ms > 0) t.timeout = (uint32_t)(ms);
+    }
+
+    if(SetupEnvironment(&env,1)) {
+      rcode = SkipBrokenTest(q->mod,q->sym);
+    } else if(async) {
+      ModuleEntry me;
+
+      memset(&me,0,sizeof(me));
+      me.module   = q->mod;
+      me.tt       = TT_ASYNC;
+      me.arr.arr  = &t;
+      me.arr.size = 1;
+      if(RunAsyncTests(&me,0,1,ShowAsyncTest,NULL)) rcode = -1;
+    } else if(param) {
+      ModuleEntry me;
+
+      memset(&me,0,sizeof(me));
+      me.module = q->mod;
+      me.tt     = TT_PARAM;
+      if(RunParamTest(&me,&t)) rcode = -1;
+    } else if(!fixture) {
+      if(RunTest(t.address,q->mod,q->sym,TT_SIMPLE,NULL,TestTimeout(&t))) rcode = -1;
     } else {
-      address = FindStrongSymbol(pinfo,buf);
-      if(!address) {
-        ShowError("Test %s is not found\n",*test_list);
+      TestQuery*  o = query + q->owner;
+      ModuleEntry me;
+
+      memset(&me,0,sizeof(me));
+      me.module    = q->mod;
+      me.tt        = TT_FIXTURE;
+      me.setup     = (FixtureSetup   )(QUERY_ADDRESS(QUERY_SETUP   ,q->owner));
+      me.tear_down = (FixtureTearDown)(QUERY_ADDRESS(QUERY_TEARDOWN,q->owner));
+      me.per_test  = QUERY_ADDRESS(QUERY_PER_TEST,q->owner) != NULL;
+
+      if(!o->ready) {
+        o->broken = SetupFixture(&me,&(o->ctx));
+        o->ready  = 1;
+      }
+
+      if(o->broken) {
+        rcode = SkipBrokenTest(q->mod,q->sym);
+      } else if(kForkFixture ? RunForkedTest(&me,&t,o->ctx) :
+                               RunTest(t.address,q->mod,q->sym,TT_FIXTURE,o->ctx,
+                                       TestTimeout(&t))) {
         rcode = -1;
-      } else {
-        RunTest(address,stderr,mod,sym,TT_SIMPLE,NULL);
+      }
+
+      if(me.per_test || o->last == i) {
+        if(!o->broken && TearDownFixture(&me,o->ctx)) rcode = -1;
+        o->ready = 0;
       }
     }
   }
+  if(TearDownEnvironment(&env,1)) rcode = -1;
+  ProfileEnd(PROFILE_RUN,start);
 
-  DeleteProcInfo(pinfo);
+#undef QUERY_ADDRESS
+
+done:
+  free(query);
+  free(name);
+  free(address);
   return rcode;
 }
 
-static int ListAllTest( int opt ) {
+static void ListTestPlan( const TestPlan* tp ) {
   size_t i;
-  TestPlan tp;
-  struct ProcInfo* pinfo;
-  int rcode = CreateProcInfo(getpid(),&pinfo,opt);
-  if(rcode) {
-    ShowError("Cannot create ProcInfo object because of error code %d\n",rcode);
-    return -1;
-  }
-
-  PrepareTestPlan(pinfo,&tp,NULL);
-
-  for( i = 0 ; i < tp.size ; ++i ) {
-    ModuleEntry* me = tp.module + i;
+  for( i = 0 ; i < tp->size ; ++i ) {
+    ModuleEntry* me = tp->module + i;
     ColorFPrintf(stderr,NULL,"Green",NULL,"[ SUITE(%s)] ",GetTTName(me->tt));
     fprintf     (stderr,"%s\n",me->module);
 
@@ -544,6 +3573,8 @@ static int ListAllTest( int opt ) {
         }
         // fallthrough
       case TT_SIMPLE:
+      case TT_ASYNC:
+      case TT_PARAM:
         {
           for( size_t j = 0 ; j < me->arr.size ; ++j ) {
             TestEntry* t = me->arr.arr + j;
@@ -557,21 +3588,108 @@ static int ListAllTest( int opt ) {
     }
     ShowSeparator();
   }
+}
 
-  DeleteProcInfo(pinfo);
+static int ListAllTest( const CmdOption* opt ) {
+  TestPlan tp;
+
+  if(BuildTestPlan(&tp,NULL,opt)) {
+    return -1;
+  }
+
+  ListTestPlan(&tp);
+  DeleteTestPlan(&tp);
   return 0;
 }
 
 /* --------------------------------------------
- * Command Line Parser                        |
+ * Test Host                                  |
  * -------------------------------------------*/
-typedef struct _CmdOption {
-  int opt ;
-  int list;
-  const char** module_list;
-  const char** test_list;
-} CmdOption;
 
+// Get the stem of a library from its path , ie /a/libfoo.so.1 => libfoo
+static const char* LibraryStem( Arena* arena , const char* path ) {
+  const char* base = strrchr(path,'/');
+  const char* end;
+  base = base ? base + 1 : path;
+  end  = strchr(base,'.');
+  return ArenaSubStr(arena,base,end ? end : base + strlen(base));
+}
+
+// Get the scope of the library i , its stem unless an earlier library of the
+// same stem is another file. The loader opens a file once , so the handle
+// tells the files apart by their dev/inode. Returns NULL for a file given
+// again , its tests are already in the plan , another file of the same stem
+// is numbered , ie /b/libfoo.so => libfoo~2
+static const char* LibraryScope( Arena* arena , void** handle , const char** stem ,
+                                                const char** scope , size_t i ) {
+  size_t j , n = 1;
+  char buf[1024];
+
+  // a file given again has no scope , so every scope is another file
+  for( j = 0 ; j < i ; ++j ) {
+    if(!scope[j]) continue;
+    if(handle[j] == handle[i]) return NULL;
+    if(strcmp(stem[j],stem[i]) == 0) ++n;
+  }
+  if(n == 1) return stem[i];
+  snprintf(buf,sizeof(buf),"%s~%zu",stem[i],n);
+  return ArenaStrDup(arena,buf);
+}
+
+// Load every library and add the tests found in it into the plan , only the
+// newly loaded object is scanned for each library. A library that cannot be
+// loaded is reported and skipped
+static int BuildHostTestPlan( TestPlan* tp , const CmdOption* opt , void** handle ) {
+  TestPlanGenerator gen;
+  const char** stem;
+  const char** scope;
+  uint64_t start;
+  size_t i;
+  int rcode = 0;
+
+  InitTestPlanGenerator(&gen,tp,opt->module_list);
+
+  for( i = 0 ; opt->library[i] ; ++i )
+    ;
+  stem  = ArenaCalloc(&(tp->arena),i ? i : 1,sizeof(const char*));
+  scope = ArenaCalloc(&(tp->arena),i ? i : 1,sizeof(const char*));
+
+  for( i = 0 ; opt->library[i] ; ++i ) {
+    struct ProcInfo* pinfo;
+    int ret;
+
+    if(!(handle[i] = dlopen(opt->library[i],RTLD_NOW | RTLD_LOCAL))) {
+      ShowError("Cannot load %s : %s",opt->library[i],dlerror());
+      rcode = -1;
+      continue;
+    }
+
+    stem [i] = LibraryStem (&(tp->arena),opt->library[i]);
+    if(!(scope[i] = LibraryScope(&(tp->arena),handle,stem,scope,i))) continue;
+
+    if((ret = CreateLibraryProcInfo(handle[i],&pinfo))) {
+      ShowError("Cannot create ProcInfo object of %s because of error code %d",
+                opt->library[i],ret);
+      rcode = -1;
+      continue;
+    }
+
+    start     = ProfileBegin();
+    gen.scope = scope[i];
+    ForeachSymbol(pinfo,SymbolBegin,OnSymbol,SymbolEnd,&gen);
+    ProfileEnd(PROFILE_PLAN,start);
+    DeleteProcInfo(pinfo);
+  }
+
+  start = ProfileBegin();
+  FinishTestPlanGenerator(&gen);
+  ProfileEnd(PROFILE_PLAN,start);
+  return rcode;
+}
+
+/* --------------------------------------------
+ * Command Line Parser                        |
+ * -------------------------------------------*/
 static void FreeStrList( const char** slist ) {
   void* m = (void*)slist;
   for( ; *slist ; ++slist ) {
@@ -583,6 +3701,7 @@ static void FreeStrList( const char** slist ) {
 static void DeleteCmdOption( CmdOption* opt ) {
   if(opt->module_list) FreeStrList(opt->module_list);
   if(opt->test_list  ) FreeStrList(opt->test_list  );
+  if(opt->library    ) FreeStrList(opt->library    );
 }
 
 static void ShowHelp( const char* fmt , ... ) {
@@ -599,7 +3718,100 @@ static void ShowHelp( const char* fmt , ... ) {
     "  --option:   \n"
     "    Specify the searching option for test cases, the value can be *Main*\n"
     "    or *All*.*Main* means only search this executable program and *All* \n"
-    "    means search all the shared object and the executable program\n";
+    "    means search all the shared object and the executable program. Only\n"
+    "    shared objects built with the cunitpp header are searched\n"
+    "\n"
+    "  --cache-dir:\n"
+    "    Specify a directory to cache the discovered tests keyed by the build-id\n"
+    "    of the program , so later runs skip the ELF parsing. It can also be\n"
+    "    specified by the environment variable CUNITPP_CACHE_DIR\n"
+    "\n"
+    "  -j, --jobs:\n"
+    "    Specify the number of worker processes running the tests , 0 means\n"
+    "    the number of CPUs. Tests are handed out to the workers one by one ,\n"
+    "    a fixture module as a whole , and a crashing worker is replaced\n"
+    "\n"
+    "  --threads:\n"
+    "    Specify the number of threads running the tests inside of this\n"
+    "    process , 0 means the number of CPUs. Only suitable for tests that\n"
+    "    are safe to run concurrently , cannot be used together with --jobs\n"
+    "\n"
+    "  --repeat:\n"
+    "    Run every test the given number of times to hunt flaky tests. The\n"
+    "    tests are discovered once and the rounds run in --stress-jobs worker\n"
+    "    processes , only the failing runs are shown and the failure rate and\n"
+    "    the first failing iteration of each failing test are reported\n"
+    "\n"
+    "  --until-fail:\n"
+    "    Repeat the tests until one of them fails , at most --repeat times if\n"
+    "    it is given as well\n"
+    "\n"
+    "  --stress-jobs:\n"
+    "    Specify the number of worker processes of --repeat and --until-fail ,\n"
+    "    0 means the number of CPUs. It is 1 by default\n"
+    "\n"
+    "  --no-jobserver:\n"
+    "    Do not share the job slots of a parent make. By default --jobs and\n"
+    "    --threads only run as many tests at once as make has free slots\n"
+    "    when the binary runs under make -j , so every test binary of the\n"
+    "    build shares one budget of CPUs\n"
+    "\n"
+    "  --timing-db:\n"
+    "    Specify a file to keep the duration history of the tests in , the\n"
+    "    parallel modes run the slowest tests first according to it. It can\n"
+    "    also be specified by the environment variable CUNITPP_TIMING_DB\n"
+    "\n"
+    "  --journal:\n"
+    "    Specify a file to record the progress of the run in. The status and\n"
+    "    the duration of every test are written to a mapping of the file as\n"
+    "    soon as it ends , so they survive the runner getting killed\n"
+    "\n"
+    "  --resume:\n"
+    "    Continue the run recorded in the given journal. The plan is built\n"
+    "    again and the tests the journal has a result of are skipped , the\n"
+    "    ones that failed before still fail the run. A test that was running\n"
+    "    when the run died counts as failed. The journal is kept up to date\n"
+    "\n"
+    "  --shard-index , --total-shards:\n"
+    "    Only run the tests of one shard out of the total number of shards ,\n"
+    "    ie to split a test binary between machines. A fixture module always\n"
+    "    belongs to a single shard. They can also be specified by the\n"
+    "    environment variables CUNITPP_SHARD_INDEX and CUNITPP_TOTAL_SHARDS\n"
+    "\n"
+    "  --shard-mode:\n"
+    "    How the tests are split between the shards , *hash* ( default ) uses\n"
+    "    a stable hash of the test name and *duration* balances the shards by\n"
+    "    the timing database , which then must be the same on every machine.\n"
+    "    It can also be specified by the environment variable\n"
+    "    CUNITPP_SHARD_MODE\n"
+    "\n"
+    "  --timeout:\n"
+    "    Specify the default timeout of a test in milliseconds , 0 ( default )\n"
+    "    means none. A test that runs out of it prints a backtrace and fails ,\n"
+    "    a worker process or a forked fixture child is killed instead. The\n"
+    "    TEST_TIMEOUT macro overrides it per test. It can also be specified by\n"
+    "    the environment variable CUNITPP_TIMEOUT\n"
+    "\n"
+    "  --fork-fixture:\n"
+    "    Run the setup of a fixture module once and every test of it in a\n"
+    "    child forked from that state , so each test gets a pristine copy on\n"
+    "    write copy of the fixture. The teardown runs in every child on its\n"
+    "    copy and once more in the runner on the original\n"
+    "\n"
+    "  --no-crash-handler:\n"
+    "    Do not catch crashing tests. By default a test that receives SIGSEGV,\n"
+    "    SIGBUS, SIGFPE, SIGILL or SIGABRT prints a backtrace and fails , and\n"
+    "    the run continues with the next test\n"
+    "\n"
+    "  --profile:\n"
+    "    Specify a file to write the time spent in each phase of the framework\n"
+    "    as JSON. It can also be specified by the environment variable\n"
+    "    CUNITPP_PROFILE\n"
+    "\n"
+    "  FILE...:\n"
+    "    Shared objects to load and run tests from , only accepted by the\n"
+    "    cunitpp-host runner. Modules are prefixed with the library name ,\n"
+    "    ie Suite1 of ./libfoo.so becomes libfoo/Suite1\n";
 
   char buf[1024];
   va_list vl;
@@ -629,7 +3841,7 @@ static const char** ParseCommaList( const char* str ) {
     } while(1);
   }
 
-  ret = malloc(sizeof(const char*)*sz + 1);
+  ret = malloc(sizeof(const char*)*(sz + 1));
   sz  = 0;
   {
     do {
@@ -649,12 +3861,98 @@ static const char** ParseCommaList( const char* str ) {
   return ret;
 }
 
-static int ParseCommandLine( int argc , char** argv , CmdOption* opt ) {
+// Parse one of the sharding options , the name is the command line flag
+static int ParseShardOption( CmdOption* opt , const char* name , const char* value ) {
+  char* end;
+  long    v;
+
+  if(strcmp(name,"--shard-mode") == 0) {
+    if(strcmp(value,"hash") == 0) {
+      opt->shard_mode = SHARD_HASH;
+    } else if(strcmp(value,"duration") == 0) {
+      opt->shard_mode = SHARD_DURATION;
+    } else {
+      ShowHelp("unknown shard mode %s",value);
+      return -1;
+    }
+    return 0;
+  }
+
+  v = strtol(value,&end,10);
+  if(!*value || *end || v < 0 || v > INT32_MAX) {
+    ShowHelp("invalid value %s of %s",value,name);
+    return -1;
+  }
+
+  if(strcmp(name,"--shard-index") == 0) {
+    opt->shard_index = (int)(v);
+  } else if(v == 0) {
+    ShowHelp("%s must be at least 1",name);
+    return -1;
+  } else {
+    opt->total_shards = (int)(v);
+  }
+  return 0;
+}
+
+static int ParseTimeout( CmdOption* opt , const char* v ) {
+  char*         end;
+  unsigned long  ms = strtoul(v,&end,10);
+  if(!*v || *end || ms > UINT32_MAX) {
+    ShowHelp("invalid timeout %s",v);
+    return -1;
+  }
+  opt->timeout = (uint32_t)(ms);
+  return 0;
+}
+
+// The sharding options can also come from the environment , so a CI system
+// can split every test binary the same way , the command line wins
+static int ParseShardEnv( CmdOption* opt ) {
+  static const char* kShardEnv[][2] = {
+    { "CUNITPP_SHARD_INDEX"  , "--shard-index"  },
+    { "CUNITPP_TOTAL_SHARDS" , "--total-shards" },
+    { "CUNITPP_SHARD_MODE"   , "--shard-mode"   }
+  };
+  size_t i;
+
+  for( i = 0 ; i < ARRAY_SIZE(kShardEnv) ; ++i ) {
+    const char* v = getenv(kShardEnv[i][0]);
+    if(v && ParseShardOption(opt,kShardEnv[i][1],v)) return -1;
+  }
+  return 0;
+}
+
+static int ParseCommandLine( int argc , char** argv , CmdOption* opt , int host ) {
   int i = 1;
-  opt->opt         = PINFO_SRCH_MAIN_ONLY;
+  size_t nlib = 0;
+
+  // the fail path frees the lists , nothing may be left uninitialized by a
+  // step that fails before they are set
+  memset(opt,0,sizeof(*opt));
   opt->list        = -1;
-  opt->module_list = NULL;
-  opt->test_list   = NULL;
+  opt->opt         = PINFO_SRCH_MAIN_ONLY;
+  opt->crash       = 1;
+  opt->jobs        = 1;
+  opt->threads     = 1;
+  opt->fork_fixture = 0;
+  opt->timing_db   = getenv("CUNITPP_TIMING_DB");
+  opt->shard_index = 0;
+  opt->total_shards = 1;
+  opt->shard_mode  = SHARD_HASH;
+  opt->timeout     = 0;
+  opt->jobserver   = 1;
+  opt->repeat      = 0;
+  opt->until_fail  = 0;
+  opt->stress_jobs = 1;
+  opt->journal     = NULL;
+  opt->resume      = 0;
+
+  if(ParseShardEnv(opt)) goto fail;
+  if(getenv("CUNITPP_TIMEOUT") && ParseTimeout(opt,getenv("CUNITPP_TIMEOUT"))) goto fail;
+  opt->cache_dir   = getenv("CUNITPP_CACHE_DIR");
+
+  if(getenv("CUNITPP_PROFILE")) ProfileEnable(getenv("CUNITPP_PROFILE"));
 
   for( ; i < argc ; ++i ) {
     if(strcmp(argv[i],"--help") == 0) {
@@ -686,6 +3984,107 @@ static int ParseCommandLine( int argc , char** argv , CmdOption* opt ) {
         goto fail;
       }
       opt->test_list = ParseCommaList(argv[++i]);
+    } else if(strcmp(argv[i],"--cache-dir") == 0) {
+      if(i+1 == argc) {
+        ShowHelp("expect a argument after --cache-dir");
+        goto fail;
+      }
+      opt->cache_dir = argv[++i];
+    } else if(strcmp(argv[i],"-j") == 0 || strcmp(argv[i],"--jobs") == 0) {
+      char* end;
+      if(i+1 == argc) {
+        ShowHelp("expect a argument after %s",argv[i]);
+        goto fail;
+      }
+      opt->jobs = (int)(strtol(argv[++i],&end,10));
+      if(*end || opt->jobs < 0) {
+        ShowHelp("invalid number of jobs %s",argv[i]);
+        goto fail;
+      }
+      if(opt->jobs == 0) opt->jobs = (int)(sysconf(_SC_NPROCESSORS_ONLN));
+    } else if(strcmp(argv[i],"--threads") == 0) {
+      char* end;
+      if(i+1 == argc) {
+        ShowHelp("expect a argument after --threads");
+        goto fail;
+      }
+      opt->threads = (int)(strtol(argv[++i],&end,10));
+      if(*end || opt->threads < 0) {
+        ShowHelp("invalid number of threads %s",argv[i]);
+        goto fail;
+      }
+      if(opt->threads == 0) opt->threads = (int)(sysconf(_SC_NPROCESSORS_ONLN));
+    } else if(strcmp(argv[i],"--timing-db") == 0) {
+      if(i+1 == argc) {
+        ShowHelp("expect a argument after --timing-db");
+        goto fail;
+      }
+      opt->timing_db = argv[++i];
+    } else if(strcmp(argv[i],"--shard-index") == 0 ||
+              strcmp(argv[i],"--total-shards") == 0 ||
+              strcmp(argv[i],"--shard-mode") == 0) {
+      if(i+1 == argc) {
+        ShowHelp("expect a argument after %s",argv[i]);
+        goto fail;
+      }
+      if(ParseShardOption(opt,argv[i],argv[i+1])) goto fail;
+      ++i;
+    } else if(strcmp(argv[i],"--timeout") == 0) {
+      if(i+1 == argc) {
+        ShowHelp("expect a argument after --timeout");
+        goto fail;
+      }
+      if(ParseTimeout(opt,argv[++i])) goto fail;
+    } else if(strcmp(argv[i],"--repeat") == 0) {
+      char*         end;
+      unsigned long   n;
+      if(i+1 == argc) {
+        ShowHelp("expect a argument after --repeat");
+        goto fail;
+      }
+      n = strtoul(argv[++i],&end,10);
+      if(*end || n == 0 || n > UINT32_MAX) {
+        ShowHelp("invalid number of repeats %s",argv[i]);
+        goto fail;
+      }
+      opt->repeat = (uint32_t)(n);
+    } else if(strcmp(argv[i],"--until-fail") == 0) {
+      opt->until_fail = 1;
+    } else if(strcmp(argv[i],"--stress-jobs") == 0) {
+      char* end;
+      if(i+1 == argc) {
+        ShowHelp("expect a argument after --stress-jobs");
+        goto fail;
+      }
+      opt->stress_jobs = (int)(strtol(argv[++i],&end,10));
+      if(*end || opt->stress_jobs < 0) {
+        ShowHelp("invalid number of stress jobs %s",argv[i]);
+        goto fail;
+      }
+      if(opt->stress_jobs == 0) opt->stress_jobs = (int)(sysconf(_SC_NPROCESSORS_ONLN));
+    } else if(strcmp(argv[i],"--journal") == 0 || strcmp(argv[i],"--resume") == 0) {
+      if(opt->journal) {
+        ShowHelp("only one of --journal and --resume can be given");
+        goto fail;
+      }
+      if(i+1 == argc) {
+        ShowHelp("expect a argument after %s",argv[i]);
+        goto fail;
+      }
+      opt->resume  = strcmp(argv[i],"--resume") == 0;
+      opt->journal = argv[++i];
+    } else if(strcmp(argv[i],"--no-jobserver") == 0) {
+      opt->jobserver = 0;
+    } else if(strcmp(argv[i],"--fork-fixture") == 0) {
+      opt->fork_fixture = 1;
+    } else if(strcmp(argv[i],"--no-crash-handler") == 0) {
+      opt->crash = 0;
+    } else if(strcmp(argv[i],"--profile") == 0) {
+      if(i+1 == argc) {
+        ShowHelp("expect a argument after --profile");
+        goto fail;
+      }
+      ProfileEnable(argv[++i]);
     } else if(strcmp(argv[i],"--option") == 0) {
       if(i+1 == argc) {
         ShowHelp("expect a argument after --option");
@@ -696,12 +4095,42 @@ static int ParseCommandLine( int argc , char** argv , CmdOption* opt ) {
       } else {
         opt->opt = PINFO_SRCH_MAIN_ONLY;
       }
+    } else if(host && argv[i][0] != '-') {
+      opt->library = realloc(opt->library,sizeof(const char*) * (nlib + 2));
+      opt->library[nlib++] = strdup(argv[i]);
+      opt->library[nlib  ] = NULL;
     } else {
       ShowHelp("unknown option %s",argv[i]);
       goto fail;
     }
   }
 
+  if(opt->jobs > 1 && opt->threads > 1) {
+    ShowHelp("--jobs and --threads cannot be used together");
+    goto fail;
+  }
+
+  if(opt->shard_index >= opt->total_shards) {
+    ShowHelp("shard index %d is out of %d shards",opt->shard_index,opt->total_shards);
+    goto fail;
+  }
+
+  if(IsRepeatRun(opt) && (opt->jobs > 1 || opt->threads > 1)) {
+    ShowHelp("--repeat and --until-fail run in --stress-jobs workers , not --jobs or --threads");
+    goto fail;
+  }
+
+  if(IsRepeatRun(opt) && opt->journal) {
+    ShowHelp("--journal and --resume cannot be used with --repeat or --until-fail");
+    goto fail;
+  }
+
+  // forking a process with several threads is not safe
+  if(opt->fork_fixture && opt->threads > 1) {
+    ShowHelp("--fork-fixture and --threads cannot be used together");
+    goto fail;
+  }
+
   if(opt->list == -1) opt->list = 0;
   return 0;
 fail:
@@ -709,15 +4138,58 @@ fail:
   return -1;
 }
 
+// Stream the assertions of the calling thread print into
+static FILE* TestOutput() {
+  TestContext* t = kTest ? kTest : kTestOwner;
+  return t && t->output ? t->output : stderr;
+}
+
+// Leave the test after a failed assertion. The runner thread jumps back
+// into the runner , any other thread marks its test failed and exits since
+// there is nothing to jump to
+static void FailTest() {
+  TestContext* t = kTest;
+
+  if(t && kTestRunner) longjmp(t->env,1);
+  if(!t) t = kTestOwner;
+
+  // ending the main thread would leave the process exiting with 0 once the
+  // other threads are gone , the failure must not pass unnoticed
+  if(gettid() == getpid()) {
+    fprintf(stderr,"Assertion failed outside of a test , the run is aborted\n");
+    fflush(stdout);
+    fflush(stderr);
+    _exit(1);
+  }
+
+  if(t) {
+    t->failed = 1;
+  } else {
+    fprintf(stderr,"Assertion failed on a thread that belongs to no test\n");
+    kTestOrphan = 1;
+  }
+  pthread_exit(NULL);
+}
+
+void* CUnitCurrentTest() {
+  return kTest;
+}
+
+void CUnitAttachTest( void* test ) {
+  kTest       = test;
+  kTestRunner = 0;
+}
+
 void _CUnitAssert( const char* file , int line , const char* format , ... ) {
-  char buf[1024];
+  FILE* output = TestOutput();
   va_list vl;
-  size_t nret;
   va_start(vl,format);
-  nret = snprintf(buf,1024,"Assertion failed around %d:%s => ",line,file);
-  fwrite  (buf,nret,1,stderr);
-  vfprintf(stderr,format,vl);
-  longjmp (kTestEnv,1);
+  flockfile(output);
+  fprintf  (output,"Assertion failed around %d:%s => ",line,file);
+  vfprintf (output,format,vl);
+  funlockfile(output);
+  va_end(vl);
+  FailTest();
 }
 
 static const char* _StringEscape( const char* str ) {
@@ -759,30 +4231,146 @@ void _CUnitAssertStrBin( const char* file , int line , const char* lhs ,
                                                        const char*  op ) {
   const char* elhs = _StringEscape(lhs);
   const char* erhs = _StringEscape(rhs);
-  fprintf(stderr,"Assertion failed around %d:%s => "
+  fprintf(TestOutput(),"Assertion failed around %d:%s => "
                  "String comaprison `\"%s\" %s \"%s\"` failed\n",line,file,elhs,op,erhs);
   free((void*)elhs);
   free((void*)erhs);
 
-  longjmp(kTestEnv,1);
+  FailTest();
+}
+
+// Load the duration history. The file is given by --timing-db , otherwise it
+// lives in the cache directory and is named after the program
+static void OpenTimingDB( const CmdOption* opt , const char* prog , char* path ,
+                                                                   size_t  len ) {
+  const char* base = strrchr(prog,'/');
+
+  path[0] = 0;
+  if(opt->timing_db) {
+    snprintf(path,len,"%s",opt->timing_db);
+  } else if(opt->cache_dir) {
+    snprintf(path,len,"%s/%s.timing",opt->cache_dir,base ? base + 1 : prog);
+  }
+
+  if(path[0]) LoadTimingDB(path,&kTiming);
+}
+
+static void CloseTimingDB( const char* path ) {
+  if(!kTiming) return;
+  if(SaveTimingDB(kTiming,path)) ShowError("Cannot write the timing database %s",path);
+  DeleteTimingDB(kTiming);
+  kTiming = NULL;
+}
+
+// Open the journal of --journal or --resume , a run whose progress cannot be
+// recorded is not started
+static int OpenJournal( const CmdOption* opt ) {
+  static Journal journal;
+
+  if(!opt->journal) return 0;
+  if(JournalOpen(&journal,opt->journal,opt->resume)) {
+    ShowError("Cannot open the journal %s , %s",opt->journal,strerror(errno));
+    return -1;
+  }
+  kJournal = &journal;
+  return 0;
+}
+
+static void CloseJournal() {
+  if(!kJournal) return;
+  JournalClose(kJournal);
+  kJournal = NULL;
 }
 
 int RunAllTests( int argc , char* argv[] ) {
   CmdOption opt;
   int rcode;
 
-  if(ParseCommandLine(argc,argv,&opt)) {
+  if(ParseCommandLine(argc,argv,&opt,0)) {
+    return -1;
+  }
+
+  if(opt.list) {
+    rcode = ListAllTest(&opt);
+  } else if(OpenJournal(&opt)) {
+    rcode = -1;
+  } else {
+    char timing[4096];
+    OpenTimingDB(&opt,argv[0],timing,sizeof(timing));
+    if(opt.crash) InstallCrashHandler(opt.opt);
+    kTimeout = opt.timeout;
+    InstallTimeoutHandler();
+    // resuming needs the plan to know what is left
+    if(opt.test_list && opt.jobs <= 1 && opt.threads <= 1 && opt.total_shards <= 1 &&
+       !IsRepeatRun(&opt) && !opt.resume) {
+      rcode = RunTestList(&opt);
+    } else {
+      rcode = RunModuleTest(&opt);
+    }
+    UninstallTimeoutHandler();
+    DeleteTestTimer();
+    UninstallCrashHandler();
+    CloseTimingDB(timing);
+    CloseJournal();
+  }
+
+  ProfileDump();
+  DeleteCmdOption(&opt);
+  return rcode;
+}
+
+int RunHostTests( int argc , char* argv[] ) {
+  CmdOption opt;
+  TestPlan  tp;
+  void**    handle;
+  size_t    size = 0 , i;
+  int       rcode;
+
+  if(ParseCommandLine(argc,argv,&opt,1)) {
     return -1;
   }
 
+  if(!opt.library) {
+    ShowHelp("expect at least one shared object to load");
+    DeleteCmdOption(&opt);
+    return -1;
+  }
+
+  for( ; opt.library[size] ; ++size )
+    ;
+  handle = calloc(size,sizeof(void*));
+
+  rcode = BuildHostTestPlan(&tp,&opt,handle);
+
   if(opt.list) {
-    rcode = ListAllTest(opt.opt);
-  } else if(opt.test_list) {
-    rcode = RunTestList(opt.test_list,opt.opt);
+    ListTestPlan(&tp);
+  } else if(OpenJournal(&opt)) {
+    rcode = -1;
   } else {
-    rcode = RunModuleTest(opt.module_list,opt.opt);
+    char timing[4096];
+    if(opt.test_list && FilterTestPlan(&tp,opt.test_list)) rcode = -1;
+    OpenTimingDB(&opt,argv[0],timing,sizeof(timing));
+    if(opt.total_shards > 1) ShardTestPlan(&tp,&opt);
+    if(opt.resume && ResumeTestPlan(&tp)) rcode = -1;
+    if(opt.crash) InstallCrashHandler(PINFO_SRCH_ALL);
+    kTimeout = opt.timeout;
+    InstallTimeoutHandler();
+    if(DispatchTestPlan(&tp,&opt)) rcode = -1;
+    UninstallTimeoutHandler();
+    DeleteTestTimer();
+    UninstallCrashHandler();
+    CloseTimingDB(timing);
+    CloseJournal();
   }
 
+  DeleteTestPlan(&tp);
+  ProfileDump();
+
+  // the plan points into the libraries , so they are closed at last
+  for( i = 0 ; i < size ; ++i ) {
+    if(handle[i]) dlclose(handle[i]);
+  }
+  free(handle);
   DeleteCmdOption(&opt);
   return rcode;
 }
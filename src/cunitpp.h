@@ -23,19 +23,192 @@
 #define CUNIT_FIXTURE_SETUP    'S'
 #define CUNIT_FIXTURE_TEARDOWN 'D'
 
+// The cunitpp's test timeout meta information
+#define CUNIT_TEST_TIMEOUT     'O'
+
+// The cunitpp's fixture scope meta information , a fixture module marked with
+// it sets up and tears down around each of its tests
+#define CUNIT_FIXTURE_PER_TEST 'E'
+
+// The cunitpp's global environment meta information
+#define CUNIT_ENV_SETUP        'G'
+#define CUNIT_ENV_TEARDOWN     'H'
+
+// The cunitpp's asynchronous test meta information
+#define CUNIT_ASYNC_TEST       'A'
+
+// The cunitpp's parameterized test meta information , the test and its rows
+#define CUNIT_PARAM_TEST       'P'
+#define CUNIT_PARAM_VALUES     'V'
+
+// The module name the global environment is registered under
+#define CUNIT_ENV_MODULE       "CUnitEnvironment"
+
 // The cunitpp's module separator name
 #define CUNIT_MODULE_SEPARATOR "____"
 
 // The cunitpp's symbol definition macro
 #define CUNIT_TEST_DEFINE_SCHEMA(TT,MODULE,NAME) __CUnitPP_##TT##MODULE##____##NAME
 
+/**
+ * Besides the symbol name, each TEST macro also emits a compact descriptor
+ * into a dedicated ELF section. The runner walks the section through the
+ * linker generated __start_/__stop_ symbols , so discovering tests costs
+ * O(tests) instead of loading the whole symbol table of the binary. The
+ * symbol name schema is kept as a fallback for binaries that are built with
+ * older headers or with CONFIG_CUNIT_NO_REGISTRY defined.
+ */
+
+// The cunitpp's test registry section name, must be a valid C identifier
+// otherwise the linker will not generate the __start_/__stop_ symbols
+#define CUNIT_REGISTRY_SECTION "cunitpp_tests"
+
+typedef struct _CUnitTestDesc {
+  const char* module;   // module name of the test
+  const char* name;     // test name , fixture setup/teardown use S/D
+  const char* file;     // file that defines the test
+  void*       func;     // address of the test function
+  int         line;     // line that defines the test
+  int         type;     // meta character of the test , ie CUNIT_SIMPLE_TEST
+} CUnitTestDesc;
+
+#ifndef CONFIG_CUNIT_NO_REGISTRY
+#define CUNIT_TEST_REGISTER(TT,MT,MODULE,NAME)                                \
+  static const CUnitTestDesc __CUnitPPDesc_##TT##MODULE##____##NAME           \
+  __attribute__((used,section(CUNIT_REGISTRY_SECTION),aligned(sizeof(void*))))\
+  = { #MODULE , #NAME , __FILE__ ,                                            \
+      (void*)(CUNIT_TEST_DEFINE_SCHEMA(TT,MODULE,NAME)) , __LINE__ , MT };
+#else
+#define CUNIT_TEST_REGISTER(TT,MT,MODULE,NAME)
+#endif // CONFIG_CUNIT_NO_REGISTRY
+
 // The cunitpp's exported test case macro, mimic google test's TEST macro
-#define TEST(MODULE,NAME)       void CUNIT_TEST_DEFINE_SCHEMA(T,MODULE,NAME)(void)
+#define TEST(MODULE,NAME)                                              \
+  void CUNIT_TEST_DEFINE_SCHEMA(T,MODULE,NAME)(void);                  \
+  CUNIT_TEST_REGISTER(T,CUNIT_SIMPLE_TEST,MODULE,NAME)                 \
+  void CUNIT_TEST_DEFINE_SCHEMA(T,MODULE,NAME)(void)
 
 // The cunitpp's fixture test meta function macro
-#define TEST_F(MODULE,NAME,PAR)     void  CUNIT_TEST_DEFINE_SCHEMA(F,MODULE,NAME)(PAR)
-#define TEST_F_SETUP(MODULE)        void* CUNIT_TEST_DEFINE_SCHEMA(S,MODULE,S)(void )
-#define TEST_F_TEARDOWN(MODULE,PAR) void  CUNIT_TEST_DEFINE_SCHEMA(D,MODULE,D)(PAR)
+#define TEST_F(MODULE,NAME,PAR)                                        \
+  void  CUNIT_TEST_DEFINE_SCHEMA(F,MODULE,NAME)(PAR);                  \
+  CUNIT_TEST_REGISTER(F,CUNIT_FIXTURE_TEST,MODULE,NAME)                \
+  void  CUNIT_TEST_DEFINE_SCHEMA(F,MODULE,NAME)(PAR)
+
+#define TEST_F_SETUP(MODULE)                                           \
+  void* CUNIT_TEST_DEFINE_SCHEMA(S,MODULE,S)(void);                    \
+  CUNIT_TEST_REGISTER(S,CUNIT_FIXTURE_SETUP,MODULE,S)                  \
+  void* CUNIT_TEST_DEFINE_SCHEMA(S,MODULE,S)(void)
+
+#define TEST_F_TEARDOWN(MODULE,PAR)                                    \
+  void  CUNIT_TEST_DEFINE_SCHEMA(D,MODULE,D)(PAR);                     \
+  CUNIT_TEST_REGISTER(D,CUNIT_FIXTURE_TEARDOWN,MODULE,D)               \
+  void  CUNIT_TEST_DEFINE_SCHEMA(D,MODULE,D)(PAR)
+
+// Run the setup and the teardown of a fixture module around each of its
+// tests instead of once for the whole module , ie
+//
+//   TEST_F_PER_TEST(Suite);
+#define TEST_F_PER_TEST(MODULE)                                        \
+  void  CUNIT_TEST_DEFINE_SCHEMA(E,MODULE,E)(void);                    \
+  CUNIT_TEST_REGISTER(E,CUNIT_FIXTURE_PER_TEST,MODULE,E)               \
+  void  CUNIT_TEST_DEFINE_SCHEMA(E,MODULE,E)(void) {}                  \
+  void  CUNIT_TEST_DEFINE_SCHEMA(E,MODULE,E)(void)
+
+// The global environment of a test binary , set up right before the first
+// test that runs and torn down after the last one. Nothing is done if no
+// test is selected. Each worker process of --jobs has its own environment
+#define TEST_ENV_SETUP()                                               \
+  void  CUNIT_TEST_DEFINE_SCHEMA(G,CUnitEnvironment,G)(void);          \
+  CUNIT_TEST_REGISTER(G,CUNIT_ENV_SETUP,CUnitEnvironment,G)            \
+  void  CUNIT_TEST_DEFINE_SCHEMA(G,CUnitEnvironment,G)(void)
+
+#define TEST_ENV_TEARDOWN()                                            \
+  void  CUNIT_TEST_DEFINE_SCHEMA(H,CUnitEnvironment,H)(void);          \
+  CUNIT_TEST_REGISTER(H,CUNIT_ENV_TEARDOWN,CUnitEnvironment,H)         \
+  void  CUNIT_TEST_DEFINE_SCHEMA(H,CUnitEnvironment,H)(void)
+
+/**
+ * An asynchronous test does not block , its body registers continuations on
+ * an epoll loop owned by the runner and returns. The runner multiplexes all
+ * the asynchronous tests of a module on one thread , each with its own
+ * deadline , and the test ends once it calls CUnitAsyncDone , fails , or has
+ * no continuation left. A failed assertion inside a continuation only fails
+ * the test owning it , ie
+ *
+ *   static void OnRead( CUnitAsync* a , int fd , unsigned ev , void* data ) {
+ *     ASSERT_TRUE(ev & CUNIT_ASYNC_READ);
+ *     CUnitAsyncDone(a);
+ *   }
+ *
+ *   TEST_ASYNC(Suite,Echo) {
+ *     CUnitAsyncWatch(async,fd,CUNIT_ASYNC_READ,OnRead,NULL);
+ *   }
+ */
+typedef struct _CUnitAsync CUnitAsync;
+
+#define CUNIT_ASYNC_READ  0x1
+#define CUNIT_ASYNC_WRITE 0x4
+#define CUNIT_ASYNC_ERROR 0x8
+
+// A continuation , fd is -1 and events is 0 when a timer fires
+typedef void (*CUnitAsyncCallback)( CUnitAsync* , int fd , unsigned events ,
+                                                           void* data );
+
+#define TEST_ASYNC(MODULE,NAME)                                        \
+  void  CUNIT_TEST_DEFINE_SCHEMA(A,MODULE,NAME)(CUnitAsync* async);    \
+  CUNIT_TEST_REGISTER(A,CUNIT_ASYNC_TEST,MODULE,NAME)                  \
+  void  CUNIT_TEST_DEFINE_SCHEMA(A,MODULE,NAME)(CUnitAsync* async)
+
+// Call cb once , when fd is ready for the events. A fd can only have one
+// continuation at a time , the callback may watch it again. Returns -1 and
+// fails the test if the fd can not be watched
+int  CUnitAsyncWatch( CUnitAsync* , int fd , unsigned events , CUnitAsyncCallback cb ,
+                                                                void* data );
+
+// Call cb once , after ms milliseconds
+int  CUnitAsyncTimer( CUnitAsync* , unsigned ms , CUnitAsyncCallback cb ,
+                                                  void* data );
+
+// End the test , the continuations it has left are dropped
+void CUnitAsyncDone ( CUnitAsync* );
+
+// A test run once for each row of a static table. The rows run back to back
+// in one batch without a banner each , every failing row is reported with its
+// index and does not stop the rows after it. The body gets a pointer to its
+// row named row , ie
+//
+//   static const struct { int in , out; } kDouble[] = { { 1 , 2 } , { 2 , 4 } };
+//
+//   TEST_P(Suite,Double,kDouble) {
+//     ASSERT_EQ(row->in * 2,row->out);
+//   }
+//
+// The table is exported through a V function so it is found the same way as
+// the test itself. The timeout of the test is the budget of all of its rows
+#define TEST_P(MODULE,NAME,TABLE)                                                  \
+  void  CUNIT_TEST_DEFINE_SCHEMA(P,MODULE,NAME)(const __typeof__((TABLE)[0])* row);\
+  const void* CUNIT_TEST_DEFINE_SCHEMA(V,MODULE,NAME)(size_t* , size_t* );         \
+  CUNIT_TEST_REGISTER(P,CUNIT_PARAM_TEST,MODULE,NAME)                              \
+  CUNIT_TEST_REGISTER(V,CUNIT_PARAM_VALUES,MODULE,NAME)                            \
+  const void* CUNIT_TEST_DEFINE_SCHEMA(V,MODULE,NAME)(size_t* size ,               \
+                                                      size_t* stride ) {           \
+    *size   = sizeof(TABLE) / sizeof((TABLE)[0]);                                  \
+    *stride = sizeof((TABLE)[0]);                                                  \
+    return (TABLE);                                                                \
+  }                                                                                \
+  void  CUNIT_TEST_DEFINE_SCHEMA(P,MODULE,NAME)(const __typeof__((TABLE)[0])* row)
+
+// Override the time budget of a test in milliseconds , the --timeout option
+// of the runner is used for every other test. It is a function returning the
+// budget so it is found the same way as the test itself , ie
+//
+//   TEST_TIMEOUT(Suite,Slow,5000);
+//   TEST(Suite,Slow) { ... }
+#define TEST_TIMEOUT(MODULE,NAME,MS)                                   \
+  int   CUNIT_TEST_DEFINE_SCHEMA(O,MODULE,NAME)(void);                 \
+  CUNIT_TEST_REGISTER(O,CUNIT_TEST_TIMEOUT,MODULE,NAME)                \
+  int   CUNIT_TEST_DEFINE_SCHEMA(O,MODULE,NAME)(void) { return (MS); } \
+  int   CUNIT_TEST_DEFINE_SCHEMA(O,MODULE,NAME)(void)
 
 // The assertion function to spew out error information into the output stream
 // This function will not abort the program
@@ -78,7 +251,24 @@ void _CUnitAssertStrBin( const char* , int line , const char* lhs ,
   ((!(COND)) ? (void)(0) : _CUnitAssert(__FILE__,__LINE__, \
     "Expression `%s` expected to be False\n",#COND))
 
+// Handle of the test running on the calling thread , NULL if there is none
+void* CUnitCurrentTest();
+
+// Attach a helper thread started by a test to the test , the handle comes
+// from CUnitCurrentTest on the thread of the test. A failed assertion on a
+// helper thread marks its test failed and ends the helper with pthread_exit
+// since only the thread of the test can leave it. The helper must be joined
+// before the test returns
+void CUnitAttachTest( void* test );
+
 // Run all the tests that is registered based on symbol name
 int RunAllTests( int , char** argv );
 
+// Load the shared objects given on the command line into the process and run
+// the tests found in them. Only the loaded objects are scanned and their
+// modules are prefixed with the library name , ie libfoo/Suite1. The program
+// calling it must export the cunitpp functions ( link with -rdynamic ) so the
+// libraries resolve the assertion functions against it
+int RunHostTests( int , char** argv );
+
 #endif // CUNITPP_H_
@@ -0,0 +1,182 @@
+#include "elf-image.h"
+
+#include <string.h>
+
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#include <fcntl.h>
+
+// Check the range [off,off+len) is inside of the mapping
+static int InRange( const ElfImage* img , uint64_t off , uint64_t len ) {
+  return off <= img->size && len <= img->size - off;
+}
+
+static int ValidateHeader( ElfImage* img ) {
+  const Elf64_Ehdr* ehdr = (const Elf64_Ehdr*)(img->base);
+  size_t shstrndx;
+
+  if(img->size < sizeof(Elf64_Ehdr)             ||
+     memcmp(ehdr->e_ident,ELFMAG,SELFMAG) != 0  ||
+     ehdr->e_ident[EI_CLASS] != ELFCLASS64      ||
+#if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+     ehdr->e_ident[EI_DATA ] != ELFDATA2LSB
+#else
+     ehdr->e_ident[EI_DATA ] != ELFDATA2MSB
+#endif
+    ) {
+    return ELF_BAD_FORMAT;
+  }
+
+  img->ehdr      = ehdr;
+  img->shdr      = NULL;
+  img->shnum     = 0;
+  img->shstr     = NULL;
+  img->shstrsize = 0;
+
+  // a stripped file may not have section header table at all
+  if(ehdr->e_shoff == 0) return ELF_NO_ERROR;
+
+  if(ehdr->e_shentsize != sizeof(Elf64_Shdr) ||
+     !InRange(img,ehdr->e_shoff,sizeof(Elf64_Shdr))) {
+    return ELF_BAD_FORMAT;
+  }
+
+  img->shdr  = (const Elf64_Shdr*)(img->base + ehdr->e_shoff);
+
+  // extended section numbering stores the real value in the first section
+  img->shnum = ehdr->e_shnum ? ehdr->e_shnum : img->shdr[0].sh_size;
+  shstrndx   = ehdr->e_shstrndx == SHN_XINDEX ? img->shdr[0].sh_link :
+                                                ehdr->e_shstrndx;
+
+  // the count may come from the file as a 64 bits value , so it is divided
+  // instead of multiplied to not overflow
+  if(img->shnum > (img->size - ehdr->e_shoff) / sizeof(Elf64_Shdr)) {
+    return ELF_BAD_FORMAT;
+  }
+
+  // a section name is only looked up in a terminated string table , so it
+  // cannot run out of the mapping
+  if(shstrndx != SHN_UNDEF && shstrndx < img->shnum) {
+    const Elf64_Shdr* shdr = img->shdr + shstrndx;
+    const char*       str  = ElfImageSectionData(img,shdr);
+    if(str && shdr->sh_size && str[shdr->sh_size - 1] == 0) {
+      img->shstr     = str;
+      img->shstrsize = shdr->sh_size;
+    }
+  }
+  return ELF_NO_ERROR;
+}
+
+int ElfImageOpen( ElfImage* img , const char* path ) {
+  struct stat st;
+  void* base;
+  int fd = open(path,O_RDONLY | O_CLOEXEC);
+  if(fd < 0) {
+    return ELF_CANNOT_OPEN;
+  }
+
+  if(fstat(fd,&st) || st.st_size == 0) {
+    close(fd);
+    return ELF_CANNOT_OPEN;
+  }
+
+  base = mmap(NULL,(size_t)(st.st_size),PROT_READ,MAP_PRIVATE,fd,0);
+  close(fd);
+  if(base == MAP_FAILED) {
+    return ELF_CANNOT_OPEN;
+  }
+
+  img->base = base;
+  img->size = (size_t)(st.st_size);
+
+  if(ValidateHeader(img)) {
+    ElfImageClose(img);
+    return ELF_BAD_FORMAT;
+  }
+  return ELF_NO_ERROR;
+}
+
+void ElfImageClose( ElfImage* img ) {
+  if(img->base) {
+    munmap((void*)img->base,img->size);
+  }
+  img->base = NULL;
+  img->size = 0;
+  img->ehdr = NULL;
+  img->shdr = NULL;
+  img->shnum= 0;
+  img->shstr= NULL;
+  img->shstrsize = 0;
+}
+
+const void* ElfImageSectionData( const ElfImage* img , const Elf64_Shdr* shdr ) {
+  if(shdr->sh_type == SHT_NOBITS || !InRange(img,shdr->sh_offset,shdr->sh_size))
+    return NULL;
+  return img->base + shdr->sh_offset;
+}
+
+const Elf64_Phdr* ElfImageProgramHeaders( const ElfImage* img , size_t* n ) {
+  const Elf64_Ehdr* ehdr = img->ehdr;
+  if(ehdr->e_phoff == 0 || ehdr->e_phentsize != sizeof(Elf64_Phdr) ||
+     !InRange(img,ehdr->e_phoff,(uint64_t)(ehdr->e_phnum) * sizeof(Elf64_Phdr))) {
+    *n = 0;
+    return NULL;
+  }
+  *n = ehdr->e_phnum;
+  return (const Elf64_Phdr*)(img->base + ehdr->e_phoff);
+}
+
+const Elf64_Shdr* ElfImageFindSection( const ElfImage* img , const char* name ) {
+  size_t i;
+  if(!img->shstr) return NULL;
+
+  for( i = 0 ; i < img->shnum ; ++i ) {
+    const Elf64_Shdr* shdr = img->shdr + i;
+    if(shdr->sh_name < img->shstrsize && strcmp(img->shstr + shdr->sh_name,name) == 0)
+      return shdr;
+  }
+  return NULL;
+}
+
+const Elf64_Shdr* ElfImageFindSectionByType( const ElfImage* img , uint32_t type ) {
+  size_t i;
+  for( i = 0 ; i < img->shnum ; ++i ) {
+    if(img->shdr[i].sh_type == type)
+      return img->shdr + i;
+  }
+  return NULL;
+}
+
+void ElfImageForeachSymbol( const ElfImage* img , const Elf64_Shdr* shdr ,
+                                                  ElfSymbolCallback   cb ,
+                                                  void*             data ) {
+  const Elf64_Sym*  sym;
+  const Elf64_Sym*  end;
+  const Elf64_Shdr* strtab;
+  const char*       str;
+
+  if(shdr->sh_entsize != sizeof(Elf64_Sym) || shdr->sh_link >= img->shnum)
+    return;
+
+  strtab = img->shdr + shdr->sh_link;
+  sym    = ElfImageSectionData(img,shdr);
+  str    = ElfImageSectionData(img,strtab);
+  if(!sym || !str || strtab->sh_size == 0)
+    return;
+
+  end = sym + shdr->sh_size / sizeof(Elf64_Sym);
+
+  // the string table must be terminated otherwise the name may run out of
+  // the mapping
+  if(str[strtab->sh_size - 1] != 0)
+    return;
+
+  for( ; sym != end ; ++sym ) {
+    if(sym->st_name >= strtab->sh_size)
+      continue;
+    if(cb(data,str + sym->st_name,sym))
+      break;
+  }
+}
@@ -0,0 +1,55 @@
+#ifndef ELF_IMAGE_H_
+#define ELF_IMAGE_H_
+
+#include <elf.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// A read only memory mapped ELF64 file. Nothing is copied out of the file,
+// every pointer handed out by the functions below points into the mapping
+// and stays valid until ElfImageClose is called.
+typedef struct _ElfImage {
+  const char*       base;   // start of the mapping
+  size_t            size;   // size of the mapping
+  const Elf64_Ehdr* ehdr;   // elf header
+  const Elf64_Shdr* shdr;   // section header table , NULL if stripped
+  size_t            shnum;  // number of section headers
+  const char*       shstr;  // section name string table , NULL if not valid
+  size_t            shstrsize; // size of the string table
+} ElfImage;
+
+// Error code used to indicate error while opening the elf image
+#define ELF_NO_ERROR        0
+#define ELF_CANNOT_OPEN    -1
+#define ELF_BAD_FORMAT     -2
+
+// Map the file indicated by path and validate it is a native ELF64 file
+int  ElfImageOpen ( ElfImage* , const char* path );
+
+// Unmap the file
+void ElfImageClose( ElfImage* );
+
+// Get the program header table , return NULL if the file has none
+const Elf64_Phdr* ElfImageProgramHeaders( const ElfImage* , size_t* );
+
+// Find a section by its name , return NULL if no such section
+const Elf64_Shdr* ElfImageFindSection( const ElfImage* , const char* );
+
+// Find the first section with the type , ie SHT_SYMTAB
+const Elf64_Shdr* ElfImageFindSectionByType( const ElfImage* , uint32_t );
+
+// Get the content of a section inside of the file , return NULL if the
+// section has no content in the file or its range is not valid
+const void* ElfImageSectionData( const ElfImage* , const Elf64_Shdr* );
+
+// Callback function for each symbol in a symbol table section , return
+// non zero to stop the iteration
+typedef int (*ElfSymbolCallback)( void* , const char* , const Elf64_Sym* );
+
+// Walk all the symbols inside of a SHT_SYMTAB/SHT_DYNSYM section in place ,
+// the name passed to the callback points into the mapped string table
+void ElfImageForeachSymbol( const ElfImage* , const Elf64_Shdr* ,
+                                              ElfSymbolCallback ,
+                                              void*             );
+
+#endif // ELF_IMAGE_H_
@@ -0,0 +1,111 @@
+#include "jobserver.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <unistd.h>
+
+// Find the value of the last jobserver option in MAKEFLAGS , a recursive
+// make appends its own so the last one is the innermost
+static int FindJobServerAuth( const char* flags , char* buf , size_t len ) {
+  static const char* kOption[] = { "--jobserver-auth=" , "--jobserver-fds=" };
+  const char* p = flags;
+  int found = 0;
+
+  while(*p) {
+    const char* end;
+    size_t i;
+
+    while(*p == ' ') ++p;
+    for( end = p ; *end && *end != ' ' ; ++end )
+      ;
+
+    for( i = 0 ; i < sizeof(kOption) / sizeof(kOption[0]) ; ++i ) {
+      size_t n = strlen(kOption[i]);
+      if((size_t)(end - p) > n && strncmp(p,kOption[i],n) == 0 &&
+         (size_t)(end - p) - n < len) {
+        memcpy(buf,p + n,(end - p) - n);
+        buf[(end - p) - n] = 0;
+        found = 1;
+      }
+    }
+    p = end;
+  }
+  return found ? 0 : -1;
+}
+
+// The read end gets its own open file description , so it can be made
+// nonblocking without affecting make and the other children sharing it
+static int OpenPrivate( int fd ) {
+  char path[64];
+  snprintf(path,sizeof(path),"/proc/self/fd/%d",fd);
+  return open(path,O_RDONLY | O_NONBLOCK | O_CLOEXEC);
+}
+
+int JobServerOpen( JobServer* js ) {
+  const char* flags = getenv("MAKEFLAGS");
+  char        auth[4096];
+
+  js->rfd     = -1;
+  js->wfd     = -1;
+  js->own_wfd = 0;
+
+  if(!flags || FindJobServerAuth(flags,auth,sizeof(auth))) return -1;
+
+  if(strncmp(auth,"fifo:",5) == 0) {
+    if((js->rfd = open(auth + 5,O_RDONLY | O_NONBLOCK | O_CLOEXEC)) < 0) goto fail;
+    if((js->wfd = open(auth + 5,O_WRONLY | O_CLOEXEC)) < 0) goto fail;
+    js->own_wfd = 1;
+  } else {
+    char* end;
+    long  r = strtol(auth,&end,10) , w;
+    if(*end != ',') goto fail;
+    w = strtol(end + 1,&end,10);
+    if(*end || r < 0 || w < 0) goto fail;
+
+    // make closes them for a command it does not consider recursive
+    if(fcntl((int)(r),F_GETFD) < 0 || fcntl((int)(w),F_GETFD) < 0) goto fail;
+    if((js->rfd = OpenPrivate((int)(r))) < 0) goto fail;
+    js->wfd = (int)(w);
+  }
+  return 0;
+
+fail:
+  JobServerClose(js);
+  return -1;
+}
+
+int JobServerAcquire( JobServer* js , int ms ) {
+  for( ;; ) {
+    struct pollfd pfd;
+    unsigned char token;
+    ssize_t ret = read(js->rfd,&token,1);
+
+    if(ret == 1) return token;
+    if(ret < 0 && errno == EINTR) continue;
+    if(ret == 0 || errno != EAGAIN || ms == 0) return -1;
+
+    // another child may take the token between the poll and the read
+    pfd.fd     = js->rfd;
+    pfd.events = POLLIN;
+    if((ret = poll(&pfd,1,ms)) < 0 && errno != EINTR) return -1;
+    if(ret == 0) return -1;
+  }
+}
+
+void JobServerRelease( JobServer* js , int token ) {
+  unsigned char c = (unsigned char)(token);
+  while(write(js->wfd,&c,1) < 0 && errno == EINTR)
+    ;
+}
+
+void JobServerClose( JobServer* js ) {
+  if(js->rfd >= 0) close(js->rfd);
+  if(js->own_wfd && js->wfd >= 0) close(js->wfd);
+  js->rfd     = -1;
+  js->wfd     = -1;
+  js->own_wfd = 0;
+}
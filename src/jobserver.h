@@ -0,0 +1,31 @@
+#ifndef JOBSERVER_H_
+#define JOBSERVER_H_
+
+/**
+ * Client of the GNU make jobserver. A make started with -j passes a pipe
+ * holding one byte per free job slot to its children through MAKEFLAGS ,
+ * either as a pair of inherited fds ( --jobserver-auth=R,W ) or as a named
+ * fifo ( --jobserver-auth=fifo:PATH ). Every child owns one implicit slot
+ * and reads a byte before running anything more concurrently , and writes
+ * the same byte back once it is done with it.
+ */
+typedef struct _JobServer {
+  int rfd;          // read end , private and nonblocking
+  int wfd;          // write end
+  int own_wfd;      // whether the write end is opened by us
+} JobServer;
+
+// Find the jobserver of the parent make , returns -1 if there is none or
+// make does not share it with this command
+int JobServerOpen( JobServer* );
+
+// Take a token , waiting up to ms milliseconds for one ( -1 waits forever ).
+// Returns the token or -1 if none is free in time
+int JobServerAcquire( JobServer* , int ms );
+
+// Give a token back to make
+void JobServerRelease( JobServer* , int token );
+
+void JobServerClose( JobServer* );
+
+#endif // JOBSERVER_H_
@@ -0,0 +1,170 @@
+#include "journal.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#define JOURNAL_MAGIC   "CUNITPP-JOURNAL"
+#define JOURNAL_VERSION (1)
+
+// Records the file grows by , 1MB
+#define JOURNAL_CHUNK   (4096)
+
+// The records of the last second may be lost on a power failure , a test
+// ending more than this long after the last sync syncs the file
+#define JOURNAL_SYNC_US (1000000)
+
+_Static_assert(sizeof(JournalRecord) == 256,"a journal record must be 256 bytes");
+
+static uint64_t JournalNow() {
+  struct timespec res;
+  clock_gettime(CLOCK_MONOTONIC,&res);
+  return res.tv_sec * 1000000 + res.tv_nsec / 1000;
+}
+
+// FNV-1a over the record without the check , never 0 so an unused record
+// never matches
+static uint32_t RecordCheck( const JournalRecord* r ) {
+  const uint8_t* p = (const uint8_t*)(r) + sizeof(r->check);
+  size_t         n = sizeof(*r) - sizeof(r->check);
+  uint32_t       h = 2166136261u;
+  for( ; n ; --n , ++p ) {
+    h ^= *p;
+    h *= 16777619u;
+  }
+  return h ? h : 1;
+}
+
+// The check goes last , a record torn by a crash in the middle of the
+// write does not match
+static void SealRecord( JournalRecord* r ) {
+  __atomic_store_n(&(r->check),RecordCheck(r),__ATOMIC_RELEASE);
+}
+
+static int MapJournal( Journal* j , size_t cap ) {
+  void* m;
+
+  if(ftruncate(j->fd,(off_t)(cap * sizeof(JournalRecord)))) return -1;
+  m = mmap(NULL,cap * sizeof(JournalRecord),PROT_READ | PROT_WRITE,MAP_SHARED,j->fd,0);
+  if(m == MAP_FAILED) return -1;
+
+  if(j->rec) munmap(j->rec,j->cap * sizeof(JournalRecord));
+  j->rec = m;
+  j->cap = cap;
+  return 0;
+}
+
+void JournalName( char* buf , const char* module , const char* name ) {
+  snprintf(buf,JOURNAL_NAME_SIZE,"%s.%s",module,name);
+}
+
+int JournalOpen( Journal* j , const char* path , int keep ) {
+  struct stat st;
+  size_t cap , i;
+
+  j->rec  = NULL;
+  j->size = 0;
+  j->cap  = 0;
+  j->sync = JournalNow();
+  if((j->fd = open(path,O_RDWR | O_CLOEXEC | (keep ? 0 : O_CREAT | O_TRUNC),0644)) < 0)
+    return -1;
+  if(fstat(j->fd,&st)) goto fail;
+
+  cap = (size_t)(st.st_size) / sizeof(JournalRecord);
+  if(keep && cap == 0) {
+    errno = EINVAL;
+    goto fail;
+  }
+  if(MapJournal(j,cap + JOURNAL_CHUNK)) goto fail;
+
+  if(keep) {
+    JournalRecord* h = j->rec;
+    if(h->check != RecordCheck(h) || h->state != JOURNAL_VERSION ||
+       strcmp(h->name,JOURNAL_MAGIC) != 0) {
+      errno = EINVAL;
+      goto fail;
+    }
+    // only a torn record is dropped , the records after it are still good.
+    // The new ones go after the last good record
+    j->size = 1;
+    for( i = 1 ; i < j->cap ; ++i ) {
+      JournalRecord* r = j->rec + i;
+      if(r->check && r->check == RecordCheck(r)) {
+        j->size = i + 1;
+      } else if(r->check || r->state || r->name[0]) {
+        memset(r,0,sizeof(*r));
+      }
+    }
+  } else {
+    JournalRecord* h = j->rec;
+    memset(h,0,sizeof(*h));
+    h->state = JOURNAL_VERSION;
+    snprintf(h->name,sizeof(h->name),"%s",JOURNAL_MAGIC);
+    SealRecord(h);
+    j->size = 1;
+  }
+  return 0;
+
+fail:
+  {
+    int e = errno;
+    JournalClose(j);
+    errno = e;
+  }
+  return -1;
+}
+
+// Append a record , it is sealed once every field is written
+static void AppendRecord( Journal* j , uint32_t state , uint64_t elapsed ,
+                                                        const char* module ,
+                                                        const char* name ) {
+  JournalRecord* r;
+
+  if(j->size == j->cap && MapJournal(j,j->cap + JOURNAL_CHUNK)) return;
+  r = j->rec + j->size++;
+  r->state    = state;
+  r->elapsed  = elapsed;
+  r->reserved = 0;
+  JournalName(r->name,module,name);
+  SealRecord(r);
+}
+
+void JournalBegin( Journal* j , const char* module , const char* name ) {
+  AppendRecord(j,JOURNAL_RUNNING,0,module,name);
+}
+
+void JournalEnd( Journal* j , const char* module , const char* name , int      rcode ,
+                                                                      uint64_t elapsed ) {
+  uint64_t now;
+
+  AppendRecord(j,rcode ? JOURNAL_FAILED : JOURNAL_PASSED,elapsed,module,name);
+
+  // a killed process loses nothing , the page cache holds the records , but
+  // a machine going down loses whatever is not written back yet
+  now = JournalNow();
+  if(now - j->sync >= JOURNAL_SYNC_US) {
+    msync(j->rec,j->size * sizeof(JournalRecord),MS_SYNC);
+    j->sync = now;
+  }
+}
+
+void JournalClose( Journal* j ) {
+  if(j->rec) {
+    msync(j->rec,j->size * sizeof(JournalRecord),MS_SYNC);
+    munmap(j->rec,j->cap * sizeof(JournalRecord));
+    // drop the unused tail , the file ends with its last record
+    if(j->size && ftruncate(j->fd,(off_t)(j->size * sizeof(JournalRecord)))) {
+      // the zero tail is harmless
+    }
+  }
+  if(j->fd >= 0) close(j->fd);
+  j->fd   = -1;
+  j->rec  = NULL;
+  j->size = 0;
+  j->cap  = 0;
+}
@@ -0,0 +1,60 @@
+#ifndef JOURNAL_H_
+#define JOURNAL_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * Progress journal of a run , a file of fixed size records mapped into the
+ * memory. A test appends a record once it starts and another one with its
+ * result once it ends , so whatever the process dies of the records are
+ * already in the page cache. A record is never written twice and its check
+ * is written last , so a crash leaves at most one torn record whose check
+ * does not match , it is dropped by the next load. The latest record of a
+ * test wins. The first record is the header , the file grows in chunks and
+ * the unused tail is zero.
+ */
+
+// Room for MODULE.NAME , a longer name is truncated the same way everywhere
+#define JOURNAL_NAME_SIZE (232)
+
+enum {
+  JOURNAL_RUNNING = 1,    // started , the run died before it ended
+  JOURNAL_PASSED,
+  JOURNAL_FAILED
+};
+
+typedef struct _JournalRecord {
+  uint32_t check;                   // hash of the rest , 0 if unused or torn
+  uint32_t state;                   // JOURNAL_* , the version for the header
+  uint64_t elapsed;                 // in microseconds
+  uint64_t reserved;
+  char     name[JOURNAL_NAME_SIZE]; // MODULE.NAME
+} JournalRecord;
+
+typedef struct _Journal {
+  int            fd;
+  JournalRecord* rec;       // the mapping , rec[0] is the header
+  size_t         size;      // records in use , the header included
+  size_t         cap;       // records mapped
+  uint64_t       sync;      // when the file was last synced , in microseconds
+} Journal;
+
+// Open the journal at path. A new journal is created unless keep is set ,
+// then the records of the existing one are loaded and new ones are appended
+// after them. Returns -1 if it cannot be opened or is not a journal
+int  JournalOpen ( Journal* , const char* path , int keep );
+
+// Append the record of a test that starts
+void JournalBegin( Journal* , const char* module , const char* name );
+
+// Append the record of the result of a test
+void JournalEnd  ( Journal* , const char* module , const char* name , int      rcode ,
+                                                                      uint64_t elapsed );
+
+// Format MODULE.NAME the way the records store it
+void JournalName ( char* buf , const char* module , const char* name );
+
+void JournalClose( Journal* );
+
+#endif // JOURNAL_H_
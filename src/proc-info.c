@@ -1,4 +1,11 @@
+#define _GNU_SOURCE
+
 #include "proc-info.h"
+#include "elf-image.h"
+#include "arena.h"
+#include "symbol-table.h"
+#include "profile.h"
+#include "cunitpp.h"
 #include "util.h"
 
 #include <assert.h>
@@ -6,19 +13,30 @@
 #include <stdlib.h>
 #include <ctype.h>
 #include <string.h>
+#include <limits.h>
 
 #include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
 #include <unistd.h>
 #include <fcntl.h>
-
-#include <libelf.h>
+#include <link.h>
+#include <dlfcn.h>
+#include <pthread.h>
 
 // Module information structure. Represent a loaded *elf* module
 typedef struct _ModuleInfo {
   struct _ModuleInfo* next;  // link to next module
   uintptr_t start;           // start of the loading address for this module
   uintptr_t end  ;           // end of the loading address for this module
+  uintptr_t offset;          // file offset that is mapped at the start address
+  uintptr_t bias ;           // load bias , difference between st_value and address
+  int  bias_valid;           // whether the bias is reported by the dynamic loader
+  const ElfW(Dyn)* dynamic;  // PT_DYNAMIC of the module in memory , may be NULL
+  const ElfW(Phdr)* phdr;    // program header in memory , NULL if not loaded by us
+  size_t          phnum;     // number of program header
   const char* path;          // path of the module , if it is the *process* itself, it is NULL
+  ElfImage  image;           // mapped elf file , symbol names point into it
 } ModuleInfo;
 
 // Symbol information
@@ -29,22 +47,21 @@ typedef struct _SymbolInfo {
   ModuleInfo* mod;
 } SymbolInfo;
 
-typedef struct _SymbolEntry {
-  struct _SymbolEntry* chain;
-  SymbolInfo* info;
-  const char* name;
-  uint64_t    hash;
-} SymbolEntry;
-
 // Process Information structure
 struct ProcInfo {
   ModuleInfo* mod;   // header of the module loaded for this proc , NULL if no
                      // module has been loaded, etc -nostdlib
 
-  // hash table for symbol entry using open addressing
-  SymbolEntry* entry;
-  size_t       mask;
-  size_t       size;
+  // mapped test index cache , symbol names point into it when it is used
+  const char*  cache;
+  size_t       cache_size;
+
+  // owns all the modules and symbol information discovered
+  Arena        arena;
+
+  // symbol name to the list of SymbolInfo , names point into the string
+  // table of the mapped elf or the cache
+  SymbolTable  table;
 };
 
 // Skip leading whitespaces
@@ -84,40 +101,6 @@ static int GetNthToken( const char* str , const char** start ,
   return 0;
 }
 
-static const char* FReadLine( FILE* f ) {
-  char* buf = malloc(1024);
-  size_t cap= 1023;
-  size_t pos= 0;
-
-  while(!feof(f) && !ferror(f)) {
-    int c = fgetc(f);
-    if(c == '\n') {
-      buf[pos] = 0;
-      break;
-    }
-
-    if(pos == cap) {
-      size_t rc     = (cap+1) * 2;
-      char* new_buf = malloc(rc);
-      cap = rc - 1;
-      memcpy(new_buf,buf,pos);
-      free  (buf);
-      buf = new_buf;
-    }
-
-    buf[pos++] = c;
-  }
-
-  if(ferror(f)) {
-    free(buf);
-    buf = NULL;
-  } else if(feof(f)) {
-    buf[pos] = 0;
-  }
-
-  return buf;
-}
-
 /** -------------------------------------*
  * Handling of /proc/pid/maps files      |
  * --------------------------------------*/
@@ -125,9 +108,9 @@ static const char* FReadLine( FILE* f ) {
 // Parse a line from the maps file
 // The mapping file contains information as following :
 // [range] [execution flags] [irrelevent] [irrelevent] [irrelevent] [path or other] ...
-static ModuleInfo* MapsParseLine( const char* line ) {
+static ModuleInfo* MapsParseLine( Arena* arena , const char* line ) {
   ModuleInfo*      ret;
-  uintptr_t start, end;
+  uintptr_t start, end, offset;
   const char*     path;
   const char* pstart, *pend;
   const char* p;
@@ -148,18 +131,25 @@ static ModuleInfo* MapsParseLine( const char* line ) {
   if(!(p=strchr(pstart,'-')))
     goto fail;
 
-  start = (uintptr_t)(strtoll(pstart,NULL,16));
-  end   = (uintptr_t)(strtoll(p+1   ,NULL,16));
+  start = (uintptr_t)(strtoull(pstart,NULL,16));
+  end   = (uintptr_t)(strtoull(p+1   ,NULL,16));
+
+  // 3. get the file offset of the mapping
+  if(GetNthToken(line,&pstart,&pend,3))
+    goto fail;
+
+  offset = (uintptr_t)(strtoull(pstart,NULL,16));
 
-  // 3. get the path
+  // 4. get the path
   if(GetNthToken(line,&pstart,&pend,6) || pstart[0] != '/')
     goto fail;
 
-  path = SubStr(pstart,pend);
-  ret  = malloc(sizeof(*ret));
+  path = ArenaSubStr(arena,pstart,pend);
+  ret  = ArenaCalloc(arena,1,sizeof(*ret));
 
   ret->start = start;
   ret->end   = end;
+  ret->offset= offset;
   ret->path  = path;
   ret->next  = NULL;
   return ret;
@@ -168,314 +158,771 @@ fail:
   return NULL;
 }
 
-static int MapsParse( pid_t pid , ModuleInfo** pret , int opt ) {
+static int MapsParse( Arena* arena , pid_t pid , ModuleInfo** pret , int opt ) {
   ModuleInfo* ret = NULL;
   ModuleInfo* cur = NULL;
   char path[1024];
+  char*  line = NULL;
+  size_t cap  = 0;
   FILE* file = NULL;
   snprintf(path,1024,"/proc/%d/maps",(uint32_t)(pid));
 
   if(!(file = fopen(path,"r")))
-    goto fail;
-
-  // go through each line of the file
-  while(!feof(file) && !ferror(file)) {
-    const char* line = FReadLine(file);
-    if(line) {
-      ModuleInfo* mod = MapsParseLine(line);
-      if(mod) {
-        if(!cur) {
-          ret = mod;
-          cur = mod;
-          // check if we can just bailout here if we only need to search the main
-          // app instead of the full dynamic linked library
-          if(opt == PINFO_SRCH_MAIN_ONLY) {
-            free((void*)line);
-            break;
-          }
-        } else {
-          cur->next = mod;
-          cur = mod;
+    return PINFO_CANNOT_OPEN_MAPS;
+
+  // go through each line of the file , the line buffer is reused
+  while(getline(&line,&cap,file) > 0) {
+    ModuleInfo* mod = MapsParseLine(arena,line);
+    if(mod) {
+      if(!cur) {
+        ret = mod;
+        cur = mod;
+        // check if we can just bailout here if we only need to search the main
+        // app instead of the full dynamic linked library
+        if(opt == PINFO_SRCH_MAIN_ONLY) {
+          break;
         }
+      } else {
+        cur->next = mod;
+        cur = mod;
       }
     }
-    free((void*)line);
   }
 
+  free(line);
+  fclose(file);
   *pret = ret;
   return PINFO_NO_ERROR;
-fail:
-  if(file)
-    fclose(file);
-  return PINFO_CANNOT_OPEN_MAPS;
 }
 
-/* ---------------------------------------------
- * Symbol Table Hash                           |
- * --------------------------------------------*/
-static uint64_t StrHash( const char* str , size_t len ) {
-  uint64_t ret = 17771;
-  size_t     i = 0;
-  for( ; i < len ; ++i ) {
-    ret = ret ^ ((ret<<5) + (ret>>2) + str[i]);
+/** -------------------------------------*
+ * Loaded objects from the dynamic loader|
+ * --------------------------------------*/
+typedef struct _PhdrParser {
+  Arena*     arena;
+  ModuleInfo* head;
+  ModuleInfo* tail;
+  int          opt;
+} PhdrParser;
+
+// Create a module from the program header reported by the dynamic loader
+static ModuleInfo* NewPhdrModule( Arena* arena , const struct dl_phdr_info* info ,
+                                                 const char*                path ) {
+  ModuleInfo* mod;
+  uintptr_t start = UINTPTR_MAX , end = 0;
+  const ElfW(Dyn)* dynamic = NULL;
+  ElfW(Half) i;
+
+  for( i = 0 ; i < info->dlpi_phnum ; ++i ) {
+    const ElfW(Phdr)* phdr = info->dlpi_phdr + i;
+    if(phdr->p_type == PT_LOAD && (phdr->p_flags & PF_X)) {
+      uintptr_t s = info->dlpi_addr + phdr->p_vaddr;
+      uintptr_t e = s + phdr->p_memsz;
+      if(s < start) start = s;
+      if(e > end  ) end   = e;
+    } else if(phdr->p_type == PT_DYNAMIC) {
+      dynamic = (const ElfW(Dyn)*)(info->dlpi_addr + phdr->p_vaddr);
+    }
   }
-  return ret;
+
+  mod = ArenaCalloc(arena,1,sizeof(*mod));
+  mod->start      = start == UINTPTR_MAX ? 0 : start;
+  mod->end        = end;
+  mod->bias       = info->dlpi_addr;
+  mod->bias_valid = 1;
+  mod->dynamic    = dynamic;
+  mod->phdr       = info->dlpi_phdr;
+  mod->phnum      = info->dlpi_phnum;
+  mod->path       = path;
+
+  return mod;
 }
 
-#define OPT_INSERT 0
-#define OPT_QUERY  1
+static int OnPhdr( struct dl_phdr_info* info , size_t size , void* data ) {
+  PhdrParser* parser = data;
+  ModuleInfo*    mod;
+  const char*   path;
+
+  (void)size;
+
+  // the first object reported by the loader is always the main program
+  // which comes without a name , every other object without an absolute
+  // path has no file backed by it , ie the vdso
+  if(!parser->head) {
+    char buf[PATH_MAX];
+    ssize_t len = readlink("/proc/self/exe",buf,sizeof(buf)-1);
+    if(len <= 0) return -1;
+    path = ArenaSubStr(parser->arena,buf,buf+len);
+  } else if(info->dlpi_name && info->dlpi_name[0] == '/') {
+    path = ArenaStrDup(parser->arena,info->dlpi_name);
+  } else {
+    return 0;
+  }
 
-static SymbolEntry* _SymbolFindEntry( struct ProcInfo* pinfo ,
-                                      const char* name       ,
-                                      uint64_t    hash       ,
-                                      int          opt        ) {
-  SymbolEntry* prev  = NULL;
-  SymbolEntry* entry = pinfo->entry + (pinfo->mask & hash);
-  if(!entry->name) {
-    // main position of the table is not in used
-    if(opt == OPT_INSERT)
-      return entry;
-    else
-      return NULL;
+  mod = NewPhdrModule(parser->arena,info,path);
+
+  if(parser->tail)
+    parser->tail->next = mod;
+  else
+    parser->head = mod;
+  parser->tail = mod;
+
+  // stop the iteration once the main program is found if we only need to
+  // search the main program
+  return parser->opt == PINFO_SRCH_MAIN_ONLY ? 1 : 0;
+}
+
+// Discover the modules of the current process straight from the dynamic
+// loader , no text parsing of the procfs is needed
+static int PhdrParse( Arena* arena , ModuleInfo** pret , int opt ) {
+  PhdrParser parser = { arena , NULL , NULL , opt };
+  int rcode = dl_iterate_phdr(OnPhdr,&parser);
+  *pret = parser.head;
+  return (rcode < 0 || !parser.head) ? PINFO_NO_MODULE : PINFO_NO_ERROR;
+}
+
+// Locate a single object opened by dlopen , the link map of the handle tells
+// which of the objects reported by the loader it is
+typedef struct _LibraryParser {
+  Arena*                 arena;
+  const struct link_map* lm;
+  ModuleInfo*            mod;
+} LibraryParser;
+
+static int OnLibraryPhdr( struct dl_phdr_info* info , size_t size , void* data ) {
+  LibraryParser* parser = data;
+  (void)size;
+
+  if(info->dlpi_addr != parser->lm->l_addr || !info->dlpi_name ||
+     strcmp(info->dlpi_name,parser->lm->l_name) != 0) {
+    return 0;
   }
 
-  // do a chain resolution
-  do {
-    if(entry->hash == hash && strcmp(entry->name,name) == 0) {
-      return entry;
-    }
-    prev = entry;
-    entry= entry->chain;
-  } while(entry);
+  parser->mod = NewPhdrModule(parser->arena,info,ArenaStrDup(parser->arena,info->dlpi_name));
+  return 1;
+}
 
-  // when we reach here it means we cannot find a entry with the
-  // same name and hash value
-  if(opt == OPT_QUERY) return NULL;
+/* ---------------------------------------------
+ * Symbol Table                                |
+ * --------------------------------------------*/
+static SymbolInfo* SymbolInsert( struct ProcInfo* pinfo , const char* name ) {
+  SymbolSlot* slot = SymbolTableInsert(&(pinfo->table),name);
+  SymbolInfo* ret  = ArenaAlloc(&(pinfo->arena),sizeof(SymbolInfo));
 
-  // do a linear probing to find an empty slot to do the insertion
-  do
-    entry = pinfo->entry + (++hash & pinfo->mask);
-  while(entry->name);
+  // now insert a new symbol info entry into the chain
+  ret->next   = slot->value;
+  slot->value = ret;
+  return ret;
+}
 
-  prev->chain = entry;
-  return entry;
+static SymbolInfo* SymbolFind( struct ProcInfo* pinfo, const char* name ) {
+  SymbolSlot* slot = SymbolTableFind(&(pinfo->table),name);
+  return slot ? slot->value : NULL;
 }
 
-static void _SymbolRehash( struct ProcInfo* pinfo ) {
-  struct ProcInfo temp;
-  size_t i;
-  SymbolEntry* e;
-  SymbolEntry* new_e;
-  size_t newcap = pinfo->size * 2;
+// The symbol information is owned by the arena , only the table is freed
+static void SymbolDelete( struct ProcInfo* pinfo ) {
+  SymbolTableDelete(&(pinfo->table));
+}
 
-  assert( pinfo->mask + 1 == pinfo->size );
+// A symbol found inside of a single module
+typedef struct _ModuleSymbol {
+  const char* name;
+  uintptr_t   base;
+  int         weak;
+} ModuleSymbol;
+
+// Loading job of a single module. Symbols are collected into the job instead
+// of the shared symbol table , so modules can be scanned concurrently and
+// merged into the table afterwards in the module order
+typedef struct _ModuleLoader {
+  ModuleInfo*   mod;
+  int           main;
+  int           rcode;
+  ModuleSymbol* sym;
+  size_t        size;
+  size_t        cap;
+} ModuleLoader;
+
+static int OnElfSymbol( void* data , const char* name , const Elf64_Sym* elf_sym ) {
+  ModuleLoader* loader = data;
+  ModuleSymbol* ms;
+
+  if(elf_sym->st_value == 0 ||
+     (ELF64_ST_BIND(elf_sym->st_info) == STB_NUM) ||
+     (ELF64_ST_TYPE(elf_sym->st_info) != STT_FUNC)) {
+    return 0; // none function type
+  }
+
+#ifndef CONFIG_ALLOW_WEAK_FUNCTION
+  if(ELF64_ST_BIND(elf_sym->st_info) == STB_WEAK) return 0;
+#endif // CONFIG_ALLOW_WEAK_FUNCTION
 
-  temp.mask = newcap - 1;
-  temp.entry= calloc(newcap,sizeof(SymbolEntry));
+  // only the symbols follow our naming schema are interesting , filter them
+  // before anything is inserted into the table
+  if(strncmp(name,CUNIT_SYMBOL_PREFIX,sizeof(CUNIT_SYMBOL_PREFIX)-1) != 0)
+    return 0;
 
-  for( i = 0 ; i < pinfo->size ; ++i ) {
-    e = pinfo->entry + i;
-    assert(e->name);
-    new_e = _SymbolFindEntry(&temp,e->name,e->hash,OPT_INSERT);
-    assert(new_e);
-    new_e->name = e->name;
-    new_e->hash = e->hash;
-    new_e->info = e->info;
+  if(loader->size == loader->cap) {
+    loader->cap = loader->cap ? loader->cap * 2 : 16;
+    loader->sym = realloc(loader->sym,sizeof(ModuleSymbol) * loader->cap);
   }
 
-  free(pinfo->entry);
+  // now we have a test function symbol here , the name is not copied since
+  // the mapping of the elf file is alive as long as the ProcInfo object
+  ms = loader->sym + loader->size++;
+  ms->name = name;
+  ms->base = elf_sym->st_value + loader->mod->bias;
 
-  pinfo->mask = temp.mask;
-  pinfo->entry= temp.entry;
+#ifdef CONFIG_ALLOW_WEAK_FUNCTION
+  ms->weak = ELF64_ST_BIND(elf_sym->st_info) == STB_WEAK;
+#else
+  ms->weak = 0;
+#endif // CONFIG_ALLOW_WEAK_FUNCTION
+  return 0;
 }
 
-static SymbolInfo* SymbolInsert( struct ProcInfo* pinfo , const char* name ) {
-  SymbolInfo* ret;
-  SymbolEntry* e;
-  uint64_t  hash = StrHash(name,strlen(name));
+// Load all the symbol sections that matches the predicate from a mapped elf file
+static void LoadElfSection( ModuleLoader* loader , int (*predicate)(int) ) {
+  ModuleInfo* mod = loader->mod;
+  size_t i;
 
-  if(pinfo->mask+1 == pinfo->size)
-    _SymbolRehash(pinfo);
+  for( i = 0 ; i < mod->image.shnum ; ++i ) {
+    const Elf64_Shdr* shdr = mod->image.shdr + i;
+    if(predicate(shdr->sh_type)) {
+      ElfImageForeachSymbol(&(mod->image),shdr,OnElfSymbol,loader);
+    }
+  }
+}
 
-  // get the symbol from the hash table
-  e = _SymbolFindEntry(pinfo,name,hash,OPT_INSERT);
-  assert(e);
-  if(!e->name) {
-    ++(pinfo->size);
-    // now insert a new symbol info entry into the chain
-    e->hash = hash;
-    e->name = strdup(name);
+static int _MainProgramElfPredicate( int type ) {
+  return type == SHT_SYMTAB || type == SHT_DYNSYM;
+}
+
+static int _DynProgramElfPredicate ( int type ) {
+  return type == SHT_DYNSYM;
+}
+
+// Compute the load bias of the module. The maps file tells the address and
+// the file offset of the executable mapping , the program header tells the
+// virtual address of the segment that covers that file offset
+static int ComputeLoadBias( ModuleInfo* mod ) {
+  const Elf64_Phdr* phdr;
+  size_t i , n;
+
+  // in ubuntu 18.04 the default entry executable is marked as DYN instead
+  // of executable which makes the linked object's address changed , only a
+  // true executable is loaded at the address in its symbol table
+  if(mod->image.ehdr->e_type == ET_EXEC) {
+    mod->bias = 0;
+    return 0;
   }
 
-  ret = malloc(sizeof(SymbolInfo));
-  ret->next = e->info;
-  e->info   = ret;
+  phdr = ElfImageProgramHeaders(&(mod->image),&n);
+  for( i = 0 ; i < n ; ++i ) {
+    uintptr_t page;
+    if(phdr[i].p_type != PT_LOAD) continue;
 
-  return ret;
+    page = phdr[i].p_align > 1 ? phdr[i].p_offset & ~(phdr[i].p_align - 1) :
+                                 phdr[i].p_offset;
+    if(mod->offset >= page && mod->offset < phdr[i].p_offset + phdr[i].p_filesz) {
+      mod->bias = mod->start - (phdr[i].p_vaddr - phdr[i].p_offset + mod->offset);
+      return 0;
+    }
+  }
+  return -1;
 }
 
-static SymbolEntry* SymbolFind( struct ProcInfo* pinfo, const char* name ) {
-  return _SymbolFindEntry(pinfo,name,StrHash(name,strlen(name)),OPT_QUERY);
+// Whether the dynamic string table of the module names a test symbol , a
+// plain memory search that is far cheaper than walking the symbols
+static int HasTestSymbol( const ElfImage* image ) {
+  const Elf64_Shdr* dynsym = ElfImageFindSectionByType(image,SHT_DYNSYM);
+  const Elf64_Shdr* strtab;
+  const char*       str;
+
+  if(!dynsym || dynsym->sh_link >= image->shnum) return 0;
+  strtab = image->shdr + dynsym->sh_link;
+  if(!(str = ElfImageSectionData(image,strtab))) return 0;
+  return memmem(str,strtab->sh_size,CUNIT_SYMBOL_PREFIX,
+                sizeof(CUNIT_SYMBOL_PREFIX)-1) != NULL;
 }
 
-static void SymbolDelete( struct ProcInfo* pinfo ) {
-  size_t i;
-  for( i = 0 ; i < pinfo->mask + 1; ++i ) {
-    SymbolEntry* e = pinfo->entry + i;
-    if(e->name) {
-      SymbolInfo*  t = e->info;
-      free((void*)e->name);
-      do {
-        SymbolInfo* temp = t->next;
-        free(t);
-        t = temp;
-      } while(t);
-    }
+// Scan a module for symbols , it only touches the loader itself so it is
+// safe to be invoked concurrently for different modules
+static int LoadElf( ModuleLoader* loader ) {
+  ModuleInfo* mod = loader->mod;
+
+  if(ElfImageOpen(&(mod->image),mod->path)) {
+    return PINFO_CANNOT_OPEN_ELF;
   }
-  free(pinfo->entry);
 
-  pinfo->entry = NULL;
-  pinfo->mask  = 0;
-  pinfo->size  = 0;
+  if(!mod->bias_valid && ComputeLoadBias(mod)) {
+    return PINFO_ELF_ERROR;
+  }
+
+  if(loader->main) {
+    LoadElfSection(loader,_MainProgramElfPredicate);
+  } else {
+    // a shared object built with our header has the registry section as a
+    // marker. One built with older headers or CONFIG_CUNIT_NO_REGISTRY has
+    // none , its string table is searched for a test symbol instead. Both
+    // skip libc and friends without walking their symbol tables
+    if(!ElfImageFindSection(&(mod->image),CUNIT_REGISTRY_SECTION) &&
+       !HasTestSymbol(&(mod->image)))
+      return PINFO_NO_ERROR;
+    LoadElfSection(loader,_DynProgramElfPredicate );
+  }
+  return PINFO_NO_ERROR;
 }
 
-// Load a elf section from a openned elf stream
-static void LoadElfSection( Elf* elf , struct ProcInfo* pinfo , ModuleInfo* mod ,
-                                                                int (*predicate)(int) ,
-                                                                int zero_offset ) {
-  Elf_Scn*     elf_section = NULL;
-  Elf64_Shdr*  elf_shdr;
-  uintptr_t    offset = zero_offset ? 0 : mod->start;
+/** -------------------------------------*
+ * Concurrent module loading             |
+ * --------------------------------------*/
 
-  while((elf_section = elf_nextscn(elf,elf_section)) != NULL) {
-    if((elf_shdr = elf64_getshdr(elf_section)) != NULL) {
-      if(predicate(elf_shdr->sh_type)) {
-        Elf_Data*  elf_data = elf_getdata(elf_section,NULL);
-        Elf64_Sym* elf_sym;
-        Elf64_Sym* elf_end;
+// Maximum number of threads used to load modules concurrently
+#define LOADER_MAX_THREAD 8
 
-        if(elf_data == NULL || elf_data->d_size == 0) {
-          break;
-        }
+typedef struct _LoaderPool {
+  ModuleLoader* loader;
+  size_t        size;
+  size_t        next;   // next job to pick , updated atomically
+} LoaderPool;
 
-        elf_sym = (Elf64_Sym*)(elf_data->d_buf);
-        elf_end = (Elf64_Sym*)((char*)elf_data->d_buf + elf_data->d_size);
+static void* LoaderThreadMain( void* data ) {
+  LoaderPool* pool = data;
+  size_t i;
+  while((i = __atomic_fetch_add(&(pool->next),1,__ATOMIC_RELAXED)) < pool->size) {
+    pool->loader[i].rcode = LoadElf(pool->loader + i);
+  }
+  return NULL;
+}
 
-        for( ; elf_sym != elf_end ; elf_sym++ ) {
-          const char* name;
-          SymbolInfo* si;
+// Load all the modules , the modules are scanned on a small thread pool and
+// their symbols are merged into the symbol table in the module order
+static int LoadModules( struct ProcInfo* pinfo ) {
+  LoaderPool pool;
+  pthread_t  thread[LOADER_MAX_THREAD];
+  size_t nthread = 0 , i;
+  long   ncpu;
+  int   rcode = PINFO_NO_ERROR;
+  ModuleInfo* m;
+  uint64_t start = ProfileBegin();
+
+  pool.size = 0;
+  pool.next = 0;
+  for( m = pinfo->mod ; m ; m = m->next ) ++pool.size;
+
+  pool.loader = calloc(pool.size,sizeof(ModuleLoader));
+  for( i = 0 , m = pinfo->mod ; m ; m = m->next , ++i ) {
+    pool.loader[i].mod  = m;
+    pool.loader[i].main = (i == 0);
+  }
 
-          if(elf_sym->st_value == 0 ||
-             (ELF64_ST_BIND(elf_sym->st_info) == STB_NUM) ||
-             (ELF64_ST_TYPE(elf_sym->st_info) != STT_FUNC)) {
-            continue; // none function type
-          }
+  // 1. scan all the modules , the calling thread also works on the jobs
+  ncpu = sysconf(_SC_NPROCESSORS_ONLN);
+  if(pool.size > 1 && ncpu > 1) {
+    nthread = (size_t)(ncpu) - 1;
+    if(nthread > LOADER_MAX_THREAD) nthread = LOADER_MAX_THREAD;
+    if(nthread > pool.size - 1    ) nthread = pool.size - 1;
+  }
 
-#ifndef CONFIG_ALLOW_WEAK_FUNCTION
-          if(ELF64_ST_BIND(elf_sym->st_info) == STB_WEAK) continue;
-#endif // CONFIG_ALLOW_WEAK_FUNCTION
+  for( i = 0 ; i < nthread ; ++i ) {
+    if(pthread_create(thread + i,NULL,LoaderThreadMain,&pool)) break;
+  }
+  nthread = i;
 
-          // now we have a function symbol here
-          name = elf_strptr(elf,elf_shdr->sh_link,(size_t)(elf_sym->st_name));
-          si   = SymbolInsert(pinfo,name);
+  LoaderThreadMain(&pool);
 
-#ifdef CONFIG_ALLOW_WEAK_FUNCTION
-          si->weak = ELF64_ST_BIND(elf_sym->st_info) == STB_WEAK;
-#else
-          si->weak = 0;
-#endif // CONFIG_ALLOW_WEAK_FUNCTION
+  for( i = 0 ; i < nthread ; ++i ) {
+    pthread_join(thread[i],NULL);
+  }
 
-          si->mod  = mod;
-          si->base = elf_sym->st_value + offset;
-        }
+  // 2. merge the symbols into the table
+  for( i = 0 ; i < pool.size ; ++i ) {
+    ModuleLoader* loader = pool.loader + i;
+    if(loader->rcode) {
+      if(!rcode) rcode = loader->rcode;
+    } else {
+      size_t j;
+      for( j = 0 ; j < loader->size ; ++j ) {
+        SymbolInfo* si = SymbolInsert(pinfo,loader->sym[j].name);
+        si->weak = loader->sym[j].weak;
+        si->base = loader->sym[j].base;
+        si->mod  = loader->mod;
       }
+      ProfileCount(PROFILE_SYMBOL,loader->size);
     }
+    free(loader->sym);
   }
-}
 
-static int _MainProgramElfPredicate( int type ) {
-  return type == SHT_SYMTAB || type == SHT_DYNSYM;
+  free(pool.loader);
+  ProfileCount(PROFILE_MODULE,pool.size);
+  ProfileEnd(PROFILE_LOAD_ELF,start);
+  return rcode;
 }
 
-static int _DynProgramElfPredicate ( int type ) {
-  return type == SHT_DYNSYM;
+/** -------------------------------------*
+ * Test index cache                      |
+ * --------------------------------------*/
+
+/**
+ * The symbols discovered from the modules are saved into a cache file named
+ * after the NT_GNU_BUILD_ID of the main program. The file is laid out as a
+ * header followed by the module table , the symbol table and a string pool
+ * so it can be used in place once mapped. Symbols are stored as offsets
+ * relative to the load base of their module and rebased on every run.
+ *
+ * A cache file is only used when every module recorded in it is currently
+ * loaded in the same order with the same path and build-id , anything else
+ * falls back to parsing the elf files and rewrites the cache.
+ */
+
+#define CACHE_MAGIC        "CUPPIDX"
+#define CACHE_VERSION      1
+#define CACHE_BUILD_ID_MAX 64
+
+typedef struct _CacheHeader {
+  char     magic[8];
+  uint32_t version;
+  uint32_t opt;            // searching option used to create the cache
+  uint32_t module_size;
+  uint32_t symbol_size;
+  uint64_t string_size;
+  uint64_t file_size;
+} CacheHeader;
+
+typedef struct _CacheModule {
+  uint32_t path;           // offset in the string pool
+  uint32_t build_id_size;
+  uint8_t  build_id[CACHE_BUILD_ID_MAX];
+} CacheModule;
+
+typedef struct _CacheSymbol {
+  uint32_t name;           // offset in the string pool
+  uint32_t module;         // index of the module table
+  uint32_t weak;
+  uint32_t padding;
+  uint64_t offset;         // address relative to the load base of the module
+} CacheSymbol;
+
+// Find the NT_GNU_BUILD_ID note of a module from its loaded program header
+static int GetBuildId( const ModuleInfo* mod , const uint8_t** id , size_t* len ) {
+  size_t i;
+  for( i = 0 ; i < mod->phnum ; ++i ) {
+    const ElfW(Phdr)* phdr = mod->phdr + i;
+    const char* note;
+    const char* end;
+    size_t    align;
+
+    if(phdr->p_type != PT_NOTE) continue;
+
+    note  = (const char*)(mod->bias + phdr->p_vaddr);
+    end   = note + phdr->p_memsz;
+    align = phdr->p_align == 8 ? 8 : 4;
+
+    while(note + sizeof(ElfW(Nhdr)) <= end) {
+      const ElfW(Nhdr)* nhdr = (const ElfW(Nhdr)*)(note);
+      const char*       name = note + sizeof(ElfW(Nhdr));
+      const char*       desc = name + ((nhdr->n_namesz + align - 1) & ~(align - 1));
+
+      if(desc + nhdr->n_descsz > end) break;
+
+      if(nhdr->n_type == NT_GNU_BUILD_ID && nhdr->n_namesz == 4 &&
+         memcmp(name,"GNU",4) == 0) {
+        *id  = (const uint8_t*)(desc);
+        *len = nhdr->n_descsz;
+        return *len && *len <= CACHE_BUILD_ID_MAX ? 0 : -1;
+      }
+      note = desc + ((nhdr->n_descsz + align - 1) & ~(align - 1));
+    }
+  }
+  return -1;
 }
 
-static int LoadElf( struct ProcInfo* pinfo , ModuleInfo* mod , int main ) {
-  int fd = open(mod->path,O_RDONLY);
-  int zero_offset = 0;
-  Elf* elf;
-  Elf64_Ehdr* e64_hdr;
+static void GetCachePath( const char* dir , const ModuleInfo* main , char* buf ,
+                                                                     size_t len ) {
+  const uint8_t* id;
+  size_t     id_len;
+  size_t pos = (size_t)snprintf(buf,len,"%s/",dir);
+  size_t   i;
 
-  if(!fd) {
-    return PINFO_CANNOT_OPEN_ELF;
+  if(GetBuildId(main,&id,&id_len) || pos + id_len * 2 + 5 > len) {
+    buf[0] = 0;
+    return;
   }
 
-  elf = elf_begin(fd,ELF_C_READ,NULL);
-  if(!elf) {
+  for( i = 0 ; i < id_len ; ++i ) {
+    pos += snprintf(buf+pos,len-pos,"%02x",id[i]);
+  }
+  snprintf(buf+pos,len-pos,".idx");
+}
+
+// Validate the cache file against the modules that are currently loaded and
+// insert all the symbols inside of it into the symbol table
+static int CacheLoad( struct ProcInfo* pinfo , const char* path , int opt ) {
+  const CacheHeader* hdr;
+  const CacheModule* cmod;
+  const CacheSymbol* csym;
+  const char*        str;
+  ModuleInfo**       mods = NULL;
+  ModuleInfo*        mod;
+  struct stat         st;
+  void*             base;
+  size_t               i;
+  int fd = open(path,O_RDONLY | O_CLOEXEC);
+
+  if(fd < 0) return -1;
+  if(fstat(fd,&st) || (size_t)(st.st_size) < sizeof(CacheHeader)) {
+    close(fd);
+    return -1;
+  }
+
+  base = mmap(NULL,(size_t)(st.st_size),PROT_READ,MAP_PRIVATE,fd,0);
+  close(fd);
+  if(base == MAP_FAILED) return -1;
+
+  hdr  = base;
+  if(memcmp(hdr->magic,CACHE_MAGIC,sizeof(CACHE_MAGIC)) != 0 ||
+     hdr->version   != CACHE_VERSION                         ||
+     hdr->opt       != (uint32_t)(opt)                       ||
+     hdr->file_size != (uint64_t)(st.st_size)                ||
+     hdr->file_size != sizeof(CacheHeader)                            +
+                       (uint64_t)(hdr->module_size) * sizeof(CacheModule) +
+                       (uint64_t)(hdr->symbol_size) * sizeof(CacheSymbol) +
+                       hdr->string_size                                   ||
+     hdr->string_size == 0) {
     goto fail;
   }
 
-  if(main) {
-    e64_hdr = elf64_getehdr(elf);
-    if(!e64_hdr) {
+  cmod = (const CacheModule*)(hdr + 1);
+  csym = (const CacheSymbol*)(cmod + hdr->module_size);
+  str  = (const char*)(csym + hdr->symbol_size);
+  if(str[hdr->string_size-1] != 0) goto fail;
+
+  // 1. every cached module must be loaded with the same path and build-id
+  mods = malloc(sizeof(ModuleInfo*) * (hdr->module_size + 1));
+  for( i = 0 , mod = pinfo->mod ; i < hdr->module_size ; ++i , mod = mod->next ) {
+    const uint8_t* id;
+    size_t     id_len;
+    if(!mod || cmod[i].path >= hdr->string_size              ||
+       strcmp(str + cmod[i].path,mod->path) != 0             ||
+       GetBuildId(mod,&id,&id_len)                           ||
+       id_len != cmod[i].build_id_size                       ||
+       memcmp(id,cmod[i].build_id,id_len) != 0) {
       goto fail;
     }
+    mods[i] = mod;
+  }
+  if(mod) goto fail;
 
-    // now we check the type of the main executable. in ubuntu 18.04, the
-    // default entry executable is marked as DYN instead of executable that
-    // makes the linked object's address changed which result in segv.
-    if(e64_hdr->e_type != ET_EXEC) {
-      // this binary is not marked as executable but normally as a DYN
-      zero_offset = 0;
-    } else {
-      zero_offset = 1;
-    }
+  for( i = 0 ; i < hdr->symbol_size ; ++i ) {
+    if(csym[i].name >= hdr->string_size || csym[i].module >= hdr->module_size)
+      goto fail;
   }
 
-  if(main) {
-    LoadElfSection(elf,pinfo,mod,_MainProgramElfPredicate,zero_offset);
-  } else {
-    LoadElfSection(elf,pinfo,mod,_DynProgramElfPredicate ,zero_offset);
+  // 2. rebase all the symbols , names point into the mapped cache file
+  for( i = 0 ; i < hdr->symbol_size ; ++i ) {
+    SymbolInfo* si = SymbolInsert(pinfo,str + csym[i].name);
+    si->weak = (int)(csym[i].weak);
+    si->mod  = mods[csym[i].module];
+    si->base = si->mod->bias + csym[i].offset;
   }
 
-  elf_end(elf);
-  close(fd);
-  return PINFO_NO_ERROR;
+  free(mods);
+  pinfo->cache      = base;
+  pinfo->cache_size = (size_t)(st.st_size);
+  return 0;
 
 fail:
-  if(elf) elf_end(elf);
-  close(fd);
-  return PINFO_ELF_ERROR;
+  free(mods);
+  munmap(base,(size_t)(st.st_size));
+  return -1;
+}
+
+typedef struct _CacheWriter {
+  char*  str;
+  size_t str_size;
+  size_t str_cap;
+} CacheWriter;
+
+static uint32_t CacheAddString( CacheWriter* w , const char* s ) {
+  size_t   len = strlen(s) + 1;
+  uint32_t ret = (uint32_t)(w->str_size);
+  if(w->str_size + len > w->str_cap) {
+    size_t ncap = (w->str_size + len) * 2;
+    w->str      = realloc(w->str,ncap);
+    w->str_cap  = ncap;
+  }
+  memcpy(w->str + w->str_size,s,len);
+  w->str_size += len;
+  return ret;
+}
+
+// Write all the symbols into the cache file , the file is written aside and
+// renamed so a concurrent run never observes a partial cache file
+static void CacheSave( struct ProcInfo* pinfo , const char* path , int opt ) {
+  CacheHeader   hdr;
+  CacheModule* cmod = NULL;
+  CacheSymbol* csym = NULL;
+  CacheWriter     w = { NULL , 0 , 0 };
+  ModuleInfo*   mod;
+  size_t msize = 0 , ssize = 0 , i;
+  char tmp[PATH_MAX];
+  FILE* file;
+
+  for( mod = pinfo->mod ; mod ; mod = mod->next ) ++msize;
+  cmod = calloc(msize,sizeof(CacheModule));
+
+  for( i = 0 , mod = pinfo->mod ; mod ; mod = mod->next , ++i ) {
+    const uint8_t* id;
+    size_t     id_len;
+    if(GetBuildId(mod,&id,&id_len)) goto done; // cannot validate it later
+    cmod[i].path          = CacheAddString(&w,mod->path);
+    cmod[i].build_id_size = (uint32_t)(id_len);
+    memcpy(cmod[i].build_id,id,id_len);
+  }
+
+  for( i = 0 ; i < pinfo->table.mask + 1 ; ++i ) {
+    SymbolSlot* e = SymbolTableAt(&(pinfo->table),i);
+    SymbolInfo* si;
+    if(!e) continue;
+    for( si = e->value ; si ; si = si->next ) {
+      size_t idx = 0;
+      for( mod = pinfo->mod ; mod != si->mod ; mod = mod->next ) ++idx;
+
+      csym = realloc(csym,sizeof(CacheSymbol) * (ssize+1));
+      csym[ssize].name    = CacheAddString(&w,e->name);
+      csym[ssize].module  = (uint32_t)(idx);
+      csym[ssize].weak    = (uint32_t)(si->weak);
+      csym[ssize].padding = 0;
+      csym[ssize].offset  = si->base - si->mod->bias;
+      ++ssize;
+    }
+  }
+
+  if(w.str_size == 0) CacheAddString(&w,"");
+
+  memset(&hdr,0,sizeof(hdr));
+  memcpy(hdr.magic,CACHE_MAGIC,sizeof(CACHE_MAGIC));
+  hdr.version     = CACHE_VERSION;
+  hdr.opt         = (uint32_t)(opt);
+  hdr.module_size = (uint32_t)(msize);
+  hdr.symbol_size = (uint32_t)(ssize);
+  hdr.string_size = w.str_size;
+  hdr.file_size   = sizeof(hdr) + msize * sizeof(CacheModule) +
+                                  ssize * sizeof(CacheSymbol) + w.str_size;
+
+  snprintf(tmp,sizeof(tmp),"%s.%d",path,(int)(getpid()));
+  if(!(file = fopen(tmp,"wb"))) goto done;
+
+  if(fwrite(&hdr,sizeof(hdr),1,file) != 1                             ||
+     fwrite(cmod,sizeof(CacheModule),msize,file) != msize              ||
+     (ssize && fwrite(csym,sizeof(CacheSymbol),ssize,file) != ssize)   ||
+     fwrite(w.str,1,w.str_size,file) != w.str_size) {
+    fclose(file);
+    unlink(tmp);
+    goto done;
+  }
+
+  if(fclose(file) || rename(tmp,path)) {
+    unlink(tmp);
+  }
+
+done:
+  free(cmod);
+  free(csym);
+  free(w.str);
 }
 
 int CreateProcInfo( pid_t pid , struct ProcInfo** ret , int opt ) {
-  int rcode;
+  return CreateProcInfoWithCache(pid,ret,opt,NULL);
+}
+
+static struct ProcInfo* NewProcInfo() {
   struct ProcInfo* pinfo = malloc(sizeof(*pinfo));
 
-  elf_version(EV_CURRENT);
+  // initialize the symbol table , only symbols follow the naming schema are
+  // inserted so the table is normally tiny
+  SymbolTableInit(&(pinfo->table),64);
+  pinfo->mod   = NULL;
+  pinfo->cache = NULL;
+  pinfo->cache_size = 0;
+  ArenaInit(&(pinfo->arena),0);
+  return pinfo;
+}
 
-  // initialize the symbol table
-  {
-    size_t cap = 1024;
-    pinfo->mask  = cap - 1;
-    pinfo->size  = 0;
-    pinfo->entry = calloc(cap,sizeof(SymbolEntry));
+int CreateProcInfoWithCache( pid_t pid , struct ProcInfo** ret , int opt ,
+                                                                 const char* cache_dir ) {
+  int rcode;
+  char cache_path[PATH_MAX];
+  struct ProcInfo* pinfo = NewProcInfo();
+  uint64_t start = ProfileBegin();
+
+  // 1. find all the modules , the maps file is only needed when inspecting
+  //    a foreign process
+  if(pid == getpid()) {
+    if((rcode=PhdrParse(&(pinfo->arena),&(pinfo->mod),opt))) goto fail;
+  } else {
+    if((rcode=MapsParse(&(pinfo->arena),pid,&(pinfo->mod),opt))) goto fail;
+  }
+  ProfileEnd(PROFILE_DISCOVER,start);
+
+  // 2. try the cache file , only possible for the current process since the
+  //    build-id is read from the loaded program header
+  cache_path[0] = 0;
+  if(cache_dir && pid == getpid()) {
+    start = ProfileBegin();
+    GetCachePath(cache_dir,pinfo->mod,cache_path,sizeof(cache_path));
+    if(cache_path[0] && CacheLoad(pinfo,cache_path,opt) == 0) {
+      ProfileEnd(PROFILE_CACHE,start);
+      *ret = pinfo;
+      return PINFO_NO_ERROR;
+    }
+    ProfileEnd(PROFILE_CACHE,start);
   }
 
-  // 1. parse the maps file
-  if((rcode=MapsParse(pid,&(pinfo->mod),opt))) return rcode;
+  // 3. go through each of the modules and do the elf parsing
+  if((rcode = LoadModules(pinfo))) goto fail;
 
-  // 2. go through each of the modules and do the elf parsing
-  {
-    int bmain = 1;
-    ModuleInfo* m = pinfo->mod;
-    for( ; m ; m = m->next ) {
-      if((rcode = LoadElf(pinfo,m,bmain))) goto fail;
-      bmain = 0;
-    }
+  if(cache_path[0]) {
+    start = ProfileBegin();
+    CacheSave(pinfo,cache_path,opt);
+    ProfileEnd(PROFILE_CACHE,start);
+  }
+
+  *ret = pinfo;
+  return PINFO_NO_ERROR;
+
+fail:
+  DeleteProcInfo(pinfo);
+  return rcode;
+}
+
+int CreateLibraryProcInfo( void* handle , struct ProcInfo** ret ) {
+  struct ProcInfo* pinfo = NewProcInfo();
+  struct link_map* lm;
+  LibraryParser parser;
+  int rcode;
+
+  if(dlinfo(handle,RTLD_DI_LINKMAP,&lm) || !lm) {
+    rcode = PINFO_NO_MODULE;
+    goto fail;
+  }
+
+  parser.arena = &(pinfo->arena);
+  parser.lm    = lm;
+  parser.mod   = NULL;
+  dl_iterate_phdr(OnLibraryPhdr,&parser);
+  if(!parser.mod) {
+    rcode = PINFO_NO_MODULE;
+    goto fail;
   }
 
+  // the library is the only module , so it is scanned like a main program
+  // and its .symtab is used as well when it is not stripped
+  pinfo->mod = parser.mod;
+  if((rcode = LoadModules(pinfo))) goto fail;
+
   *ret = pinfo;
   return PINFO_NO_ERROR;
 
@@ -499,10 +946,10 @@ void DumpProcInfo( const struct ProcInfo* pinfo , FILE* output ) {
   {
     size_t i = 0;
     fprintf(output,"------------------------ symbol list ----------------------------------\n");
-    for( ; i < pinfo->mask + 1 ; ++i ) {
-      SymbolEntry* se = pinfo->entry + i;
-      if(se->name) {
-        SymbolInfo* si = se->info;
+    for( ; i < pinfo->table.mask + 1 ; ++i ) {
+      SymbolSlot* se = SymbolTableAt(&(pinfo->table),i);
+      if(se) {
+        SymbolInfo* si = se->value;
         for( ; si ; si = si->next ) {
           fprintf(output,"Symbol:%s,Addr:%p,Module:%s,Weak:%d\n",se->name,(void*)si->base,
                                                                           si->mod->path,
@@ -515,32 +962,257 @@ void DumpProcInfo( const struct ProcInfo* pinfo , FILE* output ) {
 }
 
 void DeleteProcInfo( struct ProcInfo* pinfo ) {
-  // 1. delete the module list
+  // 1. unmap the elf files of the module list
   {
     ModuleInfo* mod = pinfo->mod;
-    while(mod) {
-      ModuleInfo* temp = mod->next;
-      free((void*)mod->path);
-      free(mod);
-      mod = temp;
+    for( ; mod ; mod = mod->next ) {
+      ElfImageClose(&(mod->image));
     }
   }
 
   // 2. delete hash table
   SymbolDelete(pinfo);
 
-  // 3. free itself
+  if(pinfo->cache) {
+    munmap((void*)pinfo->cache,pinfo->cache_size);
+  }
+
+  // 3. modules and symbols are all owned by the arena
+  ArenaDelete(&(pinfo->arena));
   free(pinfo);
 }
 
+/** -------------------------------------*
+ * Lazy symbol lookup                    |
+ * --------------------------------------*/
+
+// The dynamic symbol table of a loaded module
+typedef struct _DynamicTable {
+  const ElfW(Sym)* symtab;
+  const char*      strtab;
+  const uint32_t*  gnu_hash;
+  const uint32_t*  hash;
+} DynamicTable;
+
+typedef struct _SymbolQuery {
+  const char** name;
+  void**       addr;
+  size_t       size;
+  size_t       left;   // number of names that are not resolved yet
+} SymbolQuery;
+
+static uint32_t GnuHash( const char* str ) {
+  uint32_t h = 5381;
+  for( ; *str ; ++str ) h = h * 33 + (unsigned char)(*str);
+  return h;
+}
+
+static uint32_t SysvHash( const char* str ) {
+  uint32_t h = 0 , g;
+  for( ; *str ; ++str ) {
+    h = (h << 4) + (unsigned char)(*str);
+    if((g = h & 0xf0000000)) h ^= g >> 24;
+    h &= ~g;
+  }
+  return h;
+}
+
+static int IsStrongFunction( const ElfW(Sym)* sym ) {
+  return sym->st_value != 0                          &&
+         sym->st_shndx != SHN_UNDEF                  &&
+         ELF64_ST_TYPE(sym->st_info) == STT_FUNC     &&
+         ELF64_ST_BIND(sym->st_info) != STB_WEAK;
+}
+
+// Read the dynamic symbol table from the PT_DYNAMIC of a loaded module. The
+// loader normally relocates the pointers inside of it , but not for every
+// module , so an unrelocated pointer is rebased here
+static int GetDynamicTable( const ModuleInfo* mod , DynamicTable* dt ) {
+  const ElfW(Dyn)* dyn = mod->dynamic;
+  memset(dt,0,sizeof(*dt));
+  if(!dyn) return -1;
+
+  for( ; dyn->d_tag != DT_NULL ; ++dyn ) {
+    uintptr_t ptr = dyn->d_un.d_ptr;
+    if(ptr < mod->bias) ptr += mod->bias;
+    switch(dyn->d_tag) {
+      case DT_SYMTAB  : dt->symtab   = (const ElfW(Sym)*)(ptr); break;
+      case DT_STRTAB  : dt->strtab   = (const char*)     (ptr); break;
+      case DT_GNU_HASH: dt->gnu_hash = (const uint32_t*) (ptr); break;
+      case DT_HASH    : dt->hash     = (const uint32_t*) (ptr); break;
+      default: break;
+    }
+  }
+  return dt->symtab && dt->strtab && (dt->gnu_hash || dt->hash) ? 0 : -1;
+}
+
+static const ElfW(Sym)* GnuHashLookup( const DynamicTable* dt , const char* name ) {
+  const uint32_t   nbucket = dt->gnu_hash[0];
+  const uint32_t    symoff = dt->gnu_hash[1];
+  const uint32_t  nbloom   = dt->gnu_hash[2];
+  const uint32_t    shift  = dt->gnu_hash[3];
+  const ElfW(Addr)* bloom  = (const ElfW(Addr)*)(dt->gnu_hash + 4);
+  const uint32_t*  bucket  = (const uint32_t*)(bloom + nbloom);
+  const uint32_t*  chain   = bucket + nbucket;
+  const size_t      nbits  = sizeof(ElfW(Addr)) * 8;
+  uint32_t hash = GnuHash(name);
+  ElfW(Addr) word , mask;
+  uint32_t idx;
+
+  if(nbucket == 0 || nbloom == 0) return NULL;
+
+  // the bloom filter rejects most of the missing names
+  word = bloom[(hash / nbits) % nbloom];
+  mask = ((ElfW(Addr))(1) << (hash % nbits)) |
+         ((ElfW(Addr))(1) << ((hash >> shift) % nbits));
+  if((word & mask) != mask) return NULL;
+
+  if((idx = bucket[hash % nbucket]) < symoff) return NULL;
+
+  for( ;; ++idx ) {
+    uint32_t h = chain[idx - symoff];
+    if((h | 1) == (hash | 1) && strcmp(dt->strtab + dt->symtab[idx].st_name,name) == 0)
+      return dt->symtab + idx;
+    if(h & 1) break;
+  }
+  return NULL;
+}
+
+static const ElfW(Sym)* SysvHashLookup( const DynamicTable* dt , const char* name ) {
+  const uint32_t nbucket = dt->hash[0];
+  const uint32_t*bucket  = dt->hash + 2;
+  const uint32_t*chain   = bucket + nbucket;
+  uint32_t idx;
+
+  if(nbucket == 0) return NULL;
+
+  for( idx = bucket[SysvHash(name) % nbucket] ; idx != STN_UNDEF ; idx = chain[idx] ) {
+    if(strcmp(dt->strtab + dt->symtab[idx].st_name,name) == 0)
+      return dt->symtab + idx;
+  }
+  return NULL;
+}
+
+static void LookupDynamic( const ModuleInfo* mod , SymbolQuery* query ) {
+  DynamicTable dt;
+  size_t i;
+  if(GetDynamicTable(mod,&dt)) return;
+
+  for( i = 0 ; i < query->size ; ++i ) {
+    const ElfW(Sym)* sym;
+    if(query->addr[i]) continue;
+
+    sym = dt.gnu_hash ? GnuHashLookup (&dt,query->name[i]) :
+                        SysvHashLookup(&dt,query->name[i]);
+    if(sym && IsStrongFunction(sym)) {
+      query->addr[i] = (void*)(mod->bias + sym->st_value);
+      --query->left;
+    }
+  }
+}
+
+typedef struct _SymtabScanner {
+  SymbolQuery*      query;
+  const ModuleInfo* mod;
+} SymtabScanner;
+
+static int OnSymtabSymbol( void* data , const char* name , const Elf64_Sym* sym ) {
+  SymtabScanner* scanner = data;
+  SymbolQuery*   query   = scanner->query;
+  size_t i;
+
+  if(!IsStrongFunction(sym) ||
+     strncmp(name,CUNIT_SYMBOL_PREFIX,sizeof(CUNIT_SYMBOL_PREFIX)-1) != 0)
+    return 0;
+
+  for( i = 0 ; i < query->size ; ++i ) {
+    if(!query->addr[i] && strcmp(query->name[i],name) == 0) {
+      query->addr[i] = (void*)(scanner->mod->bias + sym->st_value);
+      --query->left;
+    }
+  }
+
+  // stop scanning once all the names are resolved
+  return query->left == 0;
+}
+
+// Stream the .symtab of the module until all the names are resolved
+static void LookupSymtab( ModuleInfo* mod , SymbolQuery* query ) {
+  SymtabScanner scanner = { query , mod };
+  const Elf64_Shdr* shdr;
+
+  if(ElfImageOpen(&(mod->image),mod->path)) return;
+
+  if((shdr = ElfImageFindSectionByType(&(mod->image),SHT_SYMTAB))) {
+    ElfImageForeachSymbol(&(mod->image),shdr,OnSymtabSymbol,&scanner);
+  }
+  ElfImageClose(&(mod->image));
+}
+
+static int CompareNameSlot( const void* l , const void* r ) {
+  return strcmp(**(const char* const* const*)(l),**(const char* const* const*)(r));
+}
+
+int LookupSymbols( int opt , const char** name , void** addr , size_t size ) {
+  SymbolQuery   query;
+  ModuleInfo*   head;
+  ModuleInfo*    mod;
+  Arena        arena;
+  const char*** order;
+  size_t*       slot;
+  size_t i , n = 0;
+  int rcode;
+
+  for( i = 0 ; i < size ; ++i ) addr[i] = NULL;
+
+  ArenaInit(&arena,4096);
+  order = ArenaAlloc(&arena,sizeof(*order) * (size ? size : 1));
+  slot  = ArenaAlloc(&arena,sizeof(*slot ) * (size ? size : 1));
+
+  // only the well formed unique names are looked up and counted , otherwise
+  // a single bad or repeated name keeps the .symtab scan from stopping early
+  for( i = 0 ; i < size ; ++i ) {
+    slot[i] = (size_t)(-1);
+    if(name[i] && *name[i]) order[n++] = name + i;
+  }
+  qsort(order,n,sizeof(*order),CompareNameSlot);
+
+  query.name = ArenaAlloc (&arena,sizeof(const char*) * (n ? n : 1));
+  query.addr = ArenaCalloc(&arena,n ? n : 1,sizeof(void*));
+  query.size = 0;
+  for( i = 0 ; i < n ; ++i ) {
+    if(!query.size || strcmp(query.name[query.size - 1],*order[i]) != 0)
+      query.name[query.size++] = *order[i];
+    slot[order[i] - name] = query.size - 1;
+  }
+  query.left = query.size;
+
+  if((rcode = PhdrParse(&arena,&head,opt))) goto done;
+
+  // 1. the hash table of each module , in the same order as the loader
+  for( mod = head ; mod && query.left ; mod = mod->next ) {
+    LookupDynamic(mod,&query);
+  }
+
+  // 2. the test functions of the main program are normally not exported
+  if(query.left) {
+    LookupSymtab(head,&query);
+  }
+
+  for( i = 0 ; i < size ; ++i ) {
+    if(slot[i] != (size_t)(-1)) addr[i] = query.addr[slot[i]];
+  }
+
+done:
+  ArenaDelete(&arena);
+  return rcode;
+}
+
 void* FindStrongSymbol( struct ProcInfo* pinfo , const char* name ) {
-  SymbolEntry* e = SymbolFind(pinfo,name);
-  if(e) {
-    // walk through the list to find a strong symbol
-    for( SymbolInfo* info = e->info ; info ; info = info->next ) {
-      if(!info->weak) {
-        return (void*)(info->base);
-      }
+  // walk through the list to find a strong symbol
+  for( SymbolInfo* info = SymbolFind(pinfo,name) ; info ; info = info->next ) {
+    if(!info->weak) {
+      return (void*)(info->base);
     }
   }
   return NULL;
@@ -551,16 +1223,16 @@ void ForeachSymbol( struct ProcInfo* pinfo , BeginSymbolCallback ncb ,
                                              EndSymbolCallback   ecb ,
                                              void*              data ) {
   size_t i = 0;
-  for( ; i < pinfo->mask + 1 ; ++i ) {
-    SymbolEntry* e = pinfo->entry + i;
-    if(e->name) {
+  for( ; i < pinfo->table.mask + 1 ; ++i ) {
+    SymbolSlot* e = SymbolTableAt(&(pinfo->table),i);
+    if(e) {
       switch(ncb(data,e->name)) {
         case PINFO_FOREACH_BREAK:            goto repeat;
         case PINFO_FOREACH_STOP : ecb(data); goto done  ;
         default: break;
       }
 
-      for( SymbolInfo* info = e->info; info ; info = info->next ) {
+      for( SymbolInfo* info = e->value; info ; info = info->next ) {
         switch(cb(data,(void*)(info->base),info->weak)) {
           case PINFO_FOREACH_BREAK:            goto repeat;
           case PINFO_FOREACH_STOP : ecb(data); goto done  ;
@@ -577,3 +1249,143 @@ repeat:
 done:
   return;
 }
+
+/** -------------------------------------*
+ * Address index                         |
+ * --------------------------------------*/
+
+// A function symbol as an address interval
+typedef struct _AddressEntry {
+  uintptr_t   start;
+  uintptr_t   end;
+  const char* name;   // points into the mapped elf
+} AddressEntry;
+
+struct AddressIndex {
+  ModuleInfo*   mod;
+  AddressEntry* entry;  // sorted by the start address
+  size_t        size;
+  size_t        cap;
+  Arena         arena;
+};
+
+typedef struct _AddressScanner {
+  struct AddressIndex* index;
+  ModuleInfo*          mod;
+} AddressScanner;
+
+static int OnAddressSymbol( void* data , const char* name , const Elf64_Sym* sym ) {
+  AddressScanner*     scanner = data;
+  struct AddressIndex* index  = scanner->index;
+  AddressEntry* e;
+
+  if(ELF64_ST_TYPE(sym->st_info) != STT_FUNC || sym->st_shndx == SHN_UNDEF ||
+     sym->st_value == 0 || sym->st_size == 0 || !*name) {
+    return 0;
+  }
+
+  if(index->size == index->cap) {
+    index->cap   = index->cap ? index->cap * 2 : 1024;
+    index->entry = realloc(index->entry,sizeof(AddressEntry) * index->cap);
+  }
+
+  e = index->entry + index->size++;
+  e->start = sym->st_value + scanner->mod->bias;
+  e->end   = e->start + sym->st_size;
+  e->name  = name;
+  return 0;
+}
+
+static int CompareAddressEntry( const void* l , const void* r ) {
+  const AddressEntry* le = l;
+  const AddressEntry* re = r;
+  if(le->start != re->start) return le->start < re->start ? -1 : 1;
+  // prefer the larger interval among aliases
+  return le->end > re->end ? -1 : (le->end < re->end);
+}
+
+int CreateAddressIndex( int opt , struct AddressIndex** ret ) {
+  struct AddressIndex* index = calloc(1,sizeof(*index));
+  ModuleInfo* mod;
+  size_t i , n;
+  int rcode;
+
+  ArenaInit(&(index->arena),0);
+
+  // every module is known so an address outside of the indexed symbols can
+  // still be attributed to its module
+  if((rcode = PhdrParse(&(index->arena),&(index->mod),PINFO_SRCH_ALL))) goto fail;
+
+  for( mod = index->mod ; mod ; mod = mod->next ) {
+    AddressScanner    scanner = { index , mod };
+    const Elf64_Shdr* shdr;
+
+    if(opt == PINFO_SRCH_MAIN_ONLY && mod != index->mod) break;
+    if(ElfImageOpen(&(mod->image),mod->path)) continue;
+
+    // the .symtab has the local functions as well , a stripped module only
+    // has its exported functions
+    if(!(shdr = ElfImageFindSectionByType(&(mod->image),SHT_SYMTAB)))
+      shdr = ElfImageFindSectionByType(&(mod->image),SHT_DYNSYM);
+    if(shdr)
+      ElfImageForeachSymbol(&(mod->image),shdr,OnAddressSymbol,&scanner);
+  }
+
+  qsort(index->entry,index->size,sizeof(AddressEntry),CompareAddressEntry);
+
+  // drop the aliases , the same function shows up in both tables sometimes
+  for( i = 0 , n = 0 ; i < index->size ; ++i ) {
+    if(n && index->entry[n-1].start == index->entry[i].start) continue;
+    index->entry[n++] = index->entry[i];
+  }
+  index->size = n;
+
+  *ret = index;
+  return PINFO_NO_ERROR;
+
+fail:
+  DeleteAddressIndex(index);
+  return rcode;
+}
+
+const char* LookupAddress( const struct AddressIndex* index , uintptr_t addr ,
+                                                             uintptr_t* offset ) {
+  size_t lo = 0 , hi = index->size;
+
+  // find the last interval starting at or below the address
+  while(lo < hi) {
+    size_t mid = lo + (hi - lo) / 2;
+    if(index->entry[mid].start <= addr)
+      lo = mid + 1;
+    else
+      hi = mid;
+  }
+
+  if(lo && addr < index->entry[lo-1].end) {
+    *offset = addr - index->entry[lo-1].start;
+    return index->entry[lo-1].name;
+  }
+  return NULL;
+}
+
+const char* LookupAddressModule( const struct AddressIndex* index , uintptr_t addr ,
+                                                                   uintptr_t* offset ) {
+  const ModuleInfo* mod = index->mod;
+  for( ; mod ; mod = mod->next ) {
+    if(addr >= mod->start && addr < mod->end) {
+      *offset = addr - mod->bias;
+      return mod->path;
+    }
+  }
+  return NULL;
+}
+
+void DeleteAddressIndex( struct AddressIndex* index ) {
+  ModuleInfo* mod = index->mod;
+  for( ; mod ; mod = mod->next ) {
+    ElfImageClose(&(mod->image));
+  }
+  free(index->entry);
+  ArenaDelete(&(index->arena));
+  free(index);
+}
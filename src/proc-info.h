@@ -2,6 +2,7 @@
 #define PROC_INFO_H_
 
 #include <stdio.h>
+#include <stdint.h>
 #include <sys/types.h>
 
 // A opaque structure represents the elf information inside of the current
@@ -14,6 +15,7 @@ struct ProcInfo;
 #define PINFO_CANNOT_OPEN_MAPS -1
 #define PINFO_CANNOT_OPEN_ELF  -2
 #define PINFO_ELF_ERROR        -3
+#define PINFO_NO_MODULE        -4
 
 // Option for searching the symbol
 enum {
@@ -26,12 +28,30 @@ enum {
 // Create a ProcInfo structure w.r.t the pid_t indicated in function
 int CreateProcInfo( pid_t , struct ProcInfo** , int );
 
+// Create a ProcInfo structure and cache the discovered symbols inside of the
+// directory , keyed by the build-id of the main program. Later calls skip the
+// elf parsing as long as all the loaded modules still match the cache file.
+// A NULL directory disables the cache
+int CreateProcInfoWithCache( pid_t , struct ProcInfo** , int , const char* );
+
+// Create a ProcInfo structure that only contains the shared object opened
+// by dlopen with the handle , nothing else of the process is scanned
+int CreateLibraryProcInfo( void* , struct ProcInfo** );
+
 // Dump the proc information into the stream
 void DumpProcInfo ( const struct ProcInfo* , FILE* );
 
 // Find a strong symbol function , should be only one
 void* FindStrongSymbol( struct ProcInfo* , const char* );
 
+// Resolve a list of strong function symbols of the current process without
+// building the ProcInfo symbol table. Names are resolved on demand through
+// the DT_GNU_HASH/DT_HASH table of each module , names that are not exported
+// fall back to a scan of the .symtab of the main program which stops once
+// every name is found. A NULL or empty name is skipped and a repeated one is
+// looked up once. The address of a name that cannot be found is NULL
+int LookupSymbols( int , const char** , void** , size_t );
+
 // Callback function that is invoked by the foreach routine.
 // Return status of SymbolCallback is as following
 enum {
@@ -53,4 +73,24 @@ void  ForeachSymbol( struct ProcInfo* , BeginSymbolCallback , OnSymbolCallback
 // Destroy ProcInfo object
 void DeleteProcInfo( struct ProcInfo* );
 
+// An address sorted interval index over the function symbols of the modules
+// of the current process , built from each symbol's st_size. Used to
+// symbolize addresses , lookups take O(log n) , never allocate and are
+// async-signal-safe
+struct AddressIndex;
+
+// Create the index , with PINFO_SRCH_MAIN_ONLY only the functions of the main
+// program are indexed while every module is still known
+int CreateAddressIndex( int , struct AddressIndex** );
+
+// Find the function covering the address , return its symbol name and set
+// the offset from the start of the function. Return NULL if not found
+const char* LookupAddress( const struct AddressIndex* , uintptr_t , uintptr_t* );
+
+// Find the module covering the address , return its path and set the offset
+// from the load base of the module. Return NULL if not found
+const char* LookupAddressModule( const struct AddressIndex* , uintptr_t , uintptr_t* );
+
+void DeleteAddressIndex( struct AddressIndex* );
+
 #endif // PROC_INFO_H_
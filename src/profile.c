@@ -0,0 +1,74 @@
+#include "profile.h"
+
+#include <stdio.h>
+#include <time.h>
+
+static const char* kProfilePath;
+static uint64_t    kProfilePhase  [PROFILE_PHASE_SIZE];
+static size_t      kProfileCounter[PROFILE_COUNTER_SIZE];
+
+static uint64_t NowNs() {
+  struct timespec res;
+  clock_gettime(CLOCK_MONOTONIC,&res);
+  return (uint64_t)(res.tv_sec) * 1000000000ULL + (uint64_t)(res.tv_nsec);
+}
+
+void ProfileEnable( const char* path ) {
+  kProfilePath = path;
+}
+
+uint64_t ProfileBegin() {
+  return kProfilePath ? NowNs() : 0;
+}
+
+void ProfileEnd( int phase , uint64_t start ) {
+  // the tests may run on several threads
+  if(kProfilePath) __atomic_fetch_add(kProfilePhase + phase,NowNs() - start,__ATOMIC_RELAXED);
+}
+
+void ProfileCount( int counter , size_t n ) {
+  if(kProfilePath) __atomic_fetch_add(kProfileCounter + counter,n,__ATOMIC_RELAXED);
+}
+
+void ProfileDump() {
+  static const char* kPhase[] = {
+    "discover" , "load_elf" , "cache" , "plan" , "index" , "run" , "body" , "output"
+  };
+  static const char* kCounter[] = {
+    "modules" , "symbols" , "tests"
+  };
+  FILE* file;
+  int   i;
+  size_t tests;
+  uint64_t overhead;
+
+  if(!kProfilePath) return;
+
+  if(!(file = fopen(kProfilePath,"w"))) {
+    fprintf(stderr,"cannot write the profile into %s\n",kProfilePath);
+    return;
+  }
+
+  fprintf(file,"{");
+  for( i = 0 ; i < PROFILE_PHASE_SIZE ; ++i ) {
+    fprintf(file,"\"%s_ns\":%llu,",kPhase[i],(unsigned long long)(kProfilePhase[i]));
+  }
+  for( i = 0 ; i < PROFILE_COUNTER_SIZE ; ++i ) {
+    fprintf(file,"\"%s\":%zu,",kCounter[i],kProfileCounter[i]);
+  }
+
+  // the dispatch cost of a test is whatever the runner spends around the
+  // test body except printing. The body adds up across the threads while the
+  // run is wall time , so once the tests overlap there is no per test cost
+  // to derive and null is reported instead of a wrapped value
+  tests    = kProfileCounter[PROFILE_TEST];
+  overhead = kProfilePhase[PROFILE_BODY] + kProfilePhase[PROFILE_OUTPUT];
+  if(overhead > kProfilePhase[PROFILE_RUN]) {
+    fprintf(file,"\"run_overhead_per_test_ns\":null}\n");
+  } else {
+    overhead = kProfilePhase[PROFILE_RUN] - overhead;
+    fprintf(file,"\"run_overhead_per_test_ns\":%.1f}\n",
+            tests ? (double)(overhead) / (double)(tests) : 0.0);
+  }
+  fclose(file);
+}
@@ -0,0 +1,48 @@
+#ifndef PROFILE_H_
+#define PROFILE_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Phase timing of the framework itself. It is disabled by default and then
+// ProfileBegin/ProfileEnd do not even read the clock , once enabled each
+// phase accumulates the nanoseconds spent in it and ProfileDump writes all
+// of them as a JSON object.
+
+// Phases of a run
+enum {
+  PROFILE_DISCOVER,   // find the modules of the process
+  PROFILE_LOAD_ELF,   // scan the symbol tables of the modules
+  PROFILE_CACHE,      // load or save the test index cache
+  PROFILE_PLAN,       // build the test plan from the symbols or the registry
+  PROFILE_INDEX,      // build the address index used by the crash handler
+  PROFILE_RUN,        // run the test plan , includes the two below
+  PROFILE_BODY,       // inside of the test functions
+  PROFILE_OUTPUT,     // print the progress of the run
+  PROFILE_PHASE_SIZE
+};
+
+// Counters of a run
+enum {
+  PROFILE_MODULE,     // modules scanned
+  PROFILE_SYMBOL,     // test symbols found
+  PROFILE_TEST,       // tests run
+  PROFILE_COUNTER_SIZE
+};
+
+// Enable the profiling , the result is written into the path by ProfileDump
+void ProfileEnable( const char* path );
+
+// Start timing , returns 0 if the profiling is disabled
+uint64_t ProfileBegin();
+
+// Add the time since the start into the phase
+void ProfileEnd( int phase , uint64_t start );
+
+// Add n to the counter
+void ProfileCount( int counter , size_t n );
+
+// Write the result as JSON if the profiling is enabled
+void ProfileDump();
+
+#endif // PROFILE_H_
@@ -0,0 +1,84 @@
+#include "symbol-name.h"
+#include "cunitpp.h"
+
+#include <stdio.h>
+#include <string.h>
+
+int GetSymbolType( int meta ) {
+  switch(meta) {
+    case CUNIT_SIMPLE_TEST     : return ST_SIMPLE_TEST;
+    case CUNIT_FIXTURE_TEST    : return ST_FIXTURE_TEST;
+    case CUNIT_FIXTURE_SETUP   : return ST_FIXTURE_SETUP;
+    case CUNIT_FIXTURE_TEARDOWN: return ST_FIXTURE_TEARDOWN;
+    case CUNIT_TEST_TIMEOUT    : return ST_TEST_TIMEOUT;
+    case CUNIT_FIXTURE_PER_TEST: return ST_FIXTURE_PER_TEST;
+    case CUNIT_ENV_SETUP       : return ST_ENV_SETUP;
+    case CUNIT_ENV_TEARDOWN    : return ST_ENV_TEARDOWN;
+    case CUNIT_ASYNC_TEST      : return ST_ASYNC_TEST;
+    case CUNIT_PARAM_TEST      : return ST_PARAM_TEST;
+    case CUNIT_PARAM_VALUES    : return ST_PARAM_VALUES;
+    default:                     return ST_UNKNOWN;
+  }
+}
+
+int GetSymbolMeta( int type ) {
+  switch(type) {
+    case ST_SIMPLE_TEST     : return CUNIT_SIMPLE_TEST;
+    case ST_FIXTURE_TEST    : return CUNIT_FIXTURE_TEST;
+    case ST_FIXTURE_SETUP   : return CUNIT_FIXTURE_SETUP;
+    case ST_FIXTURE_TEARDOWN: return CUNIT_FIXTURE_TEARDOWN;
+    case ST_TEST_TIMEOUT    : return CUNIT_TEST_TIMEOUT;
+    case ST_FIXTURE_PER_TEST: return CUNIT_FIXTURE_PER_TEST;
+    case ST_ENV_SETUP       : return CUNIT_ENV_SETUP;
+    case ST_ENV_TEARDOWN    : return CUNIT_ENV_TEARDOWN;
+    case ST_ASYNC_TEST      : return CUNIT_ASYNC_TEST;
+    case ST_PARAM_TEST      : return CUNIT_PARAM_TEST;
+    case ST_PARAM_VALUES    : return CUNIT_PARAM_VALUES;
+    default:                  return 0;
+  }
+}
+
+int ParseSymbolName( const char* name , SymbolName* output ) {
+  int tt;
+  const char* p;
+
+  // check whether the symbol has our designed the prefix, if not then
+  // just return it is not known to the framework
+  if(strncmp(name,CUNIT_SYMBOL_PREFIX,sizeof(CUNIT_SYMBOL_PREFIX)-1) == 0) {
+    name += sizeof(CUNIT_SYMBOL_PREFIX)-1; // advance and look for the meta character
+    if((tt = GetSymbolType(*name)) == ST_UNKNOWN)
+      goto unknown;
+
+    name ++; // skip the meta character
+    p = strstr(name,CUNIT_MODULE_SEPARATOR);
+    if(p) {
+      output->module     = name;
+      output->module_end = p;
+      output->name       = p+strlen(CUNIT_MODULE_SEPARATOR);
+      return tt;
+    }
+  }
+
+unknown:
+  return ST_UNKNOWN;
+}
+
+int ExplodeSymbolName( const char* name , int   tt ,
+                                          char* mod,
+                                          char* sym,
+                                          char* buf,
+                                          size_t len ) {
+  const char* pend = strchr(name,'.');
+  int mt = GetSymbolMeta(tt);
+
+  if(pend && mt && (size_t)(pend - name) < len && strlen(pend+1) < len) {
+    size_t sz = strlen(pend+1);
+    memcpy(mod,name,pend-name);
+    mod[pend-name] = 0;
+    memcpy(sym,pend+1,sz);
+    sym[sz] = 0;
+    snprintf(buf,len,"%s%c%s%s%s",CUNIT_SYMBOL_PREFIX,mt,mod,CUNIT_MODULE_SEPARATOR,sym);
+    return 0;
+  }
+  return -1;
+}
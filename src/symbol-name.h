@@ -0,0 +1,49 @@
+#ifndef SYMBOL_NAME_H_
+#define SYMBOL_NAME_H_
+
+#include <stddef.h>
+
+// Parsing of the symbol name schema defined in cunitpp.h , shared by the
+// runner and the offline tools
+
+// Internal used symbol name type
+#define ST_UNKNOWN         (-1)
+#define ST_SIMPLE_TEST      (0)
+#define ST_FIXTURE_SETUP    (1)
+#define ST_FIXTURE_TEARDOWN (2)
+#define ST_FIXTURE_TEST     (3)
+#define ST_TEST_TIMEOUT     (4)
+#define ST_FIXTURE_PER_TEST (5)
+#define ST_ENV_SETUP        (6)
+#define ST_ENV_TEARDOWN     (7)
+#define ST_ASYNC_TEST       (8)
+#define ST_PARAM_TEST       (9)
+#define ST_PARAM_VALUES     (10)
+
+// A parsed symbol name , all the fields point into the symbol name itself
+typedef struct _SymbolName {
+  const char* module;
+  const char* module_end;
+  const char* name  ;
+} SymbolName;
+
+// Map the meta character into internal used symbol name type
+int GetSymbolType( int meta );
+
+// Map the internal used symbol name type back to the meta character , return
+// 0 if the type is unknown
+int GetSymbolMeta( int type );
+
+// Resolve the symbol to check whether it is a unknown symbol to our framework ,
+// return the symbol name type. Nothing is allocated
+int ParseSymbolName( const char* name , SymbolName* output );
+
+// Explode a MODULE.NAME string into the module , the name and the symbol name
+// of the type. Each buffer must be able to hold len bytes
+int ExplodeSymbolName( const char* name , int   tt ,
+                                          char* mod,
+                                          char* sym,
+                                          char* buf,
+                                          size_t len );
+
+#endif // SYMBOL_NAME_H_
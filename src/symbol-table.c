@@ -0,0 +1,213 @@
+#include "symbol-table.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif // __SSE2__
+
+#define GROUP_WIDTH 16
+#define CTRL_EMPTY  ((int8_t)(-128))
+
+/* ---------------------------------------------
+ * Hash                                        |
+ * --------------------------------------------*/
+static const uint64_t kSecret[4] = {
+  0xa0761d6478bd642fULL , 0xe7037ed1a0b428dbULL ,
+  0x8ebc6af09c88c6e3ULL , 0x589965cc75374cc3ULL
+};
+
+static inline uint64_t Mix( uint64_t a , uint64_t b ) {
+  __uint128_t r = (__uint128_t)(a) * b;
+  return (uint64_t)(r) ^ (uint64_t)(r >> 64);
+}
+
+static inline uint64_t Read8( const uint8_t* p ) {
+  uint64_t v;
+  memcpy(&v,p,8);
+  return v;
+}
+
+static inline uint64_t Read4( const uint8_t* p ) {
+  uint32_t v;
+  memcpy(&v,p,4);
+  return v;
+}
+
+uint64_t SymbolHash( const char* str , size_t len ) {
+  const uint8_t* p = (const uint8_t*)(str);
+  uint64_t seed = Mix(kSecret[0],kSecret[1]);
+  uint64_t a , b;
+
+  if(len <= 16) {
+    if(len >= 4) {
+      a = (Read4(p) << 32) | Read4(p + ((len >> 3) << 2));
+      b = (Read4(p + len - 4) << 32) | Read4(p + len - 4 - ((len >> 3) << 2));
+    } else if(len > 0) {
+      a = ((uint64_t)(p[0]) << 16) | ((uint64_t)(p[len >> 1]) << 8) | p[len - 1];
+      b = 0;
+    } else {
+      a = b = 0;
+    }
+  } else {
+    size_t i = len;
+    if(i >= 48) {
+      uint64_t s1 = seed , s2 = seed;
+      do {
+        seed = Mix(Read8(p     ) ^ kSecret[1],Read8(p +  8) ^ seed);
+        s1   = Mix(Read8(p + 16) ^ kSecret[2],Read8(p + 24) ^ s1  );
+        s2   = Mix(Read8(p + 32) ^ kSecret[3],Read8(p + 40) ^ s2  );
+        p += 48;
+        i -= 48;
+      } while(i >= 48);
+      seed ^= s1 ^ s2;
+    }
+    while(i > 16) {
+      seed = Mix(Read8(p) ^ kSecret[1],Read8(p + 8) ^ seed);
+      p += 16;
+      i -= 16;
+    }
+    a = Read8(p + i - 16);
+    b = Read8(p + i - 8 );
+  }
+  return Mix(kSecret[1] ^ len,Mix(a ^ kSecret[1],b ^ seed));
+}
+
+/* ---------------------------------------------
+ * Control byte group                          |
+ * --------------------------------------------*/
+
+// Bit i of the returned mask is set when the i-th control byte of the group
+// equals to the value
+static inline uint32_t GroupMatch( const int8_t* ctrl , int8_t value ) {
+#ifdef __SSE2__
+  __m128i group = _mm_loadu_si128((const __m128i*)(ctrl));
+  return (uint32_t)(_mm_movemask_epi8(_mm_cmpeq_epi8(group,_mm_set1_epi8(value))));
+#else
+  uint32_t mask = 0;
+  int i;
+  for( i = 0 ; i < GROUP_WIDTH ; ++i ) {
+    if(ctrl[i] == value) mask |= (1u << i);
+  }
+  return mask;
+#endif // __SSE2__
+}
+
+// H1 picks the start of the probing sequence , H2 is the 7 bits fingerprint
+// stored in the control byte
+static inline size_t H1( uint64_t hash ) { return (size_t)(hash >> 7);   }
+static inline int8_t H2( uint64_t hash ) { return (int8_t)(hash & 0x7f); }
+
+// Set the control byte , the first group is mirrored after the last slot so
+// a group load starting at any slot never wraps around
+static inline void SetCtrl( SymbolTable* t , size_t i , int8_t v ) {
+  t->ctrl[i] = v;
+  if(i < GROUP_WIDTH) t->ctrl[t->mask + 1 + i] = v;
+}
+
+static void AllocTable( SymbolTable* t , size_t cap ) {
+  t->mask = cap - 1;
+  t->size = 0;
+  t->growth_left = cap - cap / 8;
+  t->ctrl = malloc(cap + GROUP_WIDTH);
+  t->slot = malloc(sizeof(SymbolSlot) * cap);
+  memset(t->ctrl,CTRL_EMPTY,cap + GROUP_WIDTH);
+}
+
+void SymbolTableInit( SymbolTable* t , size_t hint ) {
+  size_t cap = GROUP_WIDTH;
+  while(cap - cap / 8 < hint) cap *= 2;
+  AllocTable(t,cap);
+}
+
+void SymbolTableDelete( SymbolTable* t ) {
+  free(t->ctrl);
+  free(t->slot);
+  t->ctrl = NULL;
+  t->slot = NULL;
+  t->mask = 0;
+  t->size = 0;
+  t->growth_left = 0;
+}
+
+// Find the first empty slot in the probing sequence of the hash
+static size_t FindEmpty( const SymbolTable* t , uint64_t hash ) {
+  size_t pos   = H1(hash) & t->mask;
+  size_t step  = 0;
+  for( ;; ) {
+    uint32_t empty = GroupMatch(t->ctrl + pos,CTRL_EMPTY);
+    if(empty) return (pos + (size_t)(__builtin_ctz(empty))) & t->mask;
+    step += GROUP_WIDTH;
+    pos   = (pos + step) & t->mask;
+  }
+}
+
+static SymbolSlot* FindSlot( const SymbolTable* t , const char* name , uint64_t hash ) {
+  size_t pos  = H1(hash) & t->mask;
+  size_t step = 0;
+  int8_t h2   = H2(hash);
+
+  for( ;; ) {
+    uint32_t match = GroupMatch(t->ctrl + pos,h2);
+    while(match) {
+      size_t      i = (pos + (size_t)(__builtin_ctz(match))) & t->mask;
+      SymbolSlot* s = t->slot + i;
+      if(s->hash == hash && strcmp(s->name,name) == 0)
+        return s;
+      match &= match - 1;
+    }
+    // an empty slot in the group terminates the probing sequence
+    if(GroupMatch(t->ctrl + pos,CTRL_EMPTY)) return NULL;
+    step += GROUP_WIDTH;
+    pos   = (pos + step) & t->mask;
+  }
+}
+
+static void Grow( SymbolTable* t ) {
+  SymbolTable old = *t;
+  size_t i;
+
+  AllocTable(t,(old.mask + 1) * 2);
+
+  for( i = 0 ; i < old.mask + 1 ; ++i ) {
+    if(old.ctrl[i] != CTRL_EMPTY) {
+      size_t j = FindEmpty(t,old.slot[i].hash);
+      SetCtrl(t,j,H2(old.slot[i].hash));
+      t->slot[j] = old.slot[i];
+    }
+  }
+  t->size         = old.size;
+  t->growth_left -= old.size;
+
+  free(old.ctrl);
+  free(old.slot);
+}
+
+SymbolSlot* SymbolTableFind( const SymbolTable* t , const char* name ) {
+  return FindSlot(t,name,SymbolHash(name,strlen(name)));
+}
+
+SymbolSlot* SymbolTableInsert( SymbolTable* t , const char* name ) {
+  uint64_t    hash = SymbolHash(name,strlen(name));
+  SymbolSlot* s    = FindSlot(t,name,hash);
+  size_t      i;
+
+  if(s) return s;
+
+  if(t->growth_left == 0) Grow(t);
+
+  i = FindEmpty(t,hash);
+  SetCtrl(t,i,H2(hash));
+  s = t->slot + i;
+  s->name  = name;
+  s->hash  = hash;
+  s->value = NULL;
+  ++t->size;
+  --t->growth_left;
+  return s;
+}
+
+SymbolSlot* SymbolTableAt( const SymbolTable* t , size_t i ) {
+  return t->ctrl[i] == CTRL_EMPTY ? NULL : t->slot + i;
+}
@@ -0,0 +1,53 @@
+#ifndef SYMBOL_TABLE_H_
+#define SYMBOL_TABLE_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * A flat hash map from symbol name to a user pointer , in the style of the
+ * swiss table. Each slot has a control byte which is either EMPTY or the
+ * low 7 bits of the hash of the slot's name. A lookup loads 16 control bytes
+ * at once and compares them against the fingerprint with SSE2 , so most of
+ * the slots that do not match are rejected without touching the slot or the
+ * name at all. The full 64 bits hash is stored in the slot as well , thus the
+ * table grows without hashing any name again.
+ *
+ * Names are not copied , they must outlive the table.
+ */
+
+typedef struct _SymbolSlot {
+  const char* name;
+  uint64_t    hash;
+  void*       value;
+} SymbolSlot;
+
+typedef struct _SymbolTable {
+  int8_t*     ctrl;         // capacity + group width control bytes
+  SymbolSlot* slot;
+  size_t      mask;         // capacity - 1 , capacity is a power of 2
+  size_t      size;
+  size_t      growth_left;  // number of insertion before the table grows
+} SymbolTable;
+
+// Hash function used by the table , a wyhash style multiply mix hash
+uint64_t SymbolHash( const char* , size_t );
+
+// Initialize the table with a capacity hint
+void SymbolTableInit( SymbolTable* , size_t );
+
+// Find the slot of the name , NULL if not found
+SymbolSlot* SymbolTableFind( const SymbolTable* , const char* );
+
+// Find the slot of the name or insert a new slot whose value is NULL. The
+// returned slot is only valid until next insertion
+SymbolSlot* SymbolTableInsert( SymbolTable* , const char* );
+
+// Get the slot at the index , NULL if the slot is empty. Index ranges from 0
+// to the mask of the table , used to iterate the table
+SymbolSlot* SymbolTableAt( const SymbolTable* , size_t );
+
+// Release the memory of the table
+void SymbolTableDelete( SymbolTable* );
+
+#endif // SYMBOL_TABLE_H_
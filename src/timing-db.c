@@ -0,0 +1,183 @@
+#include "timing-db.h"
+#include "symbol-table.h"
+#include "arena.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+// Weight of the latest run in the moving averages
+#define TIMING_ALPHA 0.25
+
+#define TIMING_HEADER "# cunitpp timing v1\n"
+
+struct TimingDB {
+  SymbolTable table;    // MODULE.NAME => TimingEntry
+  Arena       arena;    // owns the entries and their names
+};
+
+static TimingEntry* AddTimingEntry( struct TimingDB* db , const char* name ) {
+  SymbolSlot* slot = SymbolTableFind(&(db->table),name);
+  TimingEntry*   e;
+
+  if(slot) return slot->value;
+
+  e       = ArenaCalloc(&(db->arena),1,sizeof(TimingEntry));
+  e->name = ArenaStrDup(&(db->arena),name);
+  SymbolTableInsert(&(db->table),e->name)->value = e;
+  return e;
+}
+
+// Parse a line of the file , returns -1 if it is malformed
+static int ParseTimingLine( char* line , char** name , TimingEntry* e ) {
+  char* field[5];
+  char* end;
+  int   i;
+
+  for( i = 0 ; i < 5 ; ++i ) {
+    field[i] = strsep(&line,"\t\n");
+    if(!field[i] || !*field[i]) return -1;
+  }
+
+  *name   = field[0];
+  e->runs = (uint32_t)(strtoul(field[1],&end,10));
+  if(*end) return -1;
+  e->last = strtod(field[2],&end);
+  if(*end) return -1;
+  e->mean = strtod(field[3],&end);
+  if(*end) return -1;
+  e->var  = strtod(field[4],&end);
+  if(*end) return -1;
+  return 0;
+}
+
+int LoadTimingDB( const char* path , struct TimingDB** ret ) {
+  struct TimingDB* db = malloc(sizeof(*db));
+  FILE*          file;
+  char*          line = NULL;
+  size_t          cap = 0;
+
+  SymbolTableInit(&(db->table),0);
+  ArenaInit(&(db->arena),0);
+  *ret = db;
+
+  if(!(file = fopen(path,"r"))) return 0;
+
+  while(getline(&line,&cap,file) > 0) {
+    TimingEntry e;
+    char*    name;
+
+    if(line[0] == '#') continue;
+    if(ParseTimingLine(line,&name,&e)) continue;
+
+    {
+      TimingEntry* t = AddTimingEntry(db,name);
+      e.name = t->name;
+      *t     = e;
+    }
+  }
+
+  free(line);
+  fclose(file);
+  return 0;
+}
+
+static const TimingEntry* FindTimingEntry( const struct TimingDB* db , const char* module ,
+                                                                       const char* name   ,
+                                                                       char*       buf    ,
+                                                                       size_t      len    ) {
+  SymbolSlot* slot;
+  snprintf(buf,len,"%s.%s",module,name);
+  slot = SymbolTableFind(&(db->table),buf);
+  return slot ? slot->value : NULL;
+}
+
+const TimingEntry* TimingDBFind( const struct TimingDB* db , const char* module ,
+                                                             const char* name ) {
+  char buf[1024];
+  return FindTimingEntry(db,module,name,buf,sizeof(buf));
+}
+
+void TimingDBUpdate( struct TimingDB* db , const char* module , const char* name ,
+                                                                uint64_t us ) {
+  char         buf[1024];
+  TimingEntry* e = (TimingEntry*)(FindTimingEntry(db,module,name,buf,sizeof(buf)));
+  double       x = (double)(us);
+
+  if(!e) e = AddTimingEntry(db,buf);
+
+  if(e->runs == 0) {
+    e->mean = x;
+    e->var  = 0.0;
+  } else {
+    // exponentially weighted mean and variance , see West 1979
+    double diff = x - e->mean;
+    double incr = TIMING_ALPHA * diff;
+    e->mean += incr;
+    e->var   = (1.0 - TIMING_ALPHA) * (e->var + diff * incr);
+  }
+  e->last = x;
+  ++e->runs;
+}
+
+double TimingDBAverage( const struct TimingDB* db ) {
+  double sum = 0.0;
+  size_t   i , n = 0;
+
+  for( i = 0 ; i <= db->table.mask ; ++i ) {
+    SymbolSlot* slot = SymbolTableAt(&(db->table),i);
+    if(slot) {
+      sum += ((const TimingEntry*)(slot->value))->mean;
+      ++n;
+    }
+  }
+  return n ? sum / (double)(n) : 0.0;
+}
+
+static int CompareTimingEntry( const void* l , const void* r ) {
+  return strcmp((*(const TimingEntry* const*)(l))->name,
+                (*(const TimingEntry* const*)(r))->name);
+}
+
+int SaveTimingDB( const struct TimingDB* db , const char* path ) {
+  const TimingEntry** entry = malloc(sizeof(TimingEntry*) * (db->table.size + 1));
+  char   tmp[4096];
+  FILE*  file;
+  size_t i , n = 0;
+  int    rcode = -1;
+
+  // sorted so the file diffs nicely between runs
+  for( i = 0 ; i <= db->table.mask ; ++i ) {
+    SymbolSlot* slot = SymbolTableAt(&(db->table),i);
+    if(slot) entry[n++] = slot->value;
+  }
+  qsort(entry,n,sizeof(TimingEntry*),CompareTimingEntry);
+
+  if((size_t)(snprintf(tmp,sizeof(tmp),"%s.%d",path,(int)(getpid()))) >= sizeof(tmp) ||
+     !(file = fopen(tmp,"w"))) {
+    goto done;
+  }
+
+  fputs(TIMING_HEADER,file);
+  for( i = 0 ; i < n ; ++i ) {
+    const TimingEntry* e = entry[i];
+    fprintf(file,"%s\t%u\t%.0f\t%.1f\t%.1f\n",e->name,e->runs,e->last,e->mean,e->var);
+  }
+
+  if(fclose(file) == 0 && rename(tmp,path) == 0) {
+    rcode = 0;
+  } else {
+    remove(tmp);
+  }
+
+done:
+  free(entry);
+  return rcode;
+}
+
+void DeleteTimingDB( struct TimingDB* db ) {
+  SymbolTableDelete(&(db->table));
+  ArenaDelete(&(db->arena));
+  free(db);
+}
@@ -0,0 +1,49 @@
+#ifndef TIMING_DB_H_
+#define TIMING_DB_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * Duration history of the tests , persisted between runs into a small text
+ * file with one line per test:
+ *
+ *   MODULE.NAME <tab> RUNS <tab> LAST_US <tab> MEAN_US <tab> VARIANCE_US2
+ *
+ * The mean and the variance are exponentially weighted moving averages , so
+ * they follow a test whose duration changes over time while still smoothing
+ * out the noise of a single run. A missing or unreadable file is an empty
+ * database , a malformed line is skipped.
+ */
+struct TimingDB;
+
+typedef struct _TimingEntry {
+  const char* name;       // MODULE.NAME
+  uint32_t    runs;       // number of passing runs recorded
+  double      last;       // duration of the last run in microseconds
+  double      mean;
+  double      var;
+} TimingEntry;
+
+// Load the database from the file , the file does not need to exist
+int LoadTimingDB( const char* path , struct TimingDB** );
+
+// Find the entry of a test , NULL if it has never been recorded
+const TimingEntry* TimingDBFind( const struct TimingDB* , const char* module ,
+                                                          const char* name );
+
+// Record a passing run of a test that took us microseconds
+void TimingDBUpdate( struct TimingDB* , const char* module , const char* name ,
+                                                             uint64_t us );
+
+// Average of the mean of every recorded test , 0 if the database is empty.
+// Used as the estimated duration of a test that has never been recorded
+double TimingDBAverage( const struct TimingDB* );
+
+// Write the database back into the file , the file is replaced atomically
+// so concurrent runs never see half of it. Returns 0 on success
+int SaveTimingDB( const struct TimingDB* , const char* path );
+
+void DeleteTimingDB( struct TimingDB* );
+
+#endif // TIMING_DB_H_
@@ -87,12 +87,11 @@ static const char* kReset = "\033[0m";
 void ColorFPrintf( FILE* file , const char* format , const char* fg  ,
                                                      const char* bg  ,
                                                      const char* fmt , ... ) {
-  char buf[1024];
   va_list vl;
-  size_t sz;
   va_start(vl,fmt);
-  sz = vsnprintf(buf,1024,fmt,vl);
-  fprintf(file,"\033[%s;%s;%sm",GetFormatCode(format),GetFgColor(fg),GetBgColor(bg));
-  fwrite (buf ,sz,1,file);
-  fwrite (kReset,strlen(kReset),1,file);
+  // no intermediate buffer , the help text alone is longer than any sane one
+  fprintf (file,"\033[%s;%s;%sm",GetFormatCode(format),GetFgColor(fg),GetBgColor(bg));
+  vfprintf(file,fmt,vl);
+  fwrite  (kReset,strlen(kReset),1,file);
+  va_end(vl);
 }
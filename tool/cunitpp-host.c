@@ -0,0 +1,15 @@
+// cunitpp-host , load test shared objects into one process and run them.
+//
+// Usage: cunitpp-host [OPTION]... FILE...
+//
+// Every FILE is loaded with dlopen and only the newly loaded object is
+// scanned for tests , the modules of each library are prefixed with its
+// name , ie Suite1 of ./libfoo.so runs as libfoo/Suite1. The libraries are
+// built with the cunitpp header and left with undefined cunitpp functions ,
+// which are resolved against this program. All the options of RunAllTests
+// except --option and --cache-dir are accepted.
+#include <src/cunitpp.h>
+
+int main( int argc , char** argv ) {
+  return RunHostTests(argc,argv);
+}
@@ -0,0 +1,391 @@
+// cunitpp-list , enumerate the tests of ELF files without executing them.
+//
+// Usage: cunitpp-list [--json] FILE...
+//
+// The tests are read from the cunitpp_tests registry section when the file
+// has one , its pointers are resolved through the relative relocations of
+// the file so the source location is available as well. Files built without
+// the registry fall back to the __CUnitPP_ symbols of .symtab , or .dynsym
+// when the file is stripped. Nothing is loaded , no dependency is resolved
+// and no constructor runs , the file is only mapped read only.
+//
+// Each test is printed as one line , tab separated by default:
+//
+//   FILE  MODULE  NAME  TYPE  SETUP  TEARDOWN  LOCATION
+//
+// TYPE is simple , fixture , async ( TEST_ASYNC ) or param ( TEST_P ) ,
+// SETUP/TEARDOWN is 1 when the fixture module has the function and LOCATION
+// is file:line or - when it is not known.
+// With --json each line is a JSON object with the same fields.
+#include <src/cunitpp.h>
+#include <src/elf-image.h>
+#include <src/symbol-name.h>
+#include <src/arena.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+typedef struct _ListEntry {
+  const char* module;   // interned
+  const char* name;
+  const char* file;     // may be NULL
+  int         line;
+  int         type;     // ST_* type
+} ListEntry;
+
+typedef struct _ListModule {
+  const char* module;   // interned
+  int         setup;
+  int         tear_down;
+} ListModule;
+
+typedef struct _Lister {
+  const ElfImage* img;
+  Arena           arena;
+  StringPool      pool;
+
+  ListEntry*      entry;
+  size_t          size;
+  size_t          cap;
+
+  ListModule*     module;
+  size_t          msize;
+  size_t          mcap;
+} Lister;
+
+static ListModule* FindModule( Lister* l , const char* module ) {
+  size_t i;
+  for( i = 0 ; i < l->msize ; ++i ) {
+    if(l->module[i].module == module) return l->module + i;
+  }
+  if(l->msize == l->mcap) {
+    size_t ncap = l->mcap ? l->mcap * 2 : 16;
+    l->module = ArenaGrow(&(l->arena),l->module,sizeof(ListModule) * l->msize,
+                                                sizeof(ListModule) * ncap);
+    l->mcap   = ncap;
+  }
+  l->module[l->msize].module    = module;
+  l->module[l->msize].setup     = 0;
+  l->module[l->msize].tear_down = 0;
+  return l->module + l->msize++;
+}
+
+static void AddTest( Lister* l , int type , const char* module , const char* module_end ,
+                                                                 const char* name       ,
+                                                                 const char* file       ,
+                                                                 int         line       ) {
+  const char* m = StringPoolIntern(&(l->pool),module,module_end);
+  ListEntry*  e;
+
+  switch(type) {
+    case ST_FIXTURE_SETUP   : FindModule(l,m)->setup     = 1; return;
+    case ST_FIXTURE_TEARDOWN: FindModule(l,m)->tear_down = 1; return;
+    case ST_SIMPLE_TEST     :
+    case ST_FIXTURE_TEST    :
+    case ST_ASYNC_TEST      :
+    case ST_PARAM_TEST      : break;
+    default                 : return;
+  }
+
+  if(l->size == l->cap) {
+    size_t ncap = l->cap ? l->cap * 2 : 64;
+    l->entry = ArenaGrow(&(l->arena),l->entry,sizeof(ListEntry) * l->size,
+                                              sizeof(ListEntry) * ncap);
+    l->cap   = ncap;
+  }
+  e = l->entry + l->size++;
+  e->module = m;
+  e->name   = ArenaStrDup(&(l->arena),name);
+  e->file   = file ? ArenaStrDup(&(l->arena),file) : NULL;
+  e->line   = line;
+  e->type   = type;
+}
+
+/* ---------------------------------------------
+ * Registry section                            |
+ * --------------------------------------------*/
+
+// Relocation type that stores the addend plus the load base
+static uint32_t RelativeType( const ElfImage* img ) {
+  switch(img->ehdr->e_machine) {
+    case EM_X86_64 : return R_X86_64_RELATIVE;
+    case EM_AARCH64: return R_AARCH64_RELATIVE;
+    case EM_RISCV  : return R_RISCV_RELATIVE;
+    default:         return 0;
+  }
+}
+
+// Resolve the pointer stored at vaddr of the registry section. The value of
+// the pointer in a position independent file lives in a relocation , either
+// an explicit RELA entry or a packed RELR bitmap , while a fixed position
+// file stores the address as is
+typedef struct _SectionPointer {
+  uint64_t  base;       // sh_addr of the registry section
+  uint64_t* value;      // resolved pointer per 8 bytes word of the section
+  size_t    size;
+} SectionPointer;
+
+static void SetPointer( SectionPointer* sp , uint64_t vaddr , uint64_t value ) {
+  if(vaddr >= sp->base && vaddr < sp->base + sp->size * 8 && (vaddr & 7) == 0)
+    sp->value[(vaddr - sp->base) / 8] = value;
+}
+
+static void ApplyRela( SectionPointer* sp , const ElfImage* img , const Elf64_Shdr* shdr ) {
+  const Elf64_Rela* rela = ElfImageSectionData(img,shdr);
+  uint32_t       rtype   = RelativeType(img);
+  size_t i , n;
+  if(!rela || shdr->sh_entsize != sizeof(Elf64_Rela)) return;
+  n = shdr->sh_size / sizeof(Elf64_Rela);
+  for( i = 0 ; i < n ; ++i ) {
+    if(ELF64_R_TYPE(rela[i].r_info) == rtype)
+      SetPointer(sp,rela[i].r_offset,(uint64_t)(rela[i].r_addend));
+  }
+}
+
+#ifndef SHT_RELR
+#define SHT_RELR 19
+#endif // SHT_RELR
+
+// RELR relocations keep the addend in place , so the word in the file is the
+// value , only the relocated words are marked
+static void ApplyRelr( SectionPointer* sp , const ElfImage* img , const Elf64_Shdr* shdr ,
+                                            const uint64_t* word ) {
+  const uint64_t* relr = ElfImageSectionData(img,shdr);
+  uint64_t where = 0;
+  size_t i , n;
+  if(!relr) return;
+  n = shdr->sh_size / sizeof(uint64_t);
+  for( i = 0 ; i < n ; ++i ) {
+    if((relr[i] & 1) == 0) {
+      where = relr[i];
+      if(where >= sp->base && where < sp->base + sp->size * 8)
+        SetPointer(sp,where,word[(where - sp->base) / 8]);
+      where += 8;
+    } else {
+      uint64_t bits = relr[i] >> 1;
+      int      j;
+      for( j = 0 ; bits ; ++j , bits >>= 1 ) {
+        uint64_t w = where + j * 8;
+        if((bits & 1) && w >= sp->base && w < sp->base + sp->size * 8)
+          SetPointer(sp,w,word[(w - sp->base) / 8]);
+      }
+      where += 63 * 8;
+    }
+  }
+}
+
+// Map a virtual address to a null terminated string inside of the file
+static const char* AddressToString( const ElfImage* img , uint64_t vaddr ) {
+  const Elf64_Phdr* phdr;
+  size_t n , i;
+
+  if(!vaddr || !(phdr = ElfImageProgramHeaders(img,&n))) return NULL;
+
+  for( i = 0 ; i < n ; ++i ) {
+    if(phdr[i].p_type == PT_LOAD && vaddr >= phdr[i].p_vaddr &&
+                                    vaddr <  phdr[i].p_vaddr + phdr[i].p_filesz) {
+      uint64_t off = vaddr - phdr[i].p_vaddr + phdr[i].p_offset;
+      if(off >= img->size || !memchr(img->base + off,0,img->size - off))
+        return NULL;
+      return img->base + off;
+    }
+  }
+  return NULL;
+}
+
+// Layout of CUnitTestDesc of a 64 bits file
+typedef struct _FileTestDesc {
+  uint64_t module;
+  uint64_t name;
+  uint64_t file;
+  uint64_t func;
+  int32_t  line;
+  int32_t  type;
+} FileTestDesc;
+
+static int ListRegistry( Lister* l ) {
+  const ElfImage*   img  = l->img;
+  const Elf64_Shdr* shdr = ElfImageFindSection(img,CUNIT_REGISTRY_SECTION);
+  const FileTestDesc* desc;
+  SectionPointer sp;
+  size_t i , n;
+  int rcode = -1;
+
+  if(!shdr || !(desc = ElfImageSectionData(img,shdr)) ||
+     shdr->sh_size % sizeof(FileTestDesc) != 0)
+    return -1;
+
+  sp.base  = shdr->sh_addr;
+  sp.size  = shdr->sh_size / 8;
+  sp.value = calloc(sp.size,sizeof(uint64_t));
+
+  if(img->ehdr->e_type == ET_DYN) {
+    for( i = 0 ; i < img->shnum ; ++i ) {
+      if(img->shdr[i].sh_type == SHT_RELA)
+        ApplyRela(&sp,img,img->shdr + i);
+      else if(img->shdr[i].sh_type == SHT_RELR)
+        ApplyRelr(&sp,img,img->shdr + i,(const uint64_t*)(desc));
+    }
+  } else {
+    memcpy(sp.value,desc,sp.size * 8);
+  }
+
+  n = shdr->sh_size / sizeof(FileTestDesc);
+  for( i = 0 ; i < n ; ++i ) {
+    const uint64_t* v = sp.value + i * (sizeof(FileTestDesc) / 8);
+    const char* module = AddressToString(img,v[0]);
+    const char* name   = AddressToString(img,v[1]);
+    const char* file   = AddressToString(img,v[2]);
+    if(!module || !name) goto done;
+    AddTest(l,GetSymbolType(desc[i].type),module,module + strlen(module),name,file,
+                                                                          desc[i].line);
+  }
+  rcode = 0;
+
+done:
+  free(sp.value);
+  return rcode;
+}
+
+/* ---------------------------------------------
+ * Symbol table                                |
+ * --------------------------------------------*/
+static int OnElfSymbol( void* d , const char* name , const Elf64_Sym* sym ) {
+  SymbolName sn;
+  int tt;
+
+  if(ELF64_ST_TYPE(sym->st_info) != STT_FUNC || sym->st_shndx == SHN_UNDEF ||
+     ELF64_ST_BIND(sym->st_info) == STB_WEAK)
+    return 0;
+
+  if((tt = ParseSymbolName(name,&sn)) != ST_UNKNOWN)
+    AddTest(d,tt,sn.module,sn.module_end,sn.name,NULL,0);
+  return 0;
+}
+
+static int ListSymbol( Lister* l ) {
+  const Elf64_Shdr* shdr = ElfImageFindSectionByType(l->img,SHT_SYMTAB);
+  if(!shdr) shdr = ElfImageFindSectionByType(l->img,SHT_DYNSYM);
+  if(!shdr) return -1;
+  ElfImageForeachSymbol(l->img,shdr,OnElfSymbol,l);
+  return 0;
+}
+
+/* ---------------------------------------------
+ * Output                                      |
+ * --------------------------------------------*/
+static int CompareEntry( const void* l , const void* r ) {
+  const ListEntry* le = l;
+  const ListEntry* re = r;
+  int ret = strcmp(le->module,re->module);
+  return ret ? ret : strcmp(le->name,re->name);
+}
+
+static void PrintJsonString( const char* str ) {
+  putchar('"');
+  for( ; *str ; ++str ) {
+    if(*str == '"' || *str == '\\')
+      printf("\\%c",*str);
+    else if((unsigned char)(*str) < 0x20)
+      printf("\\u%04x",(unsigned char)(*str));
+    else
+      putchar(*str);
+  }
+  putchar('"');
+}
+
+static void PrintList( Lister* l , const char* path , int json ) {
+  size_t i;
+  qsort(l->entry,l->size,sizeof(ListEntry),CompareEntry);
+
+  for( i = 0 ; i < l->size ; ++i ) {
+    const ListEntry* e   = l->entry + i;
+    const ListModule* m  = NULL;
+    const char*      tn  = e->type == ST_SIMPLE_TEST ? "simple" :
+                         e->type == ST_ASYNC_TEST  ? "async"  :
+                         e->type == ST_PARAM_TEST  ? "param"  : "fixture";
+    size_t j;
+
+    for( j = 0 ; j < l->msize ; ++j ) {
+      if(l->module[j].module == e->module) m = l->module + j;
+    }
+
+    if(json) {
+      printf("{\"file\":");      PrintJsonString(path);
+      printf(",\"module\":");    PrintJsonString(e->module);
+      printf(",\"name\":");      PrintJsonString(e->name);
+      printf(",\"type\":\"%s\",\"setup\":%s,\"teardown\":%s",tn,
+             m && m->setup     ? "true" : "false",
+             m && m->tear_down ? "true" : "false");
+      printf(",\"location\":");
+      if(e->file) {
+        char buf[1024];
+        snprintf(buf,sizeof(buf),"%s:%d",e->file,e->line);
+        PrintJsonString(buf);
+      } else {
+        printf("null");
+      }
+      printf("}\n");
+    } else {
+      printf("%s\t%s\t%s\t%s\t%d\t%d\t",path,e->module,e->name,tn,m ? m->setup     : 0,
+                                                                  m ? m->tear_down : 0);
+      if(e->file) printf("%s:%d\n",e->file,e->line);
+      else        printf("-\n");
+    }
+  }
+}
+
+static int ListFile( const char* path , int json ) {
+  ElfImage img;
+  Lister   l;
+  int      rcode;
+
+  if((rcode = ElfImageOpen(&img,path))) {
+    fprintf(stderr,"cunitpp-list: cannot open ELF file %s , error code %d\n",path,rcode);
+    return -1;
+  }
+
+  memset(&l,0,sizeof(l));
+  l.img = &img;
+  ArenaInit(&(l.arena),0);
+  StringPoolInit(&(l.pool),&(l.arena));
+
+  if(ListRegistry(&l)) {
+    // start over from the symbol table , the registry may be partially read
+    l.size  = 0;
+    l.msize = 0;
+    if(ListSymbol(&l)) {
+      fprintf(stderr,"cunitpp-list: %s has neither test registry nor symbol table\n",path);
+      rcode = -1;
+    }
+  }
+
+  if(!rcode) PrintList(&l,path,json);
+
+  StringPoolDelete(&(l.pool));
+  ArenaDelete(&(l.arena));
+  ElfImageClose(&img);
+  return rcode;
+}
+
+int main( int argc , char** argv ) {
+  int json  = 0;
+  int rcode = 0;
+  int i     = 1;
+
+  if(i < argc && strcmp(argv[i],"--json") == 0) {
+    json = 1;
+    ++i;
+  }
+
+  if(i == argc) {
+    fprintf(stderr,"usage: %s [--json] FILE...\n",argv[0]);
+    return -1;
+  }
+
+  for( ; i < argc ; ++i ) {
+    if(ListFile(argv[i],json)) rcode = -1;
+  }
+  return rcode;
+}
@@ -0,0 +1,41 @@
+#include "../src/cunitpp.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+// Leave a garbage pattern on the stack , so an option struct that is not
+// fully initialized by the parser points into nowhere
+static void __attribute__((noinline)) DirtyStack() {
+  volatile char buf[16384];
+  memset((char*)(buf),0xa5,sizeof(buf));
+}
+
+// Run the parser on a command line with the environment variable set , the
+// run is expected to stop at the parser
+static int RunWithEnv( const char* name , const char* value ) {
+  char* argv[] = { "cmdline-test" , "--list-test" , NULL };
+  int   rcode;
+
+  setenv(name,value,1);
+  DirtyStack();
+  rcode = RunAllTests(2,argv);
+  unsetenv(name);
+  return rcode;
+}
+
+TEST(CmdLine,InvalidTotalShards) {
+  ASSERT_EQ(RunWithEnv("CUNITPP_TOTAL_SHARDS","bogus"),-1);
+  ASSERT_EQ(RunWithEnv("CUNITPP_TOTAL_SHARDS","0"),-1);
+}
+
+TEST(CmdLine,InvalidShardIndex) {
+  ASSERT_EQ(RunWithEnv("CUNITPP_SHARD_INDEX","-1"),-1);
+}
+
+TEST(CmdLine,InvalidTimeout) {
+  ASSERT_EQ(RunWithEnv("CUNITPP_TIMEOUT","soon"),-1);
+}
+
+int main( int argc , char* argv[] ) {
+  return RunAllTests(argc,argv);
+}
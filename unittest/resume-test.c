@@ -0,0 +1,102 @@
+#include "../src/cunitpp.h"
+#include "../src/journal.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+
+#define JOURNAL_PATH "resume-test.jnl"
+#define ROWS_PATH    "resume-test.rows"
+
+// Enough rows for -j 2 to split the test into slices
+static int kRows[300];
+
+// Every row run by the nested runs appends a byte to the rows file , the
+// workers of -j are forked so the count has to live in a file
+TEST_P(Sliced,Rows,kRows) {
+  const char* path = getenv("RESUME_TEST_ROWS");
+  int fd;
+  (void)row;
+  if(path && (fd = open(path,O_WRONLY | O_APPEND)) >= 0) {
+    ASSERT_EQ(write(fd,"r",1),1);
+    close(fd);
+  }
+}
+
+// Run the Sliced module in a child with -j 2 , returns the exit code and
+// the number of rows it ran
+static int RunSliced( const char* journal_option , size_t* rows ) {
+  char* argv[] = { "resume-test" , "--module-filter" , "Sliced" , "-j" , "2" ,
+                   (char*)(journal_option) , JOURNAL_PATH , NULL };
+  struct stat st;
+  pid_t pid;
+  int   status = 0 , fd;
+
+  if((fd = open(ROWS_PATH,O_WRONLY | O_CREAT | O_TRUNC,0644)) < 0) return -1;
+  close(fd);
+
+  fflush(stdout);
+  fflush(stderr);
+  if((pid = fork()) == 0) {
+    setenv("RESUME_TEST_ROWS",ROWS_PATH,1);
+    _exit(RunAllTests(7,argv) ? 1 : 0);
+  }
+  if(pid < 0 || waitpid(pid,&status,0) < 0) return -1;
+
+  *rows = stat(ROWS_PATH,&st) == 0 ? (size_t)(st.st_size) : 0;
+  unlink(ROWS_PATH);
+  return WIFEXITED(status) ? WEXITSTATUS(status) : -1;
+}
+
+// Write a journal that holds the given slices of Sliced.Rows
+static void WriteSlices( const char** slice , int rcode ) {
+  Journal j;
+  ASSERT_EQ(JournalOpen(&j,JOURNAL_PATH,0),0);
+  for( ; *slice ; ++slice ) {
+    JournalBegin(&j,"Sliced",*slice);
+    JournalEnd  (&j,"Sliced",*slice,rcode,0);
+  }
+  JournalClose(&j);
+}
+
+TEST(Resume,SlicedParamIsDone) {
+  size_t rows;
+
+  unlink(JOURNAL_PATH);
+  ASSERT_EQ(RunSliced("--journal",&rows),0);
+  ASSERT_EQ(rows,300);
+
+  // the slices cover every row , nothing runs again
+  ASSERT_EQ(RunSliced("--resume",&rows),0);
+  ASSERT_EQ(rows,0);
+  unlink(JOURNAL_PATH);
+}
+
+TEST(Resume,SlicedParamFailed) {
+  const char* slice[] = { "Rows[0-149]" , "Rows[150-299]" , NULL };
+  size_t rows;
+
+  WriteSlices(slice,-1);
+  ASSERT_EQ(RunSliced("--resume",&rows),1);
+  ASSERT_EQ(rows,0);
+  unlink(JOURNAL_PATH);
+}
+
+TEST(Resume,SlicedParamMissingRows) {
+  const char* slice[] = { "Rows[0-63]" , "Rows[64-127]" , NULL };
+  size_t rows;
+
+  // the rows past 127 never ran , the test runs again as a whole
+  WriteSlices(slice,0);
+  ASSERT_EQ(RunSliced("--resume",&rows),0);
+  ASSERT_EQ(rows,300);
+  unlink(JOURNAL_PATH);
+}
+
+int main( int argc , char* argv[] ) {
+  return RunAllTests(argc,argv);
+}